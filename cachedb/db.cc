@@ -65,6 +65,9 @@ namespace virtdb { namespace cachedb {
     
     typedef std::map<std::string, column_family::sptr>  column_family_map;
     
+    static const size_t multi_get_batch_size = 1024;
+    static const size_t delete_batch_size    = 1024;
+    
     std::string                      path_;
     column_family_map                column_families_;
     db_sptr                          db_;
@@ -258,112 +261,181 @@ namespace virtdb { namespace cachedb {
     }
     
     size_t
-    fetch(storeable & data)
+    fetch_many(const storeable_ptr_vec_t & data,
+               std::vector<size_t> * found_per_item)
     {
+      if( found_per_item ) found_per_item->assign(data.size(), 0);
       if( !db_ ) { LOG_ERROR("database not yet initialized"); return 0; }
       
       using namespace rocksdb;
       size_t ret = 0;
-      size_t n_columns = 0;
-
-      // make sure the column set has all columns
-      data.default_columns();
-      auto const & colset = data.column_set();
       
-      for( auto const & family : colset )
-      {
-        ++n_columns;
-        auto it = column_families_.find(family.name_);
-        if( it == column_families_.end() )
-        {
-          LOG_ERROR("missing column family" <<
-                    V_(data.clazz()) <<
-                    V_(data.key()) <<
-                    V_(family.name_));
-        }
-        else
+      std::vector<ColumnFamilyHandle*>  cf_handles;
+      std::vector<Slice>                keys;
+      std::vector<std::string *>        targets;
+      std::vector<size_t>               owners;
+      std::vector<std::string>          values;
+      
+      // the lookups go to MultiGet in chunks, the values are swapped
+      // into the properties so they are not copied again
+      auto lookup = [&]() {
+        if( keys.empty() ) return;
+        
+        values.clear();
+        std::vector<Status> statuses = db_->MultiGet(ReadOptions(), cf_handles, keys, &values);
+        for( size_t i=0; i<statuses.size(); ++i )
         {
-          auto cf_handle_sptr = it->second->handle_sptr_;
-          storeable::qual_name qn{family.name_};
-          Status s = db_->Get(ReadOptions(), cf_handle_sptr.get(), data.key(), &(data.property_ref(qn)));
-          if( s.IsNotFound() )
+          if( statuses[i].ok() )
           {
-            // LOG_TRACE("data not found for" << V_(data.key()) << V_(family.name_));
+            targets[i]->swap(values[i]);
+            ++ret;
+            if( found_per_item ) ++((*found_per_item)[owners[i]]);
           }
-          else
+          else if( !statuses[i].IsNotFound() )
           {
-            ++ret;
+            LOG_ERROR("failed to fetch" << V_(keys[i].ToString()) << V_(statuses[i].ToString()));
           }
         }
+        
+        cf_handles.clear();
+        keys.clear();
+        targets.clear();
+        owners.clear();
+      };
+      
+      for( size_t n=0; n<data.size(); ++n )
+      {
+        storeable * st = data[n];
+        if( !st ) continue;
+        
+        // make sure the column set has all columns
+        st->default_columns();
+        auto const & colset = st->column_set();
+        
+        for( auto const & family : colset )
+        {
+          auto it = column_families_.find(family.name_);
+          if( it == column_families_.end() )
+          {
+            LOG_ERROR("missing column family" <<
+                      V_(st->clazz()) <<
+                      V_(st->key()) <<
+                      V_(family.name_));
+            continue;
+          }
+          
+          cf_handles.push_back(it->second->handle_sptr_.get());
+          keys.push_back(Slice(st->key()));
+          targets.push_back(&(st->property_ref(family)));
+          owners.push_back(n);
+        }
+        
+        if( keys.size() >= multi_get_batch_size )
+          lookup();
       }
+      lookup();
       
       return ret;
     }
+    
+    size_t
+    fetch(storeable & data)
+    {
+      return fetch_many(storeable_ptr_vec_t{&data}, nullptr);
+    }
 
     size_t
-    exists(const storeable & data)
+    exists_many(const std::vector<const storeable *> & data,
+                std::vector<size_t> * found_per_item)
     {
+      if( found_per_item ) found_per_item->assign(data.size(), 0);
       if( !db_ ) { LOG_ERROR("database not yet initialized"); return 0; }
-
+      
       using namespace rocksdb;
       size_t ret = 0;
-      size_t n_columns = 0;
-      std::vector<ColumnFamilyHandle*> cf_handles;
-            
-      auto const & colset = data.column_set();
       
-      for( auto const & family : colset )
-      {
-        ++n_columns;
-        auto it = column_families_.find(family.name_);
-        if( it == column_families_.end() )
-        {
-          LOG_ERROR("missing column family" <<
-                    V_(data.clazz()) <<
-                    V_(data.key()) <<
-                    V_(family.name_));
-        }
-        else
+      std::vector<ColumnFamilyHandle*>  cf_handles;
+      std::vector<Slice>                keys;
+      std::vector<size_t>               owners;
+      std::vector<std::string>          values;
+      
+      auto found = [&](size_t owner) {
+        ++ret;
+        if( found_per_item ) ++((*found_per_item)[owner]);
+      };
+      
+      // KeyMayExist may give false positives, these are checked with
+      // real lookups
+      auto confirm = [&]() {
+        if( keys.empty() ) return;
+        
+        values.clear();
+        std::vector<Status> statuses = db_->MultiGet(ReadOptions(), cf_handles, keys, &values);
+        for( size_t i=0; i<statuses.size(); ++i )
         {
-          cf_handles.push_back(it->second->handle_sptr_.get());
+          if( statuses[i].ok() ) found(owners[i]);
         }
-      }
-            
-      if( cf_handles.size() > 0 )
-      {
-        std::vector<Iterator*> cf_iterators;
-        Status s = db_->NewIterators(ReadOptions(),
-                                     cf_handles,
-                                     &cf_iterators);
         
-        bool in_valid_iterators = ( !s.ok() || cf_iterators.size() != n_columns );
+        cf_handles.clear();
+        keys.clear();
+        owners.clear();
+      };
+      
+      std::string value;
+      for( size_t n=0; n<data.size(); ++n )
+      {
+        const storeable * st = data[n];
+        if( !st ) continue;
         
-        // cleanup iterator
-        for( auto & i : cf_iterators )
+        auto const & colset = st->column_set();
+        for( auto const & family : colset )
         {
-          if( !in_valid_iterators )
+          auto it = column_families_.find(family.name_);
+          if( it == column_families_.end() )
           {
-            i->Seek(data.key());
-            if( i->Valid() )
-            {
-              ++ret;
-            }
+            LOG_ERROR("missing column family" <<
+                      V_(st->clazz()) <<
+                      V_(st->key()) <<
+                      V_(family.name_));
+            continue;
+          }
+          
+          auto * cf_handle = it->second->handle_sptr_.get();
+          bool value_found = false;
+          if( !db_->KeyMayExist(ReadOptions(), cf_handle, st->key(), &value, &value_found) )
+            continue;
+          
+          if( value_found )
+          {
+            // it was in the memtable or the block cache
+            found(n);
+          }
+          else
+          {
+            cf_handles.push_back(cf_handle);
+            keys.push_back(Slice(st->key()));
+            owners.push_back(n);
+            if( keys.size() >= multi_get_batch_size )
+              confirm();
           }
-          delete i;
         }
       }
+      confirm();
       
       return ret;
     }
     
     size_t
-    set(const storeable & data)
+    exists(const storeable & data)
+    {
+      return exists_many(std::vector<const storeable *>{&data}, nullptr);
+    }
+    
+    size_t
+    prepare(const storeable & data,
+            rocksdb::WriteBatch & batch)
     {
-      if( !db_ ) { LOG_ERROR("database not yet initialized"); return 0; }
-
-      using namespace rocksdb;
       size_t ret = 0;
-      WriteBatch batch;
       auto update_columns = [this,&ret,&batch]
                                   (const std::string & _clazz,
                                    const std::string & _key,
@@ -390,17 +462,38 @@ namespace virtdb { namespace cachedb {
       
       // fire batch update preparation
       data.properties(update_columns);
-
-      if( ret > 0 )
+      return ret;
+    }
+    
+    bool
+    write(rocksdb::WriteBatch & batch,
+          bool disable_wal,
+          bool sync)
+    {
+      if( !db_ ) { LOG_ERROR("database not yet initialized"); return false; }
+      
+      auto wropts = rocksdb::WriteOptions();
+      wropts.sync = sync;
+      wropts.disableWAL = disable_wal;
+      rocksdb::Status s = db_->Write(wropts, &batch);
+      if( !s.ok() )
       {
-        auto wropts = rocksdb::WriteOptions();
-        wropts.sync = false;
-        Status s = db_->Write(wropts, &batch);
-        if( !s.ok() )
-        {
-          ret = 0;
-        }
+        LOG_ERROR("failed to write batch" << V_(batch.Count()) << V_(s.ToString()));
+        return false;
       }
+      return true;
+    }
+    
+    size_t
+    set(const storeable & data)
+    {
+      if( !db_ ) { LOG_ERROR("database not yet initialized"); return 0; }
+
+      rocksdb::WriteBatch batch;
+      size_t ret = prepare(data, batch);
+      
+      if( ret > 0 && !write(batch, false, false) )
+        ret = 0;
       
       if( !ret )
       {
@@ -412,12 +505,154 @@ namespace virtdb { namespace cachedb {
       return ret;
     }
     
+    std::vector<column_family::sptr>
+    families_of(const std::string & clazz) const
+    {
+      std::vector<column_family::sptr> ret;
+      std::string prefix{clazz + '.'};
+      for( auto it = column_families_.lower_bound(prefix);
+           it != column_families_.end() && it->first.compare(0, prefix.size(), prefix) == 0;
+           ++it )
+      {
+        ret.push_back(it->second);
+      }
+      return ret;
+    }
+    
+    size_t
+    remove_many(const std::vector<const storeable *> & data)
+    {
+      if( !db_ ) { LOG_ERROR("database not yet initialized"); return 0; }
+      
+      size_t ret = 0;
+      rocksdb::WriteBatch batch;
+      
+      auto commit = [&]() {
+        if( !batch.Count() ) return;
+        if( write(batch, false, false) )
+          ret += batch.Count();
+        batch.Clear();
+      };
+      
+      for( auto st : data )
+      {
+        if( !st ) continue;
+        
+        auto const & colset = st->column_set();
+        if( colset.empty() )
+        {
+          for( auto const & cf : families_of(st->clazz()) )
+            batch.Delete(cf->handle_sptr_.get(), st->key());
+        }
+        else
+        {
+          for( auto const & family : colset )
+          {
+            auto it = column_families_.find(family.name_);
+            if( it == column_families_.end() )
+            {
+              LOG_ERROR("missing column family" <<
+                        V_(st->clazz()) <<
+                        V_(st->key()) <<
+                        V_(family.name_));
+              continue;
+            }
+            batch.Delete(it->second->handle_sptr_.get(), st->key());
+          }
+        }
+        
+        if( (size_t)batch.Count() >= delete_batch_size )
+          commit();
+      }
+      commit();
+      
+      return ret;
+    }
+    
     size_t
     remove(const storeable & data)
+    {
+      return remove_many(std::vector<const storeable *>{&data});
+    }
+    
+    size_t
+    scan(const storeable::qual_name & family,
+         const std::string & prefix,
+         scan_function fn) const
     {
       if( !db_ ) { LOG_ERROR("database not yet initialized"); return 0; }
-
-      return 0;
+      
+      auto it = column_families_.find(family.name_);
+      if( it == column_families_.end() )
+      {
+        LOG_ERROR("missing column family" << V_(family.name_) << V_(prefix));
+        return 0;
+      }
+      
+      rocksdb::ReadOptions ropts;
+      // the prefix may be shorter than the prefix extractor's, so the hash
+      // index cannot be used. scans shouldn't push out the hot blocks
+      ropts.total_order_seek  = true;
+      ropts.fill_cache        = false;
+      
+      size_t ret = 0;
+      std::unique_ptr<rocksdb::Iterator> iter{db_->NewIterator(ropts, it->second->handle_sptr_.get())};
+      for( iter->Seek(prefix); iter->Valid() && iter->key().starts_with(prefix); iter->Next() )
+      {
+        ++ret;
+        if( !fn(iter->key().ToString(), iter->value().ToString()) )
+          break;
+      }
+      
+      if( !iter->status().ok() )
+      {
+        LOG_ERROR("failed to scan column family" <<
+                  V_(family.name_) <<
+                  V_(prefix) <<
+                  V_(iter->status().ToString()));
+      }
+      return ret;
+    }
+    
+    size_t
+    remove_prefix(const std::string & clazz,
+                  const std::string & prefix)
+    {
+      if( !db_ ) { LOG_ERROR("database not yet initialized"); return 0; }
+      
+      // a typo shouldn't wipe the whole class
+      if( prefix.empty() )
+      {
+        LOG_ERROR("refusing to remove with an empty prefix" << V_(clazz));
+        return 0;
+      }
+      
+      // the bundled rocksdb has no DeleteRange, so the keys are collected
+      // with an iterator and deleted in batches
+      size_t ret = 0;
+      rocksdb::WriteBatch batch;
+      
+      auto commit = [&]() {
+        if( !batch.Count() ) return;
+        if( write(batch, false, false) )
+          ret += batch.Count();
+        batch.Clear();
+      };
+      
+      for( auto const & cf : families_of(clazz) )
+      {
+        auto * handle = cf->handle_sptr_.get();
+        scan(storeable::qual_name{cf->name_}, prefix,
+             [&](const std::string & key, const storeable::data_t &) {
+          batch.Delete(handle, key);
+          if( (size_t)batch.Count() >= delete_batch_size )
+            commit();
+          return true;
+        });
+      }
+      commit();
+      
+      return ret;
     }
     
     bool
@@ -440,6 +675,40 @@ namespace virtdb { namespace cachedb {
       return ret;
     }
     
+    bool
+    compact(const std::string & clazz)
+    {
+      if( !db_ ) { LOG_ERROR("database not yet initialized"); return false; }
+      bool ret = true;
+      
+      for( auto const & cf : families_of(clazz) )
+      {
+        rocksdb::Status s = db_->CompactRange(cf->handle_sptr_.get(), nullptr, nullptr);
+        if( !s.ok() )
+        {
+          LOG_ERROR("failed to compact column family" << V_(cf->name_) << V_(s.ToString()));
+          ret = false;
+        }
+      }
+      return ret;
+    }
+    
+    uint64_t
+    disk_usage() const
+    {
+      if( !db_ ) { LOG_ERROR("database not yet initialized"); return 0; }
+      
+      // the WAL and the info logs would count the removed keys until
+      // they are rotated, so only the live SST files are summed
+      std::vector<rocksdb::LiveFileMetaData> files;
+      db_->GetLiveFilesMetaData(&files);
+      
+      uint64_t ret = 0;
+      for( auto const & f : files )
+        ret += f.size;
+      return ret;
+    }
+    
     impl() : db_{nullptr}
     {
       // set options for default coumn family
@@ -494,30 +763,94 @@ namespace virtdb { namespace cachedb {
     return impl_->remove(data);
   }
   
+  size_t
+  db::remove_many(const storeable_ptr_vec_t & data)
+  {
+    std::vector<const storeable *> items{data.begin(), data.end()};
+    return impl_->remove_many(items);
+  }
+  
+  size_t
+  db::remove_prefix(const std::string & clazz,
+                    const std::string & prefix)
+  {
+    return impl_->remove_prefix(clazz, prefix);
+  }
+  
   size_t
   db::exists(const storeable & data)
   {
     return impl_->exists(data);
   }
   
+  size_t
+  db::exists_many(const storeable_ptr_vec_t & data,
+                  std::vector<size_t> * found_per_item)
+  {
+    std::vector<const storeable *> items{data.begin(), data.end()};
+    return impl_->exists_many(items, found_per_item);
+  }
+  
   size_t
   db::fetch(storeable & data)
   {
     return impl_->fetch(data);
   }
   
+  size_t
+  db::fetch_many(const storeable_ptr_vec_t & data,
+                 std::vector<size_t> * found_per_item)
+  {
+    return impl_->fetch_many(data, found_per_item);
+  }
+  
+  size_t
+  db::scan(const storeable::qual_name & family,
+           const std::string & prefix,
+           scan_function fn) const
+  {
+    return impl_->scan(family, prefix, fn);
+  }
+  
   bool
   db::flush(bool sync)
   {
     return impl_->flush(sync);
   }
   
+  bool
+  db::compact(const std::string & clazz)
+  {
+    return impl_->compact(clazz);
+  }
+  
+  size_t
+  db::prepare(const storeable & data,
+              rocksdb::WriteBatch & batch)
+  {
+    return impl_->prepare(data, batch);
+  }
+  
+  bool
+  db::write(rocksdb::WriteBatch & batch,
+            bool disable_wal,
+            bool sync)
+  {
+    return impl_->write(batch, disable_wal, sync);
+  }
+  
   std::set<std::string>
   db::column_families() const
   {
     return impl_->column_families();
   }
   
+  uint64_t
+  db::disk_usage() const
+  {
+    return impl_->disk_usage();
+  }
+  
   db::db() : impl_{new impl} {}
   db::~db() {}
 }}
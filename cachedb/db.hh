@@ -5,9 +5,15 @@
 #include <vector>
 #include <string>
 #include <set>
+#include <functional>
+#include <cstdint>
+
+namespace rocksdb { class WriteBatch; }
 
 namespace virtdb { namespace cachedb {
   
+  class writer;
+  
   class db
   {
     struct impl;
@@ -16,20 +22,59 @@ namespace virtdb { namespace cachedb {
     db(const db &) = delete;
     db & operator=(const db &) = delete;
     
+    friend class writer;
+    
+    // puts the properties of data into the batch, returns the number
+    // of columns added
+    size_t prepare(const storeable & data,
+                   rocksdb::WriteBatch & batch);
+    bool write(rocksdb::WriteBatch & batch,
+               bool disable_wal,
+               bool sync);
+    
   public:
     typedef std::shared_ptr<db>      sptr;
     typedef std::vector<storeable *> storeable_ptr_vec_t;
+    typedef std::function<bool(const std::string & key,
+                               const storeable::data_t & value)> scan_function;
     
     bool init(const std::string & path,
               const storeable_ptr_vec_t & stvec);
     
+    // deletes the key from the column families in the column set, or
+    // from all families of the class if the set is empty. returns the
+    // number of deletes written
     size_t remove(const storeable & data);
+    size_t remove_many(const storeable_ptr_vec_t & data);
+    // deletes every key starting with prefix from all families of clazz,
+    // returns the number of deletes written. the space is given back by
+    // the compactions
+    size_t remove_prefix(const std::string & clazz,
+                         const std::string & prefix);
     size_t set(const storeable & data);
     size_t exists(const storeable & data);
+    // counts the stored columns of the items without fetching them. the
+    // bloom filters rule out most of the missing keys
+    size_t exists_many(const storeable_ptr_vec_t & data,
+                       std::vector<size_t> * found_per_item=nullptr);
     size_t fetch(storeable & data);
+    // fetches all columns of all items with batched lookups. returns the
+    // number of columns found, found_per_item gets the same per item
+    size_t fetch_many(const storeable_ptr_vec_t & data,
+                      std::vector<size_t> * found_per_item=nullptr);
+    // calls fn with the keys starting with prefix and their values in key
+    // order, until fn returns false. returns the number of keys visited
+    size_t scan(const storeable::qual_name & family,
+                const std::string & prefix,
+                scan_function fn) const;
     bool flush(bool sync=false);
+    // compacts all families of clazz, so removed keys free their space
+    bool compact(const std::string & clazz);
     
     std::set<std::string> column_families() const;
+    // total size of the live SST files. the memtables, the WAL and the
+    // logs are not counted
+    uint64_t disk_usage() const;
     
     db();
     virtual ~db();
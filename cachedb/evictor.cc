@@ -0,0 +1,371 @@
+#ifdef RELEASE
+#define LOG_TRACE_IS_ENABLED false
+#define LOG_SCOPED_IS_ENABLED false
+#endif //RELEASE
+
+#include "evictor.hh"
+#include <cachedb/query_table_log.hh>
+#include <cachedb/query_table_block.hh>
+#include <cachedb/query_column_block.hh>
+#include <cachedb/column_data.hh>
+#include <util/timer_service.hh>
+#include <logger.hh>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <map>
+#include <set>
+#include <vector>
+
+namespace virtdb { namespace cachedb {
+  
+  evictor::options::options()
+  : max_age_sec_{24*3600},
+    max_disk_bytes_{0},
+    interval_ms_{60000},
+    max_passes_{8}
+  {
+  }
+  
+  struct evictor::impl
+  {
+    typedef std::chrono::steady_clock                  clock;
+    typedef std::chrono::system_clock::time_point      time_point;
+    typedef std::vector<std::pair<time_point, std::string>>  query_vec;
+    
+    static const size_t remove_batch_size = 1024;
+    
+    db &                                   db_;
+    options                                options_;
+    std::mutex                             run_mtx_;
+    mutable std::mutex                     stats_mtx_;
+    stats                                  stats_;
+    std::unique_ptr<util::timer_service>   timer_;
+    
+    impl(db & d, const options & opts)
+    : db_(d),
+      options_(opts),
+      stats_{0,0,0,0,0,0,0,0}
+    {
+    }
+    
+    ~impl()
+    {
+      // stop the background runs before the members go
+      timer_.reset();
+    }
+    
+    bool
+    has_family(const storeable::qual_name & qn) const
+    {
+      return db_.column_families().count(qn.name_) > 0;
+    }
+    
+    // the block keys are: hash + ' ' + time + ' ' + seq_no
+    static bool
+    key_time(const std::string & key,
+             time_point & out)
+    {
+      auto first = key.find(' ');
+      auto last  = key.rfind(' ');
+      if( first == std::string::npos || last <= first )
+        return false;
+      return storeable::convert(key.substr(first+1, last-first-1), out);
+    }
+    
+    // the later completion time of each finished query, oldest first
+    query_vec
+    completed_queries() const
+    {
+      std::map<std::string, time_point> latest;
+      for( auto const & qn : { query_table_log::qn_t0_completed_at,
+                               query_table_log::qn_t1_completed_at } )
+      {
+        if( !has_family(qn) ) continue;
+        db_.scan(qn, "", [&latest](const std::string & key,
+                                   const storeable::data_t & value) {
+          time_point tp;
+          if( storeable::convert(value, tp) )
+          {
+            auto it = latest.find(key);
+            if( it == latest.end() ) latest[key] = tp;
+            else if( it->second < tp ) it->second = tp;
+          }
+          return true;
+        });
+      }
+      
+      query_vec ret;
+      ret.reserve(latest.size());
+      for( auto const & q : latest )
+        ret.push_back(std::make_pair(q.second, q.first));
+      std::sort(ret.begin(), ret.end());
+      return ret;
+    }
+    
+    template <typename T>
+    size_t
+    remove_keys(const std::set<std::string> & keys)
+    {
+      size_t ret = 0;
+      std::vector<std::unique_ptr<T>> items;
+      db::storeable_ptr_vec_t ptrs;
+      
+      // the column sets are empty, so all families of the class go
+      auto commit = [&]() {
+        if( ptrs.empty() ) return;
+        ret += db_.remove_many(ptrs);
+        ptrs.clear();
+        items.clear();
+      };
+      
+      for( auto const & k : keys )
+      {
+        items.emplace_back(new T);
+        storeable & st = *(items.back());
+        st.key(k);
+        ptrs.push_back(items.back().get());
+        if( ptrs.size() >= remove_batch_size )
+          commit();
+      }
+      commit();
+      return ret;
+    }
+    
+    size_t
+    evict_query(const std::string & table_hash)
+    {
+      query_table_log log;
+      log.key(table_hash);
+      size_t ret = db_.remove(log);
+      ret += db_.remove_prefix(query_table_block::clazz_static(), table_hash + ' ');
+      return ret;
+    }
+    
+    // the earliest block time of the queries still in the cache, the
+    // evicted ones have no table blocks left
+    bool
+    earliest_table_block(time_point & out) const
+    {
+      bool found = false;
+      for( auto const & qn : { query_table_block::qn_is_complete,
+                               query_table_block::qn_n_columns,
+                               query_table_block::qn_n_columns_complete } )
+      {
+        if( !has_family(qn) ) continue;
+        db_.scan(qn, "", [&](const std::string & key,
+                             const storeable::data_t &) {
+          time_point tp;
+          if( key_time(key, tp) && (!found || tp < out) )
+          {
+            out   = tp;
+            found = true;
+          }
+          return true;
+        });
+      }
+      return found;
+    }
+    
+    // the column blocks of a query are stamped with the same time as its
+    // table blocks, which can be well before the query completed. so the
+    // sweep stops before the blocks of the earliest remaining query, or
+    // a query kept by its completion time would lose its columns. the
+    // key times have a second precision
+    time_point
+    block_cutoff(const time_point & cutoff) const
+    {
+      time_point earliest;
+      if( earliest_table_block(earliest) && !(cutoff < earliest) )
+        return earliest - std::chrono::seconds(1);
+      return cutoff;
+    }
+    
+    // removes the column blocks not newer than cutoff and the column data
+    // only they refer to. a block cached during the sweep may lose its
+    // data, that reads as a cache miss
+    void
+    sweep_column_blocks(const time_point & cutoff,
+                        stats & st)
+    {
+      std::set<std::string> old_blocks;
+      std::set<std::string> old_data;
+      std::set<std::string> live_data;
+      time_point tp;
+      
+      if( has_family(query_column_block::qn_column_hash) )
+      {
+        db_.scan(query_column_block::qn_column_hash, "",
+                 [&](const std::string & key, const storeable::data_t & value) {
+          if( key_time(key, tp) && !(cutoff < tp) )
+          {
+            old_blocks.insert(key);
+            old_data.insert(value);
+          }
+          else
+          {
+            live_data.insert(value);
+          }
+          return true;
+        });
+      }
+      
+      // blocks without a column hash
+      if( has_family(query_column_block::qn_end_of_data) )
+      {
+        db_.scan(query_column_block::qn_end_of_data, "",
+                 [&](const std::string & key, const storeable::data_t &) {
+          if( key_time(key, tp) && !(cutoff < tp) )
+            old_blocks.insert(key);
+          return true;
+        });
+      }
+      
+      for( auto const & h : live_data )
+        old_data.erase(h);
+      
+      st.n_deletes_        += remove_keys<query_column_block>(old_blocks);
+      st.n_column_blocks_  += old_blocks.size();
+      st.n_deletes_        += remove_keys<column_data>(old_data);
+      st.n_column_data_    += old_data.size();
+    }
+    
+    uint64_t
+    compact()
+    {
+      for( auto const & clazz : { query_table_log::clazz_static(),
+                                  query_table_block::clazz_static(),
+                                  query_column_block::clazz_static(),
+                                  column_data::clazz_static() } )
+      {
+        db_.compact(clazz);
+      }
+      return db_.disk_usage();
+    }
+    
+    size_t
+    run()
+    {
+      std::lock_guard<std::mutex> l(run_mtx_);
+      auto start = clock::now();
+      
+      stats st{0,0,0,0,0,0,0,0};
+      st.disk_bytes_before_ = db_.disk_usage();
+      st.disk_bytes_after_  = st.disk_bytes_before_;
+      
+      query_vec queries = completed_queries();
+      size_t next = 0;
+      
+      if( options_.max_age_sec_ )
+      {
+        time_point cutoff = std::chrono::system_clock::now() -
+                            std::chrono::seconds(options_.max_age_sec_);
+        
+        while( next < queries.size() && queries[next].first < cutoff )
+          st.n_deletes_ += evict_query(queries[next++].second);
+        
+        sweep_column_blocks(block_cutoff(cutoff), st);
+        if( st.n_deletes_ )
+          st.disk_bytes_after_ = compact();
+      }
+      
+      // the space only shows up after the compactions, so the size is
+      // checked again after each pass
+      size_t n_passes = 0;
+      while( options_.max_disk_bytes_ &&
+             st.disk_bytes_after_ > options_.max_disk_bytes_ &&
+             n_passes < options_.max_passes_ &&
+             next < queries.size() )
+      {
+        size_t n = std::max<size_t>(1, (queries.size()-next)/4);
+        for( size_t i=0; i<n; ++i )
+          st.n_deletes_ += evict_query(queries[next++].second);
+        
+        sweep_column_blocks(block_cutoff(queries[next-1].first), st);
+        st.disk_bytes_after_ = compact();
+        ++n_passes;
+      }
+      
+      if( options_.max_disk_bytes_ && st.disk_bytes_after_ > options_.max_disk_bytes_ )
+      {
+        LOG_ERROR("cache is above the disk budget after eviction" <<
+                  V_(st.disk_bytes_after_) <<
+                  V_(options_.max_disk_bytes_) <<
+                  V_(queries.size()-next));
+      }
+      
+      st.n_queries_   = next;
+      st.evict_usec_  = std::chrono::duration_cast<std::chrono::microseconds>(clock::now()-start).count();
+      
+      {
+        std::lock_guard<std::mutex> sl(stats_mtx_);
+        ++stats_.n_runs_;
+        stats_.n_queries_          += st.n_queries_;
+        stats_.n_column_blocks_    += st.n_column_blocks_;
+        stats_.n_column_data_      += st.n_column_data_;
+        stats_.n_deletes_          += st.n_deletes_;
+        stats_.disk_bytes_before_   = st.disk_bytes_before_;
+        stats_.disk_bytes_after_    = st.disk_bytes_after_;
+        stats_.evict_usec_         += st.evict_usec_;
+      }
+      
+      if( next )
+      {
+        LOG_INFO("evicted cached queries" <<
+                 V_(next) <<
+                 V_(st.n_column_blocks_) <<
+                 V_(st.n_column_data_) <<
+                 V_(st.disk_bytes_before_) <<
+                 V_(st.disk_bytes_after_));
+      }
+      return next;
+    }
+    
+    void
+    start()
+    {
+      if( timer_ ) return;
+      timer_.reset(new util::timer_service{options_.interval_ms_});
+      timer_->schedule(options_.interval_ms_, [this]() {
+        run();
+        return true;
+      });
+    }
+    
+    stats
+    get_stats() const
+    {
+      std::lock_guard<std::mutex> l(stats_mtx_);
+      return stats_;
+    }
+  };
+  
+  evictor::evictor(db & d,
+                   const options & opts)
+  : impl_{new impl{d, opts}}
+  {
+  }
+  
+  evictor::~evictor()
+  {
+  }
+  
+  void
+  evictor::start()
+  {
+    impl_->start();
+  }
+  
+  size_t
+  evictor::run()
+  {
+    return impl_->run();
+  }
+  
+  evictor::stats
+  evictor::get_stats() const
+  {
+    return impl_->get_stats();
+  }
+
+}}
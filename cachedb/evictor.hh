@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cachedb/db.hh>
+#include <memory>
+#include <cstdint>
+
+namespace virtdb { namespace cachedb {
+  
+  // keeps the cache within bounds. a query is evicted when the later of
+  // its t0/t1 completion times is older than max_age_sec_, its
+  // query_table_log and query_table_blocks go together. queries without a
+  // completion time are still running and are left alone.
+  // query_column_blocks are shared by the queries that differ only in
+  // their field lists, so they age by the time in their own keys. the
+  // sweep stops short of the block time of any query still in the
+  // cache, running ones included. a column_data goes when no remaining
+  // block refers to it. while the live SST files are above
+  // max_disk_bytes_ the oldest quarter of the remaining queries is
+  // evicted, at most max_passes_ times per run
+  class evictor
+  {
+  public:
+    struct options
+    {
+      // zero turns the age limit off
+      uint64_t  max_age_sec_;
+      // zero turns the size limit off
+      uint64_t  max_disk_bytes_;
+      uint64_t  interval_ms_;
+      size_t    max_passes_;
+      
+      options();
+    };
+    
+    struct stats
+    {
+      uint64_t  n_runs_;
+      uint64_t  n_queries_;
+      uint64_t  n_column_blocks_;
+      uint64_t  n_column_data_;
+      // key deletes in all column families
+      uint64_t  n_deletes_;
+      // the SST size around the last run
+      uint64_t  disk_bytes_before_;
+      uint64_t  disk_bytes_after_;
+      uint64_t  evict_usec_;
+    };
+  
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+    
+    evictor() = delete;
+    evictor(const evictor &) = delete;
+    evictor & operator=(const evictor &) = delete;
+  
+  public:
+    evictor(db & d, const options & opts=options());
+    virtual ~evictor();
+    
+    // runs the eviction every interval_ms_ on a background thread
+    void start();
+    // runs an eviction in the caller's thread, returns the number of
+    // evicted queries
+    size_t run();
+    
+    stats get_stats() const;
+  };
+
+}}
@@ -0,0 +1,161 @@
+#ifdef RELEASE
+#define LOG_TRACE_IS_ENABLED false
+#define LOG_SCOPED_IS_ENABLED false
+#endif //RELEASE
+
+#include "writer.hh"
+#include <rocksdb/write_batch.h>
+#include <logger.hh>
+#include <chrono>
+
+namespace virtdb { namespace cachedb {
+  
+  writer::options::options()
+  : max_bytes_{4*1024*1024},
+    max_delay_ms_{100},
+    disable_wal_{false},
+    sync_{false}
+  {
+  }
+  
+  double
+  writer::stats::write_amplification() const
+  {
+    if( !payload_bytes_ ) return 0.0;
+    return ((double)(batch_bytes_+wal_bytes_))/((double)payload_bytes_);
+  }
+  
+  double
+  writer::stats::throughput_mbps() const
+  {
+    if( !commit_usec_ ) return 0.0;
+    return ((double)payload_bytes_)/((double)commit_usec_);
+  }
+  
+  struct writer::impl
+  {
+    typedef std::chrono::steady_clock  clock;
+    
+    db &                  db_;
+    options               options_;
+    rocksdb::WriteBatch   batch_;
+    size_t                n_pending_;
+    clock::time_point     first_pending_at_;
+    stats                 stats_;
+    
+    impl(db & d, const options & opts)
+    : db_(d),
+      options_(opts),
+      n_pending_{0},
+      stats_{0,0,0,0,0,0,0,0}
+    {
+    }
+    
+    bool
+    due() const
+    {
+      if( batch_.GetDataSize() >= options_.max_bytes_ )
+        return true;
+      
+      auto age = std::chrono::duration_cast<std::chrono::milliseconds>(clock::now()-first_pending_at_);
+      return (uint64_t)age.count() >= options_.max_delay_ms_;
+    }
+    
+    size_t
+    add(const storeable & data)
+    {
+      if( !n_pending_ )
+        first_pending_at_ = clock::now();
+      
+      size_t ret = db_.prepare(data, batch_);
+      if( ret )
+      {
+        ++n_pending_;
+        ++stats_.n_items_;
+        stats_.n_columns_ += ret;
+        data.properties([this](const std::string & _clazz,
+                               const std::string & _key,
+                               const storeable::qual_name & _name,
+                               const storeable::data_t & _data) {
+          stats_.payload_bytes_ += _key.size()+_data.size();
+        });
+      }
+      
+      if( n_pending_ && due() )
+        commit();
+      
+      return ret;
+    }
+    
+    bool
+    commit()
+    {
+      if( !n_pending_ ) return true;
+      
+      size_t batch_bytes = batch_.GetDataSize();
+      auto start = clock::now();
+      bool ret = db_.write(batch_, options_.disable_wal_, options_.sync_);
+      stats_.commit_usec_ += std::chrono::duration_cast<std::chrono::microseconds>(clock::now()-start).count();
+      
+      if( ret )
+      {
+        ++stats_.n_commits_;
+        stats_.batch_bytes_ += batch_bytes;
+        if( !options_.disable_wal_ )
+          stats_.wal_bytes_ += batch_bytes;
+      }
+      else
+      {
+        // the cached data is dropped, it is recreated on the next query
+        ++stats_.n_failed_commits_;
+        LOG_ERROR("failed to commit cached data" << V_(n_pending_) << V_(batch_bytes));
+      }
+      
+      batch_.Clear();
+      n_pending_ = 0;
+      return ret;
+    }
+  };
+  
+  writer::writer(db & d,
+                 const options & opts)
+  : impl_{new impl{d, opts}}
+  {
+  }
+  
+  writer::~writer()
+  {
+    impl_->commit();
+  }
+  
+  size_t
+  writer::add(const storeable & data)
+  {
+    return impl_->add(data);
+  }
+  
+  bool
+  writer::commit()
+  {
+    return impl_->commit();
+  }
+  
+  size_t
+  writer::pending_items() const
+  {
+    return impl_->n_pending_;
+  }
+  
+  size_t
+  writer::pending_bytes() const
+  {
+    return impl_->batch_.GetDataSize();
+  }
+  
+  writer::stats
+  writer::get_stats() const
+  {
+    return impl_->stats_;
+  }
+  
+}}
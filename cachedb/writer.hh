@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cachedb/db.hh>
+#include <cachedb/storeable.hh>
+#include <memory>
+#include <cstdint>
+
+namespace virtdb { namespace cachedb {
+  
+  // collects storeables across many add() calls and writes them to the
+  // db in groups, so caching a result block by block doesn't cost a WAL
+  // write per block. a group is committed when it reaches max_bytes_ or
+  // when it is older than max_delay_ms_ at the next add(), and at the
+  // latest when the writer is destroyed. a writer is not thread safe,
+  // each thread should have its own
+  class writer
+  {
+  public:
+    struct options
+    {
+      size_t    max_bytes_;
+      uint64_t  max_delay_ms_;
+      // the cached data can be recreated, so losing the last groups on
+      // a crash may be acceptable
+      bool      disable_wal_;
+      bool      sync_;
+      
+      options();
+    };
+    
+    struct stats
+    {
+      uint64_t  n_items_;
+      uint64_t  n_columns_;
+      uint64_t  n_commits_;
+      uint64_t  n_failed_commits_;
+      // keys and values passed in
+      uint64_t  payload_bytes_;
+      // written batches, they go to the memtable and to the WAL
+      uint64_t  batch_bytes_;
+      uint64_t  wal_bytes_;
+      uint64_t  commit_usec_;
+      
+      // bytes handed over to the db per payload byte, without compaction
+      double write_amplification() const;
+      // payload MB per second spent in the commits
+      double throughput_mbps() const;
+    };
+    
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+    
+    writer() = delete;
+    writer(const writer &) = delete;
+    writer & operator=(const writer &) = delete;
+    
+  public:
+    writer(db & d, const options & opts=options());
+    virtual ~writer();
+    
+    // returns the number of columns added, commits if a limit is reached
+    size_t add(const storeable & data);
+    bool commit();
+    
+    size_t pending_items() const;
+    size_t pending_bytes() const;
+    stats get_stats() const;
+  };
+  
+}}
@@ -26,6 +26,8 @@
                           'cachedb/query_column_block.cc',  'cachedb/query_column_block.hh',
                           'cachedb/query_table_log.cc',     'cachedb/query_table_log.hh',
                           'cachedb/query_table_block.cc',   'cachedb/query_table_block.hh',
+                          'cachedb/writer.cc',              'cachedb/writer.hh',
+                          'cachedb/evictor.cc',             'cachedb/evictor.hh',
                         ],
     'dsproxy_sources':  [
                           'dsproxy.hh',
@@ -39,7 +41,8 @@
                           # generic utils
                           'util.hh',                    'util/constants.hh',
                           'util/active_queue.hh',       'util/flex_alloc.hh',
-                          'util/mempool.hh',
+                          'util/mempool.hh',            'util/work_stealing_queue.hh',
+                          'util/mpmc_queue.hh',
                           'util/barrier.cc',            'util/barrier.hh',
                           'util/relative_time.cc',      'util/relative_time.hh',
                           'util/exception.hh',          'util/value_type.hh',
@@ -50,6 +53,10 @@
                           'util/async_worker.cc',       'util/async_worker.hh',
                           'util/compare_messages.cc',   'util/compare_messages.hh',   
                           'util/table_collector.hh',
+                          'util/ring_table_collector.hh',
+                          'util/object_pool.hh',
+                          'util/null_bitmap.hh',
+                          'util/cached_mempool.cc',     'util/cached_mempool.hh',
                           'util/timer_service.cc',      'util/timer_service.hh',   
                           'util/utf8.cc',               'util/utf8.hh',
                           'util/value_type_reader.cc',  'util/value_type_reader.hh',
@@ -117,6 +124,8 @@
                           'datasrc/double_column.cc',    'datasrc/double_column.hh',
                           'datasrc/int64_column.cc',     'datasrc/int64_column.hh',
                           'datasrc/pool.cc',             'datasrc/pool.hh',
+                          'datasrc/memory_budget.cc',    'datasrc/memory_budget.hh',
+                          'datasrc/compressor.cc',       'datasrc/compressor.hh',
                           # engine
                           'engine/data_handler.cc',      'engine/data_handler.hh',
                           'engine/expression.cc',        'engine/expression.hh',
@@ -124,6 +133,7 @@
                           'engine/receiver_thread.cc',   'engine/receiver_thread.hh',
                           'engine/collector.cc',         'engine/collector.hh',
                           'engine/feeder.cc',            'engine/feeder.hh',
+                          'engine/column_batch.cc',      'engine/column_batch.hh',
                           'engine/util.hh',
                           # fault injection
                           'fault/injector.cc',           'fault/injector.hh',
@@ -540,6 +550,25 @@
                              'test/cachedb_test.cc',      'test/cachedb_test.hh',
                            ],
     },
+    {
+      'target_name':       'common_bench',
+      'type':              'executable',
+      'dependencies':      [
+                             'deps_/proto/proto.gyp:proto',
+                             'deps_/fsm/fsm.gyp:fsm',
+                             'common',
+                           ],
+      'include_dirs':      [
+                             './deps_/fsm/src/',
+                           ],
+      'cflags':            [ '-std=c++11', '-Wall', ],
+      'sources':           [
+                             'test/bench_main.cc',        'test/bench.hh',
+                             'test/util_bench.cc',
+                             'test/datasrc_bench.cc',
+                             'test/engine_bench.cc',
+                           ],
+    },
     {
       'target_name':       'murmur3',
       'type':              'static_library',
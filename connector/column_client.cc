@@ -7,10 +7,14 @@ namespace virtdb { namespace connector {
   
   column_client::column_client(client_context::sptr ctx,
                                endpoint_client & ep_client,
-                               const std::string & server_name)
+                               const std::string & server_name,
+                               size_t n_decode_threads)
   : sub_base_type(ctx,
                   ep_client,
-                  server_name)
+                  server_name,
+                  10,
+                  true,
+                  n_decode_threads)
   {
   }
   
@@ -15,9 +15,12 @@ namespace virtdb { namespace connector {
   public:
     typedef std::shared_ptr<column_client> sptr;
     
+    // the columns of different queries are parsed in parallel on
+    // n_decode_threads threads
     column_client(client_context::sptr ctx,
                   endpoint_client & ep_client,
-                  const std::string & server_name);
+                  const std::string & server_name,
+                  size_t n_decode_threads=4);
     virtual ~column_client();
     
     void cleanup();
@@ -2,7 +2,6 @@
 
 #include <util/zmq_utils.hh>
 #include <util/active_queue.hh>
-#include <util/flex_alloc.hh>
 #include <util/constants.hh>
 #include <logger.hh>
 #include <memory>
@@ -32,11 +31,15 @@ namespace virtdb { namespace connector {
       try
       {
         int pub_size = tp.second->ByteSize();
-        util::flex_alloc<unsigned char, 512> pub_buffer(pub_size);
         
         if( pub_size > 0 )
         {
-          if( tp.second->SerializeToArray(pub_buffer.get(), pub_size) )
+          // serialized straight into the zmq message, so it is
+          // not copied again when handed over to the socket
+          zmq::message_t pub_msg;
+          if( util::zmq_socket_wrapper::serialize_to_message(*(tp.second),
+                                                             pub_size,
+                                                             pub_msg) )
           {
             if( !socket_.send(tp.first.c_str(), tp.first.length(), ZMQ_SNDMORE) )
             {
@@ -44,7 +47,7 @@ namespace virtdb { namespace connector {
             }
             else
             {
-              if( !socket_.send(pub_buffer.get(), pub_size) )
+              if( !socket_.send(pub_msg) )
               {
                 LOG_ERROR("failed to send" << M_(*(tp.second)) << V_(tp.first));
               }
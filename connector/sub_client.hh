@@ -4,13 +4,17 @@
 #include <util/zmq_utils.hh>
 #include <util/flex_alloc.hh>
 #include <util/active_queue.hh>
+#include <util/object_pool.hh>
 #include <util/constants.hh>
 #include <util/exception.hh>
+#include <util/relative_time.hh>
 #include <connector/endpoint_client.hh>
 #include <connector/client_base.hh>
 #include <connector/service_type_map.hh>
 #include <memory>
 #include <map>
+#include <atomic>
+#include <functional>
 
 namespace virtdb { namespace connector {
   
@@ -32,30 +36,78 @@ namespace virtdb { namespace connector {
                                const std::string & channel,
                                const std::string & subscription,
                                sub_item_sptr data)>  sub_monitor;
+    
+    struct sub_stats
+    {
+      uint64_t  n_frames_;
+      uint64_t  n_bytes_;
+      uint64_t  n_parse_errors_;
+      // summed over all frames: waiting for a decode thread, parsing
+      // the frame and running the monitors
+      uint64_t  queue_usec_;
+      uint64_t  decode_usec_;
+      uint64_t  dispatch_usec_;
+    };
 
   private:
     typedef std::lock_guard<std::mutex>             lock;
     typedef std::vector<sub_monitor>                monitor_vector;
     typedef std::map<std::string,monitor_vector>    monitor_map;
+    typedef std::shared_ptr<const monitor_map>      monitor_map_sptr;
     
-    struct raw_message
+    // a received data frame. frames are recycled through frame_pool_, so
+    // the zmq messages are reused and parsed straight from their buffers
+    struct frame
     {
-      typedef std::shared_ptr<zmq::message_t> msg_sptr;
-      std::string             subscription_;
-      std::vector<msg_sptr>   messages_;
+      std::string                       subscription_;
+      zmq::message_t                    message_;
+      util::relative_time::timepoint    received_at_;
+      
+      void Clear()
+      {
+        subscription_.clear();
+        message_.rebuild();
+      }
     };
     
-    typedef std::shared_ptr<raw_message> raw_msg_sptr;
+    typedef typename util::object_pool<frame>::sptr                      frame_sptr;
+    // unbounded, so a slow subscription never stalls the receive thread
+    // and with it the other subscriptions
+    typedef util::active_queue<frame_sptr,util::TINY_TIMEOUT_MS>        decode_lane;
+    typedef std::unique_ptr<decode_lane>                                 decode_lane_uptr;
     
     endpoint_client                                                * ep_clnt_;
     zmq::context_t                                                   zmqctx_;
     util::zmq_socket_wrapper                                         socket_;
     util::async_worker                                               worker_;
-    util::active_queue<raw_msg_sptr,util::TINY_TIMEOUT_MS>           raw_msg_queue_;
-    util::active_queue<channel_item_sptr,util::DEFAULT_TIMEOUT_MS>   queue_;
-    monitor_map                                                      monitors_;
+    // parsed items go back here when the subscribers drop them
+    util::object_pool<sub_item>                                      item_pool_;
+    util::object_pool<frame>                                         frame_pool_;
+    // replaced on every watch change, the lanes dispatch from a snapshot
+    // so the monitors of different lanes run in parallel
+    monitor_map_sptr                                                 monitors_;
     mutable std::mutex                                               sockets_mtx_;
     mutable std::mutex                                               monitors_mtx_;
+    std::atomic<uint64_t>                                            n_frames_;
+    std::atomic<uint64_t>                                            n_bytes_;
+    std::atomic<uint64_t>                                            n_parse_errors_;
+    std::atomic<uint64_t>                                            queue_usec_;
+    std::atomic<uint64_t>                                            decode_usec_;
+    std::atomic<uint64_t>                                            dispatch_usec_;
+    // every lane has a single thread, the frames of a subscription always
+    // go to the same lane so they are delivered in order
+    std::vector<decode_lane_uptr>                                    lanes_;
+    
+    decode_lane & lane_for(const std::string & subscription)
+    {
+      return *(lanes_[std::hash<std::string>()(subscription) % lanes_.size()]);
+    }
+    
+    void stop_lanes()
+    {
+      for( auto & l : lanes_ )
+        l->stop();
+    }
     
     bool worker_function()
     {
@@ -83,8 +135,6 @@ namespace virtdb { namespace connector {
       
       try
       {
-        raw_msg_sptr raw_msg{new raw_message};
-        
         // poll said we have data ...
         zmq::message_t message(0);
         
@@ -106,39 +156,33 @@ namespace virtdb { namespace connector {
           return true;
         }
         
-        util::zmq_socket_wrapper::valid_subscription(message, raw_msg->subscription_);
+        std::string subscription;
+        util::zmq_socket_wrapper::valid_subscription(message, subscription);
+        decode_lane & lane = lane_for(subscription);
         
         while( true )
         {
-          // TODO : check this if we shall rather copy out the message from this place
-          typename raw_message::msg_sptr msg_item{new zmq::message_t(0)};
+          frame_sptr frm = frame_pool_.get();
           
-          if( !socket_.get().recv(msg_item.get()) )
+          if( !socket_.get().recv(&(frm->message_)) )
           {
             LOG_ERROR("failed to recv() message - while reading data" <<
                       V_(dbg.GetTypeName()) <<
                       V_(this->server()) <<
-                      V_(raw_msg->subscription_));
+                      V_(subscription));
             return true;
           }
           
-          raw_msg->messages_.push_back(msg_item);
+          frm->received_at_ = util::relative_time::highres_clock::now();
+          frm->subscription_ = subscription;
+          bool more = frm->message_.more();
           
-          if( !msg_item->more() ) break;
-        }
-        
-        if( raw_msg->messages_.size() > 0 )
-        {
-          raw_msg_queue_.push(std::move(raw_msg));
-        }
-        else
-        {
-          LOG_ERROR("failed to construct raw message" <<
-                    V_(dbg.GetTypeName()) <<
-                    V_(this->server()) <<
-                    V_(raw_msg->subscription_));
+          ++n_frames_;
+          n_bytes_ += frm->message_.size();
+          lane.push(std::move(frm));
+          
+          if( !more ) break;
         }
-        
       }
       catch (const zmq::error_t & e)
       {
@@ -151,7 +195,7 @@ namespace virtdb { namespace connector {
       }
       catch (const std::exception & e)
       {
-        LOG_ERROR("couldn't parse message" <<
+        LOG_ERROR("exception while receiving message" <<
                   E_(e) <<
                   V_(dbg.GetTypeName()) <<
                   V_(this->server()));
@@ -165,69 +209,65 @@ namespace virtdb { namespace connector {
       return true;
     }
     
-    void process_raw_message(raw_msg_sptr msg)
+    void decode_function(frame_sptr frm)
     {
-      if( !msg )
+      if( !frm )
       {
-        LOG_ERROR("invalid message");
+        LOG_ERROR("invalid frame");
         return;
       }
       
-      if( msg->subscription_.size() == 0 )
-      {
-        LOG_ERROR("subscription for message is empty" << V_(msg->messages_.size()));
-        return;
-      }
+      util::relative_time since_received{frm->received_at_};
+      queue_usec_ += since_received.get_usec();
+      
+      util::relative_time decode_time;
+      sub_item_sptr i = item_pool_.get();
+      bool parsed = i->ParseFromArray(frm->message_.data(), frm->message_.size());
+      // the zmq buffer is not needed anymore
+      frm->message_.rebuild();
+      decode_usec_ += decode_time.get_usec();
       
-      if( msg->messages_.size() == 0 )
+      if( !parsed )
       {
-        LOG_ERROR("empty messages arrived for" << V_(msg->subscription_));
+        ++n_parse_errors_;
+        LOG_ERROR("failed to parse message" <<
+                  V_(i->GetTypeName()) <<
+                  V_(this->server()) <<
+                  V_(frm->subscription_));
         return;
       }
       
-      for( auto & m : msg->messages_ )
-      {
-        auto i = sub_item_sptr{new sub_item};
-        if( i->ParseFromArray(m->data(), m->size()) )
-        {
-          queue_.push(std::move(std::make_pair(msg->subscription_,i)));
-        }
-        else
-        {
-          LOG_ERROR("failed to parse message" <<
-                    V_(i->GetTypeName()) <<
-                    V_(this->server()) <<
-                    V_(msg->subscription_));
-        }
-      }
+      util::relative_time dispatch_time;
+      dispatch(frm->subscription_, i);
+      dispatch_usec_ += dispatch_time.get_usec();
     }
     
-    void dispatch_function(channel_item_sptr it)
+    void dispatch(const std::string & channel,
+                  sub_item_sptr item)
     {
-      if( it.first.size() == 0 )
+      if( channel.size() == 0 )
       {
         LOG_ERROR("no subscription for message");
         return;
       }
       
-      if( !it.second )
+      monitor_map_sptr monitors;
       {
-        LOG_ERROR("invald message arrived for" << V_(it.first));
-        return;
+        lock l(monitors_mtx_);
+        monitors = monitors_;
       }
       
       // dispatch through monitors
-      lock l(monitors_mtx_);
-      for( auto & m : monitors_)
+      for( auto const & m : *monitors )
       {
         if( m.first == "*" || m.first.empty() ||
-            it.first.find(m.first) == 0 )
+            channel.find(m.first) == 0 )
         {
           for( auto & h : m.second )
           {
             try
             {
-              h(client_base::server(), it.first, m.first, it.second);
+              h(client_base::server(), channel, m.first, item);
             }
             catch( const std::exception & e )
             {
@@ -248,7 +288,8 @@ namespace virtdb { namespace connector {
                endpoint_client & ep_clnt,
                const std::string & server,
                size_t n_retries_on_worker_exception=10,
-               bool die_on_worker_exception=true)
+               bool die_on_worker_exception=true,
+               size_t n_decode_threads=4)
     : client_base(ctx,
                   ep_clnt,
                   server),
@@ -258,15 +299,24 @@ namespace virtdb { namespace connector {
       worker_(std::bind(&sub_client::worker_function, this),
               n_retries_on_worker_exception,
               die_on_worker_exception),
-      raw_msg_queue_(4,std::bind(&sub_client::process_raw_message,
-                                 this,
-                                 std::placeholders::_1)),
-      queue_(1,std::bind(&sub_client::dispatch_function,
-                         this,
-                         std::placeholders::_1))
+      monitors_{new monitor_map},
+      n_frames_{0},
+      n_bytes_{0},
+      n_parse_errors_{0},
+      queue_usec_{0},
+      decode_usec_{0},
+      dispatch_usec_{0}
     {
       sub_item sub_itm;
-      LOG_TRACE(" " << V_(sub_itm.GetTypeName()) << V_(this->server()) );
+      LOG_TRACE(" " << V_(sub_itm.GetTypeName()) << V_(this->server()) << V_(n_decode_threads) );
+      
+      if( !n_decode_threads ) n_decode_threads = 1;
+      for( size_t i=0; i<n_decode_threads; ++i )
+      {
+        lanes_.push_back(decode_lane_uptr{new decode_lane(1,std::bind(&sub_client::decode_function,
+                                                                      this,
+                                                                      std::placeholders::_1))});
+      }
       
       // this machinery makes sure we reconnect whenever the endpoint changes
       ep_clnt.watch(service_type, [this](const interface::pb::EndpointData & ep) {
@@ -321,13 +371,15 @@ namespace virtdb { namespace connector {
                sub_monitor m)
     {
       lock l(monitors_mtx_);
-      auto it = monitors_.find(subscription);
-      if( it == monitors_.end() )
+      std::shared_ptr<monitor_map> monitors{new monitor_map(*monitors_)};
+      auto it = monitors->find(subscription);
+      if( it == monitors->end() )
       {
-        auto rit = monitors_.insert(std::make_pair(subscription,monitor_vector()));
+        auto rit = monitors->insert(std::make_pair(subscription,monitor_vector()));
         it = rit.first;
       }
       it->second.push_back(m);
+      monitors_ = monitors;
       if( subscription == "*" || subscription.empty() )
       {
         socket_.get().setsockopt(ZMQ_SUBSCRIBE, "*", 0);
@@ -343,18 +395,20 @@ namespace virtdb { namespace connector {
       std::vector<std::string> subs;
       {
         lock l(monitors_mtx_);
-        for( auto const & m : monitors_ )
+        for( auto const & m : *monitors_ )
           subs.push_back( m.first );
       }
       for( auto const & sub : subs )
         remove_watch(sub);
     }
     
+    // a lane that took its snapshot before the removal may still call
+    // the removed monitors once more. cleanup() waits for the lanes
     void remove_watch(const std::string & subscription)
     {
       lock l(monitors_mtx_);
-      auto it = monitors_.find(subscription);
-      if( it != monitors_.end() )
+      auto it = monitors_->find(subscription);
+      if( it != monitors_->end() )
       {
         for( size_t m=0; m<it->second.size(); ++m )
         {
@@ -384,15 +438,27 @@ namespace virtdb { namespace connector {
             LOG_ERROR("unknown exception");
           }
         }
-        monitors_.erase(it);
+        std::shared_ptr<monitor_map> monitors{new monitor_map(*monitors_)};
+        monitors->erase(subscription);
+        monitors_ = monitors;
       }
     }
     
+    sub_stats get_sub_stats() const
+    {
+      return sub_stats{n_frames_.load(),
+                       n_bytes_.load(),
+                       n_parse_errors_.load(),
+                       queue_usec_.load(),
+                       decode_usec_.load(),
+                       dispatch_usec_.load()};
+    }
+    
     virtual ~sub_client()
     {
       ep_clnt_->remove_watches(service_type);
       worker_.stop();
-      queue_.stop();
+      stop_lanes();
     }
     
     virtual void cleanup()
@@ -400,7 +466,7 @@ namespace virtdb { namespace connector {
       ep_clnt_->remove_watches(service_type);
       socket_.disconnect_all();
       worker_.stop();
-      queue_.stop();
+      stop_lanes();
     }
     
     virtual void rethrow_error()
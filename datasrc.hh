@@ -2,12 +2,14 @@
 
 #include "datasrc/bytes_column.hh"
 #include "datasrc/column.hh"
+#include "datasrc/compressor.hh"
 #include "datasrc/date_column.hh"
 #include "datasrc/datetime_column.hh"
 #include "datasrc/double_column.hh"
 #include "datasrc/float_column.hh"
 #include "datasrc/int32_column.hh"
 #include "datasrc/int64_column.hh"
+#include "datasrc/memory_budget.hh"
 #include "datasrc/pool.hh"
 #include "datasrc/string_column.hh"
 #include "datasrc/time_column.hh"
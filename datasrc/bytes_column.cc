@@ -13,7 +13,7 @@ namespace virtdb { namespace datasrc {
   bytes_column::convert_pb()
   {
     if( !get_ptr() ) return;
-
+    
     size_t n = std::min(max_rows(), n_rows());
     auto & column_pb = get_pb_column();
     auto * data_pb_ptr = column_pb.mutable_data();
@@ -23,10 +23,6 @@ namespace virtdb { namespace datasrc {
     auto * mdv = data_pb_ptr->mutable_bytesvalue();
     mdv->Reserve(n);
     
-    auto * nulls_pb = data_pb_ptr->mutable_isnull();
-    nulls_pb->Clear();
-    nulls_pb->Reserve(n);
-    
     auto & null_vals = this->nulls();
     auto * val_ptr = get_ptr();
     auto & sizes = actual_sizes();
@@ -40,13 +36,81 @@ namespace virtdb { namespace datasrc {
       else
       {
         data_pb_ptr->add_bytesvalue("", 0);
-        if( null_vals[i] )
-          util::value_type_base::set_null(*data_pb_ptr, i);
       }
       val_ptr += max_size();
     }
-
+    
+    util::value_type_base::set_nulls(*data_pb_ptr, null_vals, n);
+    
+    free_temp_data();
+  }
+  
+  util::value_type_writer::sptr
+  bytes_column::write_values()
+  {
+    size_t n = std::min(max_rows(), n_rows());
+    if( !get_ptr() || !n ) return util::value_type_writer::sptr();
+    
+    auto & null_vals = this->nulls();
+    auto ret = util::value_type_writer::construct(interface::pb::Kind::BYTES, n);
+    ret->write_bytes_strided(get_ptr()+in_field_offset(),
+                             max_size(),
+                             actual_sizes().data(),
+                             null_vals.words(),
+                             n);
+    
+    free_temp_data();
+    return ret;
+  }
+  
+  var_bytes_column::var_bytes_column(size_t max_rows,
+                                     size_t max_size)
+  : parent_type{max_rows, max_size}
+  {
+  }
+  
+  void
+  var_bytes_column::convert_pb()
+  {
+    if( !get_ptr() ) return;
+    
+    size_t n = std::min(max_rows(), n_rows());
+    auto & column_pb = get_pb_column();
+    auto * data_pb_ptr = column_pb.mutable_data();
+    
+    data_pb_ptr->Clear();
+    data_pb_ptr->set_type(interface::pb::Kind::BYTES);
+    auto * mdv = data_pb_ptr->mutable_bytesvalue();
+    mdv->Reserve(n);
+    
+    auto & null_vals = this->nulls();
+    auto * val_ptr = get_ptr();
+    auto & offs = offsets();
+    
+    for( size_t i=0; i<n; ++i  )
+    {
+      data_pb_ptr->add_bytesvalue(val_ptr+offs[i], offs[i+1]-offs[i]);
+    }
+    
+    util::value_type_base::set_nulls(*data_pb_ptr, null_vals, n);
+    
+    free_temp_data();
+  }
+  
+  util::value_type_writer::sptr
+  var_bytes_column::write_values()
+  {
+    size_t n = std::min(max_rows(), n_rows());
+    if( !get_ptr() || !n ) return util::value_type_writer::sptr();
+    
+    // the null rows are empty in the arena already
+    auto & null_vals = this->nulls();
+    auto ret = util::value_type_writer::construct(interface::pb::Kind::BYTES, n);
+    ret->write_bytes_batch(get_ptr(), offsets().data(), nullptr, n);
+    ret->set_null_bits(0, null_vals.words(), n);
+    
     free_temp_data();
+    return ret;
   }
   
 }}
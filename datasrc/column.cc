@@ -7,22 +7,29 @@
 #include <util/exception.hh>
 #include <util/flex_alloc.hh>
 #include <logger.hh>
-#include <lz4/lib/lz4.h>
+#include <algorithm>
+#include <limits>
+#include <cstring>
 
 namespace virtdb { namespace datasrc {
 
   column::column(size_t max_rows)
   : max_rows_{max_rows},
-    n_rows_{0}
+    n_rows_{0},
+    nulls_{max_rows},
+    in_free_list_{false}
   {
     if( !max_rows )
     {
       THROW_("max_rows parameter is zero");
     }
-    
-    nulls_.reserve(max_rows);
-    for( size_t i=0; i<max_rows; ++i )
-      nulls_.push_back(false);
+  }
+  
+  size_t
+  column::footprint(size_t max_rows)
+  {
+    // the null flags are packed into bits
+    return sizeof(column) + (max_rows+7)/8;
   }
   
   void
@@ -93,6 +100,12 @@ namespace virtdb { namespace datasrc {
   
   void
   column::compress()
+  {
+    compress(util::lz4_options());
+  }
+  
+  void
+  column::compress(const util::lz4_options & opts)
   {
     auto & c = get_pb_column();
     auto * dta = c.mutable_data();
@@ -102,21 +115,20 @@ namespace virtdb { namespace datasrc {
     util::flex_alloc<char, 2048> uncompressed_buffer{byte_size};
     if( dta->SerializeToArray(uncompressed_buffer.get(), byte_size) )
     {
-      int max_compressed_size = LZ4_compressBound(byte_size);
-      util::flex_alloc<char, 2048> compressed_buffer{max_compressed_size};
-      
-      int lz4ret = LZ4_compress(uncompressed_buffer.get(),
-                                compressed_buffer.get(),
-                                byte_size);
-      if( !lz4ret )
+      // compress straight into the outgoing PB buffer
+      if( !util::lz4_utils::compress(uncompressed_buffer.get(),
+                                     byte_size,
+                                     *(c.mutable_compresseddata()),
+                                     opts) )
       {
+        c.clear_compresseddata();
         LOG_ERROR("LZ4 compression failed");
         return;
       }
       
 #if 0
       LOG_TRACE("block compressed" <<
-                V_(lz4ret) <<
+                V_(c.compresseddata().size()) <<
                 V_(byte_size) <<
                 V_(c.queryid()) <<
                 V_(c.name()) <<
@@ -130,11 +142,55 @@ namespace virtdb { namespace datasrc {
      
       // set compression properties
       c.set_comptype(interface::pb::CompressionType::LZ4_COMPRESSION);
-      c.set_compresseddata(compressed_buffer.get(), lz4ret);
       c.set_uncompressedsize(byte_size);
     }
   }
   
+  void
+  column::encode(const util::lz4_options & opts)
+  {
+    auto writer = write_values();
+    if( !writer )
+    {
+      convert_pb();
+      compress(opts);
+      return;
+    }
+    
+    auto & c = get_pb_column();
+    auto * dta = c.mutable_data();
+    size_t byte_size = writer->byte_size();
+    
+    util::flex_alloc<char, 2048> uncompressed_buffer{byte_size};
+    writer->copy_to(uncompressed_buffer.get());
+    
+    // the type stays in the PB data, like after compress()
+    dta->Clear();
+    dta->set_type(writer->kind());
+    writer.reset();
+    
+    if( !util::lz4_utils::compress(uncompressed_buffer.get(),
+                                   byte_size,
+                                   *(c.mutable_compresseddata()),
+                                   opts) )
+    {
+      // send it uncompressed like compress() would
+      c.clear_compresseddata();
+      LOG_ERROR("LZ4 compression failed");
+      dta->ParseFromArray(uncompressed_buffer.get(), static_cast<int>(byte_size));
+      return;
+    }
+    
+    c.set_comptype(interface::pb::CompressionType::LZ4_COMPRESSION);
+    c.set_uncompressedsize(byte_size);
+  }
+  
+  util::value_type_writer::sptr
+  column::write_values()
+  {
+    return util::value_type_writer::sptr();
+  }
+  
   interface::pb::Column &
   column::get_pb_column()
   {
@@ -166,6 +222,15 @@ namespace virtdb { namespace datasrc {
       actual_sizes_.push_back(0);
   }
 
+  size_t
+  fixed_width_column::footprint(size_t max_rows,
+                                size_t max_size)
+  {
+    return (column::footprint(max_rows) +
+            max_rows*max_size +
+            max_rows*sizeof(size_t));
+  }
+  
   void
   fixed_width_column::free_temp_data()
   {
@@ -214,6 +279,165 @@ namespace virtdb { namespace datasrc {
   {
     return in_field_offset_;
   }
+  
+  /////////////////
+  
+  var_width_column::var_width_column(size_t max_rows,
+                                     size_t max_size)
+  : parent_type{max_rows},
+    data_size_{0},
+    data_capacity_{0},
+    max_size_{max_size}
+  {
+    if( !max_size )
+    {
+      THROW_("max_size parameter is zero");
+    }
+    offsets_.reserve(max_rows+1);
+    offsets_.push_back(0);
+    grow(initial_capacity());
+  }
+  
+  size_t
+  var_width_column::footprint(size_t max_rows,
+                              size_t max_size)
+  {
+    return (column::footprint(max_rows) +
+            max_rows*std::min(max_size, static_cast<size_t>(32)) +
+            (max_rows+1)*sizeof(uint32_t));
+  }
+  
+  size_t
+  var_width_column::initial_capacity() const
+  {
+    // short values are the common case, even for wide declared columns
+    return max_rows()*std::min(max_size_, static_cast<size_t>(32));
+  }
+  
+  void
+  var_width_column::grow(size_t min_capacity)
+  {
+    if( data_ && min_capacity <= data_capacity_ )
+      return;
+    
+    size_t new_capacity = std::max(data_capacity_*2, min_capacity);
+    if( new_capacity > std::numeric_limits<uint32_t>::max() )
+    {
+      new_capacity = std::numeric_limits<uint32_t>::max();
+      if( min_capacity > new_capacity )
+      {
+        THROW_("column data exceeds the 4GB offset limit");
+      }
+    }
+    
+    data_uptr new_data{new char[new_capacity]};
+    if( data_ && data_size_ )
+      ::memcpy(new_data.get(), data_.get(), data_size_);
+    data_.swap(new_data);
+    data_capacity_ = new_capacity;
+  }
+  
+  void
+  var_width_column::free_temp_data()
+  {
+    // don't keep a grown arena while the column sits in the pool
+    if( data_capacity_ > initial_capacity() )
+    {
+      data_.reset();
+      data_capacity_ = 0;
+    }
+  }
+  
+  void
+  var_width_column::prepare()
+  {
+    data_size_ = 0;
+    offsets_.clear();
+    offsets_.push_back(0);
+    grow(initial_capacity());
+    column::prepare();
+  }
+  
+  size_t
+  var_width_column::max_size() const
+  {
+    return max_size_;
+  }
+  
+  char *
+  var_width_column::get_ptr()
+  {
+    return data_.get();
+  }
+  
+  const var_width_column::offset_vector &
+  var_width_column::offsets() const
+  {
+    return offsets_;
+  }
+  
+  size_t
+  var_width_column::data_size() const
+  {
+    return data_size_;
+  }
+  
+  size_t
+  var_width_column::data_capacity() const
+  {
+    return data_capacity_;
+  }
+  
+  void
+  var_width_column::append(const char * ptr,
+                           size_t len)
+  {
+    char * dest = reserve(len);
+    len = std::min(len, max_size_);
+    if( len )
+      ::memcpy(dest, ptr, len);
+    commit(len);
+  }
+  
+  void
+  var_width_column::append_null()
+  {
+    size_t pos = offsets_.size()-1;
+    commit(0);
+    nulls()[pos] = true;
+  }
+  
+  char *
+  var_width_column::reserve(size_t len)
+  {
+    if( offsets_.size() > max_rows() )
+    {
+      THROW_("column is full");
+    }
+    grow(data_size_+std::min(len, max_size_));
+    return data_.get()+data_size_;
+  }
+  
+  void
+  var_width_column::commit(size_t len)
+  {
+    size_t pos = offsets_.size()-1;
+    if( pos >= max_rows() )
+    {
+      THROW_("column is full");
+    }
+    
+    len = std::min(len, max_size_);
+    if( data_size_+len > data_capacity_ )
+    {
+      THROW_("commit exceeds the reserved space");
+    }
+    data_size_ += len;
+    // the null flags are kept between uses of the column
+    nulls()[pos] = false;
+    offsets_.push_back(static_cast<uint32_t>(data_size_));
+    n_rows(offsets_.size()-1);
+  }
 
 
 }}
@@ -1,18 +1,23 @@
 #pragma once
 
 #include <data.pb.h>
+#include <util/lz4_utils.hh>
+#include <util/null_bitmap.hh>
+#include <util/value_type_writer.hh>
 #include <functional>
 #include <memory>
 #include <vector>
 
 namespace virtdb { namespace datasrc {
 
+  class pool;
+  
   class column
   {
   public:
     typedef std::shared_ptr<column>       sptr;
     typedef std::function<void(sptr)>     on_dispose;
-    typedef std::vector<bool>             null_vector;
+    typedef util::null_bitmap             null_vector;
     
   private:
     size_t                     max_rows_;
@@ -20,11 +25,20 @@ namespace virtdb { namespace datasrc {
     interface::pb::Column      pb_column_;
     on_dispose                 on_dispose_;
     null_vector                nulls_;
+    // intrusive link of the pool's free list
+    sptr                       next_free_;
+    bool                       in_free_list_;
+    
+    friend class pool;
     
   public:
     column(size_t max_rows);
     virtual ~column() {}
     
+    // nominal bytes of a column, charged against the memory_budget by
+    // the pools. the derived types add their data buffers
+    static size_t footprint(size_t max_rows);
+    
     // common properties
     size_t max_rows() const;
     null_vector & nulls();
@@ -34,17 +48,26 @@ namespace virtdb { namespace datasrc {
     void n_rows(size_t n);
     size_t seqno();
     bool is_last();
-
+    
     // interface for children
     virtual char * get_ptr() = 0;
     virtual size_t n_rows() const;
     virtual void prepare();           // step #1: preparation
     virtual void convert_pb() = 0;    // step #2: convert internal data to uncompressed PB
     virtual void compress();          // step #3: compress data
+    virtual void compress(const util::lz4_options & opts);
+    virtual void encode(const util::lz4_options & opts);
+                                      // steps #2 and #3 without building the PB data
                                       // step #4: get pb data for sending over
     virtual interface::pb::Column & get_pb_column();
     virtual void dispose(sptr &&);    // step #5: return this column to the pool
     
+  protected:
+    // writes the values straight into the wire format for encode(). the
+    // types without a direct encoder return nullptr, encode() falls back
+    // to convert_pb() and compress() for them
+    virtual util::value_type_writer::sptr write_values();
+    
   private:
     column() = delete;
     column(const column &) = delete;
@@ -64,6 +87,11 @@ namespace virtdb { namespace datasrc {
       data_{new T[max_rows]}
     {}
     
+    static size_t footprint(size_t max_rows)
+    {
+      return column::footprint(max_rows) + max_rows*sizeof(T);
+    }
+    
     T * get_typed_ptr() { return data_.get(); }
     char * get_ptr() { return reinterpret_cast<char *>(data_.get()); }
   };
@@ -88,6 +116,7 @@ namespace virtdb { namespace datasrc {
     
   public:
     fixed_width_column(size_t max_rows, size_t max_size);
+    static size_t footprint(size_t max_rows, size_t max_size);
     size_vector & actual_sizes();
     size_t max_size() const;
     char * get_ptr();
@@ -95,4 +124,50 @@ namespace virtdb { namespace datasrc {
     size_t in_field_offset() const;
   };
   
+  // variable width values stored back to back in a single arena, the
+  // i-th value is [offsets()[i], offsets()[i+1]). the arena grows on
+  // demand so the memory used follows the actual value sizes rather
+  // than max_rows*max_size
+  class var_width_column : public column
+  {
+  public:
+    typedef std::vector<uint32_t> offset_vector;
+    
+  private:
+    typedef column                   parent_type;
+    typedef std::unique_ptr<char[]>  data_uptr;
+    
+    data_uptr       data_;
+    size_t          data_size_;
+    size_t          data_capacity_;
+    offset_vector   offsets_;
+    size_t          max_size_;
+    
+    size_t initial_capacity() const;
+    void grow(size_t min_capacity);
+    
+  protected:
+    void free_temp_data();
+    
+  public:
+    var_width_column(size_t max_rows, size_t max_size);
+    // the arena may grow beyond this while the column is being filled
+    static size_t footprint(size_t max_rows, size_t max_size);
+    void prepare();
+    size_t max_size() const;
+    char * get_ptr();
+    const offset_vector & offsets() const;
+    size_t data_size() const;
+    size_t data_capacity() const;
+    
+    // values longer than max_size are truncated
+    void append(const char * ptr, size_t len);
+    void append_null();
+    
+    // gives room for the next value so it can be written in place,
+    // commit() tells how much was actually used
+    char * reserve(size_t len);
+    void commit(size_t len);
+  };
+  
 }}
@@ -0,0 +1,210 @@
+#ifdef RELEASE
+#define LOG_TRACE_IS_ENABLED false
+#define LOG_SCOPED_IS_ENABLED false
+#endif //RELEASE
+
+#include "compressor.hh"
+#include <util/exception.hh>
+#include <util/relative_time.hh>
+#include <logger.hh>
+#include <thread>
+
+namespace virtdb { namespace datasrc {
+  
+  compressor::stats::stats()
+  : seqno_{0},
+    uncompressed_size_{0},
+    compressed_size_{0},
+    usec_{0}
+  {
+  }
+  
+  double
+  compressor::stats::ratio() const
+  {
+    if( !compressed_size_ ) return 0.0;
+    return ((double)uncompressed_size_)/((double)compressed_size_);
+  }
+  
+  compressor::compressor(on_compressed handler,
+                         unsigned int n_threads,
+                         const util::lz4_options & opts)
+  : on_compressed_{handler},
+    options_(opts),
+    uncompressed_bytes_{0},
+    compressed_bytes_{0},
+    compress_usec_{0},
+    queue_{(n_threads ? n_threads : 1),
+           std::bind(&compressor::process,
+                     this,
+                     std::placeholders::_1)}
+  {
+    if( !on_compressed_ )
+    {
+      THROW_("invalid on_compressed handler");
+    }
+  }
+  
+  compressor::~compressor()
+  {
+    queue_.stop();
+  }
+  
+  void
+  compressor::process(column::sptr col)
+  {
+    if( !col ) return;
+    
+    auto opts = options_for(col->get_pb_column().queryid());
+    
+    stats st;
+    {
+      util::relative_time rt;
+      col->encode(opts);
+      st.usec_ = rt.get_usec();
+    }
+    
+    // the handler may dispose the column
+    auto & c = col->get_pb_column();
+    std::string query_id{c.queryid()};
+    bool sent_dictionary = (opts.dictionary_ &&
+                            opts.dictionary_mode_ == util::lz4_options::ANNOUNCE &&
+                            c.has_compresseddata());
+    st.name_    = c.name();
+    st.seqno_   = c.seqno();
+    
+    if( c.has_compresseddata() )
+    {
+      st.uncompressed_size_  = c.uncompressedsize();
+      st.compressed_size_    = c.compresseddata().size();
+    }
+    else
+    {
+      // compression failed or not needed, data goes uncompressed
+      st.uncompressed_size_  = c.data().ByteSize();
+      st.compressed_size_    = st.uncompressed_size_;
+    }
+    
+    uncompressed_bytes_  += st.uncompressed_size_;
+    compressed_bytes_    += st.compressed_size_;
+    compress_usec_       += st.usec_;
+    
+    LOG_TRACE("column compressed" <<
+              V_(st.name_) <<
+              V_(st.seqno_) <<
+              V_(st.uncompressed_size_) <<
+              V_(st.compressed_size_) <<
+              V_(st.usec_));
+    
+    on_compressed_(col, st);
+    if( sent_dictionary ) announced(query_id);
+  }
+  
+  util::lz4_options
+  compressor::options_for(const std::string & query_id)
+  {
+    std::lock_guard<std::mutex> l(hints_mtx_);
+    auto it = hints_.find(query_id);
+    if( it == hints_.end() )
+      return options_;
+    
+    util::lz4_options ret{it->second.options_};
+    if( ret.dictionary_ &&
+        ret.dictionary_mode_ == util::lz4_options::REFERENCE &&
+        !it->second.announced_ )
+    {
+      ret.dictionary_mode_ = util::lz4_options::ANNOUNCE;
+    }
+    return ret;
+  }
+  
+  void
+  compressor::announced(const std::string & query_id)
+  {
+    std::lock_guard<std::mutex> l(hints_mtx_);
+    auto it = hints_.find(query_id);
+    if( it != hints_.end() )
+      it->second.announced_ = true;
+  }
+  
+  void
+  compressor::set_query_options(const std::string & query_id,
+                                const util::lz4_options & opts)
+  {
+    std::lock_guard<std::mutex> l(hints_mtx_);
+    query_hint & h = hints_[query_id];
+    h.options_    = opts;
+    h.announced_  = false;
+  }
+  
+  void
+  compressor::remove_query_options(const std::string & query_id)
+  {
+    std::lock_guard<std::mutex> l(hints_mtx_);
+    hints_.erase(query_id);
+  }
+  
+  void
+  compressor::push(column::sptr col)
+  {
+    if( col ) queue_.push(std::move(col));
+  }
+  
+  bool
+  compressor::wait_empty(uint64_t timeout_ms)
+  {
+    return queue_.wait_empty(std::chrono::milliseconds(timeout_ms));
+  }
+  
+  void
+  compressor::stop()
+  {
+    queue_.stop();
+  }
+  
+  uint64_t
+  compressor::n_enqueued() const
+  {
+    return queue_.n_enqueued();
+  }
+  
+  uint64_t
+  compressor::n_done() const
+  {
+    return queue_.n_done();
+  }
+  
+  uint64_t
+  compressor::uncompressed_bytes() const
+  {
+    return uncompressed_bytes_;
+  }
+  
+  uint64_t
+  compressor::compressed_bytes() const
+  {
+    return compressed_bytes_;
+  }
+  
+  uint64_t
+  compressor::compress_usec() const
+  {
+    return compress_usec_;
+  }
+  
+  double
+  compressor::ratio() const
+  {
+    uint64_t compressed = compressed_bytes_;
+    if( !compressed ) return 0.0;
+    return ((double)uncompressed_bytes_)/((double)compressed);
+  }
+  
+  unsigned int
+  compressor::default_threads()
+  {
+    unsigned int ret = std::thread::hardware_concurrency();
+    return (ret ? ret : 1);
+  }
+  
+}}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <datasrc/column.hh>
+#include <util/active_queue.hh>
+#include <util/constants.hh>
+#include <util/lz4_utils.hh>
+#include <functional>
+#include <memory>
+#include <atomic>
+#include <string>
+#include <map>
+#include <mutex>
+
+namespace virtdb { namespace datasrc {
+  
+  // encodes and compresses the filled columns on a pool of worker
+  // threads and hands them over to on_compressed
+  class compressor
+  {
+  public:
+    typedef std::shared_ptr<compressor> sptr;
+    
+    struct stats
+    {
+      std::string   name_;
+      uint64_t      seqno_;
+      size_t        uncompressed_size_;
+      size_t        compressed_size_;
+      uint64_t      usec_;
+      
+      stats();
+      double ratio() const;
+    };
+    
+    typedef std::function<void(column::sptr, const stats &)> on_compressed;
+    
+  private:
+    typedef util::active_queue<column::sptr,util::TINY_TIMEOUT_MS> queue;
+    
+    struct query_hint
+    {
+      util::lz4_options   options_;
+      bool                announced_;
+    };
+    typedef std::map<std::string, query_hint> hint_map;
+    
+    on_compressed           on_compressed_;
+    util::lz4_options       options_;
+    std::mutex              hints_mtx_;
+    hint_map                hints_;
+    std::atomic<uint64_t>   uncompressed_bytes_;
+    std::atomic<uint64_t>   compressed_bytes_;
+    std::atomic<uint64_t>   compress_usec_;
+    // must be the last member, the workers start in its constructor
+    queue                   queue_;
+    
+    void process(column::sptr col);
+    util::lz4_options options_for(const std::string & query_id);
+    void announced(const std::string & query_id);
+    
+  public:
+    compressor(on_compressed handler,
+               unsigned int n_threads=default_threads(),
+               const util::lz4_options & opts=util::lz4_options());
+    virtual ~compressor();
+    
+    void push(column::sptr col);
+    bool wait_empty(uint64_t timeout_ms);
+    
+    // per query options, e.g. the dictionary of the queried table. the
+    // other queries use the options given to the constructor. with a
+    // REFERENCE dictionary the blocks announce it till the first such
+    // block was handed over to on_compressed, then only refer to it
+    void set_query_options(const std::string & query_id,
+                           const util::lz4_options & opts);
+    void remove_query_options(const std::string & query_id);
+
+    void stop();
+    
+    uint64_t n_enqueued() const;
+    uint64_t n_done() const;
+    uint64_t uncompressed_bytes() const;
+    uint64_t compressed_bytes() const;
+    uint64_t compress_usec() const;
+    double ratio() const;
+    
+    static unsigned int default_threads();
+    
+  private:
+    compressor() = delete;
+    compressor(const compressor &) = delete;
+    compressor & operator=(const compressor &) = delete;
+  };
+  
+}}
@@ -7,4 +7,10 @@ namespace virtdb { namespace datasrc {
   {
   }
   
+  size_t
+  date_column::footprint(size_t max_rows)
+  {
+    return parent_type::footprint(max_rows, 8);
+  }
+  
 }}
@@ -10,6 +10,7 @@ namespace virtdb { namespace datasrc {
     
   public:
     date_column(size_t max_rows);
+    static size_t footprint(size_t max_rows);
   };
   
 }}
@@ -12,6 +12,12 @@ namespace virtdb { namespace datasrc {
   : parent_type{max_rows, 32}
   {
   }
+  
+  size_t
+  datetime_column::footprint(size_t max_rows)
+  {
+    return parent_type::footprint(max_rows, 32);
+  }
 
   
   datetime_column::datetime_column(size_t max_rows,
@@ -21,9 +27,8 @@ namespace virtdb { namespace datasrc {
   }
   
   void
-  datetime_column::convert_pb()
+  datetime_column::sanitize()
   {
-    // sanitize here ...
     size_t n = std::min(max_rows(), n_rows());
     auto * val_ptr    = get_ptr();
     auto & null_vals  = this->nulls();
@@ -97,9 +102,22 @@ namespace virtdb { namespace datasrc {
         val_ptr += max_size();
       }
     }
-    
+  }
+  
+  void
+  datetime_column::convert_pb()
+  {
+    sanitize();
     // let our parent do the real conversion
     parent_type::convert_pb();
   }
   
+  util::value_type_writer::sptr
+  datetime_column::write_values()
+  {
+    if( !get_ptr() ) return util::value_type_writer::sptr();
+    sanitize();
+    return parent_type::write_values();
+  }
+  
 }}
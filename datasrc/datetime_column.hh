@@ -12,7 +12,17 @@ namespace virtdb { namespace datasrc {
     datetime_column(size_t max_rows);
     datetime_column(size_t max_rows, size_t max_size);
     
+    using parent_type::footprint;
+    static size_t footprint(size_t max_rows);
+    
     void convert_pb();
+    
+  protected:
+    util::value_type_writer::sptr write_values();
+    
+  private:
+    // invalid dates are turned into nulls
+    void sanitize();
   };
   
 }}
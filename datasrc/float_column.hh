@@ -12,6 +12,9 @@ namespace virtdb { namespace datasrc {
     float_column(size_t max_rows);
     
     void convert_pb();
+    
+  protected:
+    util::value_type_writer::sptr write_values();
   };
 
 }}
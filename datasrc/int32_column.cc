@@ -1,5 +1,6 @@
 #include "int32_column.hh"
 #include <util/value_type.hh>
+#include <cstring>
 
 namespace virtdb { namespace datasrc {
   
@@ -18,26 +19,31 @@ namespace virtdb { namespace datasrc {
     data_pb_ptr->Clear();
     data_pb_ptr->set_type(interface::pb::Kind::INT32);
     auto * mdv = data_pb_ptr->mutable_int32value();
-    mdv->Reserve(n);
+    mdv->Resize(static_cast<int>(n), 0);
+    if( n )
+      ::memcpy(mdv->mutable_data(), get_typed_ptr(), n*sizeof(int32_t));
     
-    auto * nulls_pb = data_pb_ptr->mutable_isnull();
-    nulls_pb->Clear();
-    nulls_pb->Reserve(n);
+    // null rows are sent as zeros
+    auto & null_vals = this->nulls();
+    auto * dst = mdv->mutable_data();
+    null_vals.for_each_null(n, [dst](size_t i) { dst[i] = 0; });
+    util::value_type_base::set_nulls(*data_pb_ptr, null_vals, n);
+  }
+  
+  util::value_type_writer::sptr
+  int32_column::write_values()
+  {
+    size_t n = std::min(max_rows(), n_rows());
+    if( !n ) return util::value_type_writer::sptr();
     
+    // null rows are sent as zeros, the buffer is not needed afterwards
     auto & null_vals = this->nulls();
-    auto * values = get_typed_ptr();
+    auto * vals = get_typed_ptr();
+    null_vals.for_each_null(n, [vals](size_t i) { vals[i] = 0; });
     
-    for( size_t i=0; i<n; ++i  )
-    {
-      if( !null_vals[i] )
-      {
-        data_pb_ptr->add_int32value(values[i]);
-      }
-      else
-      {
-        data_pb_ptr->add_int32value(0);
-        util::value_type_base::set_null(*data_pb_ptr, i);
-      }
-    }
+    auto ret = util::value_type_writer::construct(interface::pb::Kind::INT32, n);
+    ret->write_int32_batch(vals, nullptr, n);
+    ret->set_null_bits(0, null_vals.words(), n);
+    return ret;
   }
 }}
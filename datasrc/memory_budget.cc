@@ -0,0 +1,100 @@
+#include "memory_budget.hh"
+#include <atomic>
+
+namespace virtdb { namespace datasrc {
+
+  namespace
+  {
+    std::atomic<uint64_t> limit_{0};
+    std::atomic<uint64_t> current_{0};
+    std::atomic<uint64_t> peak_{0};
+    std::atomic<uint64_t> n_waits_{0};
+    std::atomic<uint64_t> n_overcommits_{0};
+    
+    void
+    update_peak(uint64_t value)
+    {
+      uint64_t peak = peak_.load();
+      while( value > peak && !peak_.compare_exchange_weak(peak, value) ) {}
+    }
+  }
+
+  void
+  memory_budget::limit(size_t bytes)
+  {
+    limit_ = bytes;
+  }
+
+  size_t
+  memory_budget::limit()
+  {
+    return limit_.load();
+  }
+
+  size_t
+  memory_budget::current()
+  {
+    return current_.load();
+  }
+
+  size_t
+  memory_budget::peak()
+  {
+    return peak_.load();
+  }
+
+  void
+  memory_budget::reset_peak()
+  {
+    peak_ = current_.load();
+  }
+
+  memory_budget::stats
+  memory_budget::get_stats()
+  {
+    return stats{current_.load(),
+                 peak_.load(),
+                 limit_.load(),
+                 n_waits_.load(),
+                 n_overcommits_.load()};
+  }
+
+  bool
+  memory_budget::try_reserve(size_t bytes)
+  {
+    uint64_t cur = current_.load();
+    while( true )
+    {
+      uint64_t lim = limit_.load();
+      if( lim && cur+bytes > lim )
+        return false;
+      if( current_.compare_exchange_weak(cur, cur+bytes) )
+        break;
+    }
+    update_peak(cur+bytes);
+    return true;
+  }
+
+  void
+  memory_budget::force_reserve(size_t bytes)
+  {
+    uint64_t value = (current_ += bytes);
+    uint64_t lim = limit_.load();
+    if( lim && value > lim )
+      ++n_overcommits_;
+    update_peak(value);
+  }
+
+  void
+  memory_budget::release(size_t bytes)
+  {
+    current_ -= bytes;
+  }
+
+  void
+  memory_budget::count_wait()
+  {
+    ++n_waits_;
+  }
+
+}}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace virtdb { namespace datasrc {
+
+  // process wide byte budget shared by all column pools. pools charge the
+  // nominal size of every column they create and give it back when they
+  // are destroyed, allocations block while the budget is exhausted. the
+  // limit is zero by default, which means unlimited
+  class memory_budget final
+  {
+  public:
+    struct stats
+    {
+      uint64_t current_bytes_;
+      uint64_t peak_bytes_;
+      uint64_t limit_bytes_;
+      // allocations that had to wait for the budget
+      uint64_t n_waits_;
+      // reservations let over the limit
+      uint64_t n_overcommits_;
+    };
+    
+    static void limit(size_t bytes);
+    static size_t limit();
+    static size_t current();
+    static size_t peak();
+    static void reset_peak();
+    static stats get_stats();
+    
+    // reserves the bytes only if they fit into the limit
+    static bool try_reserve(size_t bytes);
+    // reserves the bytes even beyond the limit
+    static void force_reserve(size_t bytes);
+    static void release(size_t bytes);
+    static void count_wait();
+
+  private:
+    memory_budget() = delete;
+    memory_budget(const memory_budget &) = delete;
+    memory_budget & operator=(const memory_budget &) = delete;
+  };
+
+}}
@@ -8,6 +8,9 @@ namespace virtdb { namespace datasrc {
   : max_rows_{max_rows},
     allocated_{0},
     max_allocated_{max_allocated},
+    charged_bytes_{0},
+    n_free_{0},
+    n_waiters_{0},
     is_valid_{true}
   {
     on_dispose_ = [this](column::sptr && col) {
@@ -18,8 +21,10 @@ namespace virtdb { namespace datasrc {
       else if( col )
       {
         lock l{mtx_};
-        pool_.insert(col);
-        cv_.notify_all();
+        push_free(std::move(col));
+        // waking up nobody still costs a syscall
+        if( n_waiters_ )
+          cv_.notify_all();
       }
     };
   }
@@ -29,33 +34,34 @@ namespace virtdb { namespace datasrc {
     is_valid_ = false;
     {
       lock l{mtx_};
-      pool_.clear();
+      // unlink one by one, a long chain would recurse in the destructors
+      while( free_head_ )
+        pop_free();
+      // columns still in use are freed by their owners, the budget
+      // doesn't wait for them
+      memory_budget::release(charged_bytes_);
+      charged_bytes_ = 0;
     }
   }
   
   bool
   pool::wait_all_disposed(uint64_t timeout_ms)
   {
-    {
-      // initial check for block state
-      lock l(mtx_);
-      if( allocated_ == pool_.size() )
-        return true;
-    }
-    
     auto wait_till = (std::chrono::steady_clock::now() +
                       std::chrono::milliseconds(timeout_ms));
     
-    std::cv_status cvstat = std::cv_status::no_timeout;
-    
-    while( cvstat != std::cv_status::timeout )
+    // checking under the lock, so a dispose between the checks and the
+    // wait cannot be missed
+    lock l(mtx_);
+    while( allocated_ != n_free_ )
     {
-      lock l(mtx_);
-      cvstat = cv_.wait_until(l, wait_till);
-      if( allocated_ == pool_.size() )
-        return true;
+      ++n_waiters_;
+      std::cv_status cvstat = cv_.wait_until(l, wait_till);
+      --n_waiters_;
+      if( cvstat == std::cv_status::timeout )
+        return (allocated_ == n_free_);
     }
-    return false;
+    return true;
   }
   
   size_t
@@ -69,13 +75,20 @@ namespace virtdb { namespace datasrc {
     return ret;
   }
   
+  size_t
+  pool::charged_bytes()
+  {
+    lock l(mtx_);
+    return charged_bytes_;
+  }
+  
   size_t
   pool::n_disposed()
   {
     size_t ret = 0;
     {
       lock l(mtx_);
-      ret = pool_.size();
+      ret = n_free_;
     }
     return ret;
   }
@@ -4,26 +4,30 @@
 #include <util/relative_time.hh>
 #include <util/constants.hh>
 #include <datasrc/column.hh>
+#include <datasrc/memory_budget.hh>
 #include <logger.hh>
 #include <functional>
 #include <list>
 #include <memory>
 #include <mutex>
 #include <condition_variable>
-#include <set>
 #include <atomic>
 
 namespace virtdb { namespace datasrc {
   
   class pool
   {
-    typedef std::set<column::sptr>        column_pool;
     typedef std::unique_lock<std::mutex>  lock;
     
-    column_pool              pool_;
     size_t                   max_rows_;
     size_t                   allocated_;
     size_t                   max_allocated_;
+    size_t                   charged_bytes_;
+    // disposed columns linked through column::next_free_, the most
+    // recently disposed one is reused first while it is still warm
+    column::sptr             free_head_;
+    size_t                   n_free_;
+    size_t                   n_waiters_;
     column::on_dispose       on_dispose_;
     std::condition_variable  cv_;
     std::mutex               mtx_;
@@ -37,6 +41,8 @@ namespace virtdb { namespace datasrc {
     bool wait_all_disposed(uint64_t timeout_ms);
     size_t n_allocated();
     size_t n_disposed();
+    // bytes charged against the memory_budget for the columns created
+    size_t charged_bytes();
     
     template <typename COLUMN_TYPE>
     column::sptr allocate()
@@ -44,36 +50,46 @@ namespace virtdb { namespace datasrc {
       column::sptr ret;
       util::relative_time now;
       bool first_pass = true;
+      bool over_budget = false;
       
       while( is_valid_ )
       {
         lock l(mtx_);
-        if( pool_.size() > 0 )
+        if( free_head_ )
         {
-          auto it = pool_.begin();
-          ret = *it;
-          pool_.erase(it);
+          ret = pop_free();
           break;
         }
         
         if( allocated_ < max_allocated_ )
         {
-          ++allocated_;
-          ret.reset(new COLUMN_TYPE{max_rows_});
-          ret->set_on_dispose(on_dispose_);
-          break;
+          if( charge(COLUMN_TYPE::footprint(max_rows_)) )
+          {
+            ++allocated_;
+            ret.reset(new COLUMN_TYPE{max_rows_});
+            ret->set_on_dispose(on_dispose_);
+            break;
+          }
+          // over the memory budget. the columns of other pools don't
+          // notify us, so recheck sooner
+          if( !over_budget ) memory_budget::count_wait();
+          over_budget = true;
         }
         // we have no items int the pool and cannot
         // allocate. we have to wait for an item to be disposed
         if( first_pass ) first_pass = false;
         
         // bounded wait. we restart the loop if timed out
-        cv_.wait_for(l, std::chrono::milliseconds(util::DEFAULT_TIMEOUT_MS));
+        ++n_waiters_;
+        cv_.wait_for(l, std::chrono::milliseconds(over_budget ?
+                                                  util::TINY_TIMEOUT_MS :
+                                                  util::DEFAULT_TIMEOUT_MS));
+        --n_waiters_;
       }
       
       if( !first_pass )
       {
-        LOG_INFO("spent" <<  V_(now.get_msec()) << "ms waiting for column");
+        LOG_INFO("spent" <<  V_(now.get_msec()) << "ms waiting for column" << V_(over_budget));
       }
       return ret;
     }
@@ -84,36 +100,46 @@ namespace virtdb { namespace datasrc {
       column::sptr ret;
       util::relative_time now;
       bool first_pass = true;
+      bool over_budget = false;
       
       while( is_valid_ )
       {
         lock l(mtx_);
-        if( pool_.size() > 0 )
+        if( free_head_ )
         {
-          auto it = pool_.begin();
-          ret = *it;
-          pool_.erase(it);
+          ret = pop_free();
           break;
         }
         
         if( allocated_ < max_allocated_ )
         {
-          ++allocated_;
-          ret.reset(new COLUMN_TYPE{max_rows_,max_size});
-          ret->set_on_dispose(on_dispose_);
-          break;
+          if( charge(COLUMN_TYPE::footprint(max_rows_, max_size)) )
+          {
+            ++allocated_;
+            ret.reset(new COLUMN_TYPE{max_rows_,max_size});
+            ret->set_on_dispose(on_dispose_);
+            break;
+          }
+          // over the memory budget. the columns of other pools don't
+          // notify us, so recheck sooner
+          if( !over_budget ) memory_budget::count_wait();
+          over_budget = true;
         }
         // we have no items int the pool and cannot
         // allocate. we have to wait for an item to be disposed
         if( first_pass ) first_pass = false;
         
         // bounded wait. we restart the loop if timed out
-        cv_.wait_for(l, std::chrono::milliseconds(util::DEFAULT_TIMEOUT_MS));
+        ++n_waiters_;
+        cv_.wait_for(l, std::chrono::milliseconds(over_budget ?
+                                                  util::TINY_TIMEOUT_MS :
+                                                  util::DEFAULT_TIMEOUT_MS));
+        --n_waiters_;
       }
       
       if( !first_pass )
       {
-        LOG_INFO("spent" <<  V_(now.get_msec()) << "ms waiting for column");
+        LOG_INFO("spent" <<  V_(now.get_msec()) << "ms waiting for column" << V_(over_budget));
       }
       return ret;
     }
@@ -125,43 +151,89 @@ namespace virtdb { namespace datasrc {
       column::sptr ret;
       util::relative_time now;
       bool first_pass = true;
+      bool over_budget = false;
       
       while( is_valid_ )
       {
         lock l(mtx_);
-        if( pool_.size() > 0 )
+        if( free_head_ )
         {
-          auto it = pool_.begin();
-          ret = *it;
-          pool_.erase(it);
+          ret = pop_free();
           break;
         }
         
         if( allocated_ < max_allocated_ )
         {
-          ++allocated_;
-          std::shared_ptr<COLUMN_TYPE> ret_tmp{new COLUMN_TYPE{max_rows_, max_size}};
-          ret_tmp->set_on_dispose(on_dispose_);
-          ret_tmp->in_field_offset(in_field_offset);
-          ret = ret_tmp;
-          break;
+          if( charge(COLUMN_TYPE::footprint(max_rows_, max_size)) )
+          {
+            ++allocated_;
+            std::shared_ptr<COLUMN_TYPE> ret_tmp{new COLUMN_TYPE{max_rows_, max_size}};
+            ret_tmp->set_on_dispose(on_dispose_);
+            ret_tmp->in_field_offset(in_field_offset);
+            ret = ret_tmp;
+            break;
+          }
+          // over the memory budget. the columns of other pools don't
+          // notify us, so recheck sooner
+          if( !over_budget ) memory_budget::count_wait();
+          over_budget = true;
         }
         // we have no items int the pool and cannot
         // allocate. we have to wait for an item to be disposed
         if( first_pass ) first_pass = false;
         
         // bounded wait. we restart the loop if timed out
-        cv_.wait_for(l, std::chrono::milliseconds(util::DEFAULT_TIMEOUT_MS));
+        ++n_waiters_;
+        cv_.wait_for(l, std::chrono::milliseconds(over_budget ?
+                                                  util::TINY_TIMEOUT_MS :
+                                                  util::DEFAULT_TIMEOUT_MS));
+        --n_waiters_;
       }
       
       if( !first_pass )
       {
-        LOG_INFO("spent" <<  V_(now.get_msec()) << "ms waiting for column");
+        LOG_INFO("spent" <<  V_(now.get_msec()) << "ms waiting for column" << V_(over_budget));
       }
       return ret;
     }
 
   private:
+    // the free list functions must be called under mtx_
+    void push_free(column::sptr && col)
+    {
+      // disposing a copy of a column that is already free
+      if( col->in_free_list_ )
+        return;
+      col->in_free_list_ = true;
+      col->next_free_ = std::move(free_head_);
+      free_head_ = std::move(col);
+      ++n_free_;
+    }
+    
+    column::sptr pop_free()
+    {
+      column::sptr ret = std::move(free_head_);
+      free_head_ = std::move(ret->next_free_);
+      ret->in_free_list_ = false;
+      --n_free_;
+      return ret;
+    }
+    
+    // charges a new column against the memory_budget, must be called
+    // under mtx_. a pool without columns may go over the limit, so it
+    // cannot be starved by the others
+    bool charge(size_t bytes)
+    {
+      if( !memory_budget::try_reserve(bytes) )
+      {
+        if( allocated_ > 0 )
+          return false;
+        memory_budget::force_reserve(bytes);
+      }
+      charged_bytes_ += bytes;
+      return true;
+    }
+    
     pool() = delete;
     pool(const pool &) = delete;
     pool& operator=(const pool &) = delete;
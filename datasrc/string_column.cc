@@ -19,7 +19,7 @@ namespace virtdb { namespace datasrc {
   string_column::convert_pb()
   {
     if( !get_ptr() ) return;
-
+    
     size_t n = std::min(max_rows(), n_rows());
     auto & column_pb = get_pb_column();
     auto * data_pb_ptr = column_pb.mutable_data();
@@ -29,10 +29,6 @@ namespace virtdb { namespace datasrc {
     auto * mdv = data_pb_ptr->mutable_stringvalue();
     mdv->Reserve(n);
     
-    auto * nulls_pb = data_pb_ptr->mutable_isnull();
-    nulls_pb->Clear();
-    nulls_pb->Reserve(n);
-    
     auto & null_vals  = this->nulls();
     auto * val_ptr    = get_ptr();
     auto & sizes      = actual_sizes();
@@ -48,13 +44,82 @@ namespace virtdb { namespace datasrc {
       else
       {
         data_pb_ptr->add_stringvalue("",0);
-        if( null_vals[i] )
-          util::value_type_base::set_null(*data_pb_ptr, i);        
       }
       val_ptr += max_size();
     }
-
+    
+    util::value_type_base::set_nulls(*data_pb_ptr, null_vals, n);
+    
+    free_temp_data();
+  }
+  
+  util::value_type_writer::sptr
+  string_column::write_values()
+  {
+    size_t n = std::min(max_rows(), n_rows());
+    if( !get_ptr() || !n ) return util::value_type_writer::sptr();
+    
+    auto & null_vals = this->nulls();
+    auto ret = util::value_type_writer::construct(interface::pb::Kind::STRING, n);
+    ret->write_strings_strided(get_ptr()+in_field_offset(),
+                               max_size(),
+                               actual_sizes().data(),
+                               null_vals.words(),
+                               n);
+    
+    free_temp_data();
+    return ret;
+  }
+  
+  var_string_column::var_string_column(size_t max_rows,
+                                       size_t max_size)
+  : parent_type{max_rows, max_size}
+  {
+  }
+  
+  void
+  var_string_column::convert_pb()
+  {
+    if( !get_ptr() ) return;
+    
+    size_t n = std::min(max_rows(), n_rows());
+    auto & column_pb = get_pb_column();
+    auto * data_pb_ptr = column_pb.mutable_data();
+    
+    data_pb_ptr->Clear();
+    data_pb_ptr->set_type(interface::pb::Kind::STRING);
+    auto * mdv = data_pb_ptr->mutable_stringvalue();
+    mdv->Reserve(n);
+    
+    auto & null_vals  = this->nulls();
+    auto * val_ptr    = get_ptr();
+    auto & offs       = offsets();
+    
+    LOG_TRACE("converting" << V_(n) << "rows" << V_(max_rows()) << V_(data_size()));
+    for( size_t i=0; i<n; ++i  )
+    {
+      data_pb_ptr->add_stringvalue(val_ptr+offs[i], offs[i+1]-offs[i]);
+    }
+    
+    util::value_type_base::set_nulls(*data_pb_ptr, null_vals, n);
+    
+    free_temp_data();
+  }
+  
+  util::value_type_writer::sptr
+  var_string_column::write_values()
+  {
+    size_t n = std::min(max_rows(), n_rows());
+    if( !get_ptr() || !n ) return util::value_type_writer::sptr();
+    
+    // the null rows are empty in the arena already
+    auto & null_vals = this->nulls();
+    auto ret = util::value_type_writer::construct(interface::pb::Kind::STRING, n);
+    ret->write_strings(get_ptr(), offsets().data(), nullptr, n);
+    ret->set_null_bits(0, null_vals.words(), n);
+    
     free_temp_data();
+    return ret;
   }
   
 }}
@@ -12,6 +12,22 @@ namespace virtdb { namespace datasrc {
     string_column(size_t max_rows, size_t max_size);
     
     void convert_pb();
+    
+  protected:
+    util::value_type_writer::sptr write_values();
+  };
+  
+  class var_string_column : public var_width_column
+  {
+    typedef var_width_column parent_type;
+    
+  public:
+    var_string_column(size_t max_rows, size_t max_size);
+    
+    void convert_pb();
+    
+  protected:
+    util::value_type_writer::sptr write_values();
   };
   
 }}
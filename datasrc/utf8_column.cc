@@ -15,9 +15,8 @@ namespace virtdb { namespace datasrc {
   }
   
   void
-  utf8_column::convert_pb()
+  utf8_column::sanitize()
   {
-    // sanitize here ...
     size_t n = std::min(max_rows(), n_rows());
     auto * val_ptr    = get_ptr();
     auto & null_vals  = this->nulls();
@@ -37,8 +36,55 @@ namespace virtdb { namespace datasrc {
         val_ptr += max_size();
       }
     }
-    
+  }
+  
+  void
+  utf8_column::convert_pb()
+  {
+    sanitize();
     // let our parent do the real conversion
     string_column::convert_pb();
   }
+  
+  util::value_type_writer::sptr
+  utf8_column::write_values()
+  {
+    if( !get_ptr() ) return util::value_type_writer::sptr();
+    sanitize();
+    return string_column::write_values();
+  }
+  
+  var_utf8_column::var_utf8_column(size_t max_rows,
+                                   size_t max_size)
+  : parent_type{max_rows, max_size}
+  {
+  }
+  
+  void
+  var_utf8_column::sanitize()
+  {
+    size_t n = std::min(max_rows(), n_rows());
+    auto * val_ptr    = get_ptr();
+    auto & offs       = offsets();
+    
+    // the whole arena in one call, only the values with non-ASCII
+    // characters are looked at one by one
+    if( val_ptr && n )
+      util::utf8::sanitize(val_ptr, offs.data(), n);
+  }
+  
+  void
+  var_utf8_column::convert_pb()
+  {
+    sanitize();
+    // let our parent do the real conversion
+    var_string_column::convert_pb();
+  }
+  
+  util::value_type_writer::sptr
+  var_utf8_column::write_values()
+  {
+    sanitize();
+    return var_string_column::write_values();
+  }
 }}
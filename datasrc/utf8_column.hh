@@ -12,6 +12,28 @@ namespace virtdb { namespace datasrc {
     utf8_column(size_t max_rows, size_t max_size);
     
     void convert_pb();
+    
+  protected:
+    util::value_type_writer::sptr write_values();
+    
+  private:
+    void sanitize();
+  };
+  
+  class var_utf8_column : public var_string_column
+  {
+    typedef var_string_column parent_type;
+    
+  public:
+    var_utf8_column(size_t max_rows, size_t max_size);
+    
+    void convert_pb();
+    
+  protected:
+    util::value_type_writer::sptr write_values();
+    
+  private:
+    void sanitize();
   };
   
 }}
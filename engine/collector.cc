@@ -8,15 +8,35 @@
 #include "collector.hh"
 #include <logger.hh>
 #include <functional>
-#include <lz4/lib/lz4.h>
+#include <thread>
+#include <util/lz4_utils.hh>
 #include <util/relative_time.hh>
 
 namespace virtdb { namespace engine {
   
+  namespace
+  {
+    unsigned int process_threads()
+    {
+      // decompression and decoding is CPU bound, so we use all cores
+      unsigned int ret = std::thread::hardware_concurrency();
+      return (ret < 4 ? 4 : ret);
+    }
+    
+    size_t ring_window(size_t window)
+    {
+      // the feeder keeps the two blocks before the actual one and reads
+      // the next one, so a smaller window would deadlock it
+      return (window < 4 ? 4 : window);
+    }
+  }
+  
   collector::collector(size_t n_cols,
-                       resend_function resend_fun)
+                       resend_function resend_fun,
+                       size_t window)
   : collector_{n_cols},
-    queue_{4, std::bind(&collector::prrocess,this,std::placeholders::_1)},
+    ring_{window ? new ring_collector_t{n_cols, ring_window(window)} : nullptr},
+    queue_{process_threads(), std::bind(&collector::prrocess,this,std::placeholders::_1)},
     max_block_id_{-1},
     last_block_id_{-1},
     n_received_{0},
@@ -29,9 +49,18 @@ namespace virtdb { namespace engine {
   
   collector::~collector()
   {
+    if( ring_ ) ring_->stop();
     queue_.stop();
   }
   
+  collector::row_t
+  collector::get_row(size_t block_id,
+                     uint64_t timeout_ms)
+  {
+    if( ring_ ) return ring_->get(block_id, timeout_ms);
+    return collector_.get(block_id, timeout_ms);
+  }
+  
   void
   collector::resend(size_t block_id,
                     const col_vec & cols)
@@ -56,27 +85,27 @@ namespace virtdb { namespace engine {
   collector::prrocess(item::sptr itm)
   {
     // cannot process invalid ptr
-    if( itm.get() == nullptr ) { ++n_process_done_; return; }
+    if( itm.get() == nullptr ) { process_done(itm); return; }
     
     // need a column to be processed
-    if( itm->col_ == nullptr ) { ++n_process_done_; return; }
+    if( itm->col_ == nullptr ) { process_done(itm); return; }
     
     // already processed
-    if( itm->reader_.get() != nullptr ) { ++n_process_done_; return; }
+    if( itm->reader_.get() != nullptr ) { process_done(itm); return; }
     
     int orig_size = itm->col_->uncompressedsize();
-    if( orig_size <= 0 ) { ++n_process_done_; return; }
+    if( orig_size <= 0 ) { process_done(itm); return; }
     
     std::unique_ptr<char[]> buffer{new char[orig_size+1]};
     
     int comp_size = itm->col_->compresseddata().size();
-    if( comp_size <= 0 ) { ++n_process_done_; return; }
+    if( comp_size <= 0 ) { process_done(itm); return; }
     
     char* res_bufer = buffer.get();
-    int comp_ret = LZ4_decompress_safe(itm->col_->compresseddata().c_str(),
-                                       res_bufer,
-                                       itm->col_->compresseddata().size(),
-                                       orig_size);
+    int comp_ret = util::lz4_utils::decompress(itm->col_->compresseddata().c_str(),
+                                               itm->col_->compresseddata().size(),
+                                               res_bufer,
+                                               orig_size);
     if( comp_ret <= 0 )
     {
       LOG_ERROR("failed to decompress" <<
@@ -86,8 +115,8 @@ namespace virtdb { namespace engine {
                 V_(itm->col_->name()) <<
                 V_(itm->col_->endofdata()));
       
-      ++n_process_done_;
       ++n_process_succeed_;
+      process_done(itm);
       return;
     }
     
@@ -96,13 +125,61 @@ namespace virtdb { namespace engine {
     
     // assign reader and update collector
     auto rdr = util::value_type_reader::construct(std::move(buffer), orig_size);
-    itm->reader_ = rdr;
     // collector_.insert(itm->block_id_, itm->col_id_, itm);
     
-    ++n_process_done_;
+    process_done(itm, rdr);
     return;
   }
   
+  void
+  collector::process_done(const item::sptr & itm,
+                          reader_sptr rdr)
+  {
+    lock l(mtx_);
+    if( rdr ) itm->reader_ = rdr;
+    ++n_process_done_;
+    
+    bool block_done = true;
+    if( itm.get() )
+    {
+      auto it = n_block_pending_.find(itm->block_id_);
+      if( it != n_block_pending_.end() )
+      {
+        if( --(it->second) > 0 ) block_done = false;
+        else                     n_block_pending_.erase(it);
+      }
+    }
+    
+    // wakes up get() waiting for the readers of its block or for the
+    // queue to drain. once per block, not for every column
+    if( block_done || n_process_started_ == n_process_done_ )
+      process_cond_.notify_all();
+  }
+  
+  bool
+  collector::enqueue(item::sptr itm)
+  {
+    // an item is decompressed only once, no matter how many times
+    // get() and background_process() see it without a reader
+    if( itm->queued_.exchange(true) )
+      return false;
+    
+    {
+      lock l(mtx_);
+      ++n_block_pending_[itm->block_id_];
+      ++n_process_started_;
+    }
+    queue_.push(itm);
+    return true;
+  }
+  
+  collector::reader_sptr
+  collector::reader_of(const item::sptr & itm) const
+  {
+    lock l(mtx_);
+    return itm->reader_;
+  }
+  
   void
   collector::push(size_t block_id,
                   size_t col_id,
@@ -110,11 +187,19 @@ namespace virtdb { namespace engine {
   {
     LOG_TRACE(V_(block_id) << V_(col_id) << V_(data->seqno()) << V_(data->endofdata()));
     
-    item::sptr i{new item};
+    item::sptr i = std::make_shared<item>();
     i->col_       = data;
     i->block_id_  = block_id;
     i->col_id_    = col_id;
     
+    // the blocks are decompressed in any order, so the dictionary that
+    // the later blocks only refer to is registered in arrival order
+    if( data->has_compresseddata() )
+    {
+      util::lz4_utils::learn_dictionary(data->compresseddata().c_str(),
+                                        data->compresseddata().size());
+    }
+    
     {
       lock l(mtx_);
       ++n_received_;
@@ -127,25 +212,52 @@ namespace virtdb { namespace engine {
         }
       }
     }
-    collector_.insert(block_id, col_id, i);
+    if( ring_ )
+    {
+      if( !ring_->insert(block_id, col_id, i) )
+      {
+        LOG_TRACE("block is out of the collector window" << V_(block_id) << V_(col_id));
+      }
+    }
+    else
+    {
+      collector_.insert(block_id, col_id, i);
+    }
   }
   
   void
   collector::background_process(size_t block_id)
   {
-    auto row = collector_.get(block_id, 1);
-    
-    for( auto & i : row.first )
-    {
-      if( i.get() )
+    auto enqueue_row = [this](size_t block_id) {
+      auto row = get_row(block_id, 0);
+      for( auto & i : row.first )
       {
-        if( !i->reader_ )
+        if( i.get() && !reader_of(i) )
         {
-          ++n_process_started_;
-          queue_.push(i);
+          enqueue(i);
         }
       }
-    }
+    };
+    
+    // start with the columns we already have, the rest are scheduled
+    // the moment the last missing column arrives
+    enqueue_row(block_id);
+    if( ring_ ) ring_->on_complete(block_id, enqueue_row);
+    else        collector_.on_complete(block_id, enqueue_row);
+  }
+  
+  bool
+  collector::ready(size_t block_id)
+  {
+    auto row = get_row(block_id, 0);
+    if( row.second != n_columns() )
+      return false;
+    
+    for( auto & i : row.first )
+      if( !reader_of(i) )
+        return false;
+    
+    return true;
   }
   
   size_t
@@ -155,9 +267,9 @@ namespace virtdb { namespace engine {
                  reader_sptr_vec & results)
   {
     // wait for data. get() returns { row_vector[], non_nil_count }
-    auto row = collector_.get(block_id, data_timeout_ms);
+    auto row = get_row(block_id, data_timeout_ms);
     
-    if( row.second != collector_.n_columns() )
+    if( row.second != n_columns() )
     {
       LOG_TRACE("timed out while waiting for data" <<
                 V_(block_id)  <<
@@ -177,13 +289,12 @@ namespace virtdb { namespace engine {
       if( i.get() )
       {
         // check if we have a reader initialized
-        if( !i->reader_ )
+        auto rdr = reader_of(i);
+        if( !rdr )
         {
           // if no reader is associated with the column sptr
           // then we need to do that asynchronously
-          ++n_process_started_;
-          queue_.push(i);
-          ++n_pushed;
+          if( enqueue(i) ) ++n_pushed;
           // we still need a placeholder so every column in the
           // the result set is valid
           results.push_back(reader_sptr());
@@ -192,7 +303,7 @@ namespace virtdb { namespace engine {
         {
           // we have the reader so we add it to the result vector
           ++n_ok;
-          results.push_back(i->reader_);
+          results.push_back(rdr);
         }
       }
       else
@@ -218,23 +329,37 @@ namespace virtdb { namespace engine {
     }
     else
     {
-      // throw away everything and wait for the queue that assigns readers
-      // is empty
+      // throw away everything and wait until the readers of this block
+      // are assigned or nothing is being processed anymore. we don't wait
+      // for other blocks' columns in the queue
       results.clear();
-      queue_.wait_empty(std::chrono::milliseconds(process_timeout_ms));
-
+      {
+        lock l(mtx_);
+        process_cond_.wait_for(l,
+                               std::chrono::milliseconds(process_timeout_ms),
+                               [&]() {
+          if( n_process_started_ == n_process_done_ )
+            return true;
+          for( auto & i : row.first )
+            if( i.get() && !i->reader_ )
+              return false;
+          return true;
+        });
+      }
+      
       // now recheck the table collector but only give 1 ms to complete
       n_ok = 0;
-      row = collector_.get(block_id, 1);
+      row = get_row(block_id, 1);
       
       // go through the results again either add a valid reader if available
       // or an empty sptr
       for( auto & i : row.first )
       {
-        if( i.get() && i->reader_ )
+        auto rdr = (i.get() ? reader_of(i) : reader_sptr());
+        if( rdr )
         {
           ++n_ok;
-          results.push_back(i->reader_);
+          results.push_back(rdr);
         }
         else
         {
@@ -249,7 +374,8 @@ namespace virtdb { namespace engine {
   void
   collector::erase(size_t block_id)
   {
-    collector_.erase(block_id);
+    if( ring_ ) ring_->erase(block_id);
+    else        collector_.erase(block_id);
   }
   
   int64_t
@@ -309,4 +435,17 @@ namespace virtdb { namespace engine {
     return n_process_succeed_.load();
   }
   
+  size_t
+  collector::n_process_stolen() const
+  {
+    return queue_.n_stolen();
+  }
+  
+  uint64_t
+  collector::n_backpressure_waits() const
+  {
+    if( ring_ ) return ring_->n_backpressure_waits();
+    return 0;
+  }
+  
 }}
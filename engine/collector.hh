@@ -2,11 +2,15 @@
 
 #include <data.pb.h>
 #include <util/table_collector.hh>
-#include <util/active_queue.hh>
+#include <util/ring_table_collector.hh>
+#include <util/work_stealing_queue.hh>
 #include <util/value_type_reader.hh>
 #include <memory>
 #include <vector>
+#include <map>
 #include <mutex>
+#include <atomic>
+#include <condition_variable>
 
 namespace virtdb { namespace engine {
   
@@ -30,12 +34,19 @@ namespace virtdb { namespace engine {
       reader_sptr    reader_;
       size_t         block_id_;
       size_t         col_id_;
+      // set when pushed to the process queue
+      std::atomic<bool>  queued_{false};
     };
     
     typedef util::table_collector<item,23>      collector_t;
-    typedef util::active_queue<item::sptr,50>   process_queue_t;
-
+    typedef util::ring_table_collector<item,23> ring_collector_t;
+    typedef std::unique_ptr<ring_collector_t>   ring_collector_uptr;
+    typedef util::work_stealing_queue<item::sptr,50>   process_queue_t;
+    typedef std::pair<std::vector<item::sptr>,size_t>  row_t;
+    typedef std::map<size_t,size_t>                    pending_map;
+    
     collector_t            collector_;
+    ring_collector_uptr    ring_;
     process_queue_t        queue_;
     int64_t                max_block_id_;
     int64_t                last_block_id_;
@@ -44,6 +55,9 @@ namespace virtdb { namespace engine {
     std::atomic<size_t>    n_process_done_;
     std::atomic<size_t>    n_process_succeed_;
     mutable std::mutex     mtx_;
+    std::condition_variable  process_cond_;
+    // queued but not yet processed columns per block, guarded by mtx_
+    pending_map            n_block_pending_;
     resend_function        resend_;
     
     collector() = delete;
@@ -53,6 +67,12 @@ namespace virtdb { namespace engine {
     void
     prrocess(item::sptr itm);
     
+    row_t get_row(size_t block_id, uint64_t timeout_ms);
+    void process_done(const item::sptr & itm,
+                      reader_sptr rdr = reader_sptr());
+    bool enqueue(item::sptr itm);
+    reader_sptr reader_of(const item::sptr & itm) const;
+    
   public:
     void push(size_t block_id,
               size_t col_id,
@@ -62,9 +82,13 @@ namespace virtdb { namespace engine {
                uint64_t data_timeout_ms,
                uint64_t process_timeout_ms,
                reader_sptr_vec & rdrs);
-
+    
     void background_process(size_t block_id);
     
+    // all columns of the block arrived and have their readers assigned.
+    // doesn't wait
+    bool ready(size_t block_id);
+    
     void erase(size_t block_id);
     
     void resend(size_t block_id,
@@ -79,8 +103,14 @@ namespace virtdb { namespace engine {
     size_t n_process_started() const;
     size_t n_process_done() const;
     size_t n_process_succeed() const;
+    size_t n_process_stolen() const;
+    uint64_t n_backpressure_waits() const;
     
-    collector(size_t n_cols, resend_function resend_fun = [](size_t,const col_vec & ){} );
+    // window > 0 keeps only that many blocks in a ring and push() blocks
+    // while the feeder is more than window blocks behind
+    collector(size_t n_cols,
+              resend_function resend_fun = [](size_t,const col_vec & ){},
+              size_t window = 0);
     virtual ~collector();
   };
   
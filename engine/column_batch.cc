@@ -0,0 +1,144 @@
+#ifdef RELEASE
+#undef LOG_TRACE_IS_ENABLED
+#define LOG_TRACE_IS_ENABLED false
+#undef LOG_SCOPED_IS_ENABLED
+#define LOG_SCOPED_IS_ENABLED false
+#endif //RELEASE
+
+#include "column_batch.hh"
+#include <common.pb.h>
+#include <cstring>
+
+namespace virtdb { namespace engine {
+  
+  namespace
+  {
+    // values decoded by one batch call
+    const size_t chunk_size = 1024;
+  }
+  
+  column_vector::column_vector()
+  : kind_{0},
+    n_rows_{0},
+    n_nulls_{0}
+  {
+  }
+  
+  void
+  column_vector::clear()
+  {
+    reader_.reset();
+    kind_     = 0;
+    n_rows_   = 0;
+    n_nulls_  = 0;
+    ptrs_.clear();
+    lens_.clear();
+    null_bits_.clear();
+  }
+  
+  template <typename T, typename READ>
+  void
+  column_vector::load_fixed(READ read)
+  {
+    size_t n = 0;
+    while( true )
+    {
+      size_t need_words = (((n+chunk_size)*sizeof(T))+7)/8;
+      if( values_.size() < need_words ) values_.resize(need_words);
+      
+      T * out = reinterpret_cast<T *>(values_.data())+n;
+      size_t got = read(out, chunk_size);
+      n += got;
+      if( got < chunk_size ) break;
+    }
+    n_rows_ = n;
+  }
+  
+  template <typename READ>
+  void
+  column_vector::load_ptrs(READ read)
+  {
+    size_t n = 0;
+    while( true )
+    {
+      if( ptrs_.size() < n+chunk_size )
+      {
+        ptrs_.resize(n+chunk_size);
+        lens_.resize(n+chunk_size);
+      }
+      
+      size_t got = read(ptrs_.data()+n, lens_.data()+n, chunk_size);
+      n += got;
+      if( got < chunk_size ) break;
+    }
+    n_rows_ = n;
+    ptrs_.resize(n);
+    lens_.resize(n);
+  }
+  
+  void
+  column_vector::load_nulls(size_t first)
+  {
+    // the reader keeps the nulls as a bitmap already, the batch
+    // readers skip them and we take them in words
+    null_bits_.assign((n_rows_+63)/64, 0);
+    n_nulls_ = reader_->copy_null_bits(first, n_rows_, null_bits_.data());
+  }
+  
+  bool
+  column_vector::load(reader_sptr rdr)
+  {
+    clear();
+    if( !rdr || !rdr->kind() )
+      return false;
+    
+    reader_ = rdr;
+    kind_   = rdr->kind();
+    
+    auto r = rdr.get();
+    size_t first = r->null_pos();
+    switch( kind_ )
+    {
+      case interface::pb::Kind::INT32:
+        load_fixed<int32_t>([r](int32_t * o, size_t n) { return r->read_int32_batch(o, nullptr, n); });
+        break;
+        
+      case interface::pb::Kind::INT64:
+        load_fixed<int64_t>([r](int64_t * o, size_t n) { return r->read_int64_batch(o, nullptr, n); });
+        break;
+        
+      case interface::pb::Kind::UINT32:
+        load_fixed<uint32_t>([r](uint32_t * o, size_t n) { return r->read_uint32_batch(o, nullptr, n); });
+        break;
+        
+      case interface::pb::Kind::UINT64:
+        load_fixed<uint64_t>([r](uint64_t * o, size_t n) { return r->read_uint64_batch(o, nullptr, n); });
+        break;
+        
+      case interface::pb::Kind::DOUBLE:
+        load_fixed<double>([r](double * o, size_t n) { return r->read_double_batch(o, nullptr, n); });
+        break;
+        
+      case interface::pb::Kind::FLOAT:
+        load_fixed<float>([r](float * o, size_t n) { return r->read_float_batch(o, nullptr, n); });
+        break;
+        
+      case interface::pb::Kind::BOOL:
+        load_fixed<bool>([r](bool * o, size_t n) { return r->read_bool_batch(o, nullptr, n); });
+        break;
+        
+      case interface::pb::Kind::BYTES:
+        load_ptrs([r](char ** p, size_t * l, size_t n) { return r->read_bytes_batch(p, l, nullptr, n); });
+        break;
+        
+      default:
+        // all other kinds are sent as strings
+        load_ptrs([r](char ** p, size_t * l, size_t n) { return r->read_string_batch(p, l, nullptr, n); });
+        break;
+    };
+    
+    load_nulls(first);
+    return true;
+  }
+  
+}}
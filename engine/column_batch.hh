@@ -0,0 +1,73 @@
+#pragma once
+
+#include <util/value_type_reader.hh>
+#include <vector>
+#include <cstdint>
+
+namespace virtdb { namespace engine {
+
+  // one column of a block decoded into contiguous arrays, so filters and
+  // aggregates can loop over values instead of calling the reader per
+  // cell. string and bytes values point into the decompressed column
+  // buffer which is kept alive through the reader
+  class column_vector final
+  {
+  public:
+    typedef util::value_type_reader::sptr  reader_sptr;
+
+  private:
+    reader_sptr             reader_;
+    uint32_t                kind_;
+    size_t                  n_rows_;
+    size_t                  n_nulls_;
+    // raw value storage, 8 byte aligned for all fixed width types
+    std::vector<uint64_t>   values_;
+    std::vector<char *>     ptrs_;
+    std::vector<size_t>     lens_;
+    std::vector<uint64_t>   null_bits_;
+    
+    template <typename T, typename READ>
+    void load_fixed(READ read);
+    
+    template <typename READ>
+    void load_ptrs(READ read);
+    
+    void load_nulls(size_t first);
+
+  public:
+    column_vector();
+    
+    // decodes everything that is left in rdr. the vectors keep their
+    // capacity between blocks. returns false if rdr has no data
+    bool load(reader_sptr rdr);
+    void clear();
+    
+    // interface::pb::Kind of the values
+    inline uint32_t kind() const { return kind_; }
+    inline size_t size() const { return n_rows_; }
+    inline size_t n_nulls() const { return n_nulls_; }
+    
+    // bit (i%64) of word (i/64) is set for null values
+    inline const uint64_t * null_bitmap() const { return null_bits_.data(); }
+    
+    inline bool is_null(size_t i) const
+    {
+      return ((null_bits_[i>>6] >> (i&63)) & 1) != 0;
+    }
+    
+    // int32_t, int64_t, uint32_t, uint64_t, double, float or bool
+    // matching kind(). the values of null rows are not meaningful
+    template <typename T>
+    inline const T * values() const
+    {
+      return reinterpret_cast<const T *>(values_.data());
+    }
+    
+    // string and bytes columns
+    inline char * const * ptrs() const { return ptrs_.data(); }
+    inline const size_t * lens() const { return lens_.data(); }
+  };
+
+  typedef std::vector<column_vector> column_batch;
+
+}}
@@ -8,6 +8,7 @@
 #include <engine/feeder.hh>
 #include <logger.hh>
 #include <functional>
+#include <algorithm>
 
 namespace virtdb { namespace engine {
 
@@ -30,6 +31,11 @@ namespace virtdb { namespace engine {
   : collector_(cll),
     act_block_{-1},
     next_block_timeout_ms_{30000},
+    read_ahead_{2},
+    prefetched_block_{-1},
+    n_consumer_stalls_{0},
+    consumer_stall_usec_{0},
+    n_producer_stalls_{0},
     state_machine_{std::to_string((uint64_t)this),
       [this](uint16_t seqno,
          const std::string & desc,
@@ -377,7 +383,7 @@ namespace virtdb { namespace engine {
       action::sptr sched(new action{[this](uint16_t seqno,
                                           transition & trans,
                                           state_machine & sm){ 
-        collector_->background_process(act_block_+1);
+        prefetch();
       },"SCHEDULE BACKGROUND DECOMPRESS"});
       action::sptr erase(new action{[this](uint16_t seqno,
                                            transition & trans,
@@ -430,19 +436,106 @@ namespace virtdb { namespace engine {
   
   feeder::~feeder() {}
   
+  void
+  feeder::prefetch()
+  {
+    int64_t last  = collector_->last_block_id();
+    int64_t until = act_block_ + (int64_t)read_ahead_.load();
+    if( last >= 0 && until > last )
+      until = last;
+    
+    // blocks scheduled earlier don't need another completion callback
+    int64_t from = std::max(prefetched_block_, act_block_) + 1;
+    for( int64_t b=from; b<=until; ++b )
+      collector_->background_process(b);
+    
+    if( until > prefetched_block_ )
+      prefetched_block_ = until;
+  }
+  
+  uint64_t
+  feeder::n_consumer_stalls() const
+  {
+    return n_consumer_stalls_.load();
+  }
+  
+  uint64_t
+  feeder::consumer_stall_usec() const
+  {
+    return consumer_stall_usec_.load();
+  }
+  
+  uint64_t
+  feeder::n_producer_stalls() const
+  {
+    return n_producer_stalls_.load();
+  }
+  
   const util::relative_time &
   feeder::timer() const
   {
     return timer_;
   }
   
+  bool
+  feeder::next_batch(column_batch & batch)
+  {
+    if( !fetch_next() )
+      return false;
+    
+    batch.resize(readers_.size());
+    for( size_t i=0; i<readers_.size(); ++i )
+    {
+      if( !batch[i].load(readers_[i]) )
+      {
+        LOG_ERROR("no data for column" << V_(act_block_) << V_(i));
+        return false;
+      }
+    }
+    return true;
+  }
+  
   bool
   feeder::fetch_next()
   {
     auto prev_state = last_state_;
+    
+    bool stalled = false;
+    if( prev_state == ST_FETCH_FIRST_ || prev_state == ST_IN_PROGRESS_ )
+    {
+      int64_t ahead = act_block_ + (int64_t)read_ahead_.load();
+      int64_t last  = collector_->last_block_id();
+      if( !collector_->ready(act_block_+1) )
+      {
+        stalled = true;
+      }
+      else if( read_ahead_ > 0 &&
+               (last < 0 || ahead <= last) &&
+               collector_->ready(ahead) )
+      {
+        ++n_producer_stalls_;
+      }
+    }
+    
+    util::relative_time rt;
     state_machine_.enqueue(EV_NEED_DATA_);
     last_state_ = state_machine_.run(prev_state);
     
+    if( stalled )
+    {
+      ++n_consumer_stalls_;
+      consumer_stall_usec_ += rt.get_usec();
+    }
+    
+    if( last_state_ == ST_COMPLETE_ )
+    {
+      LOG_TRACE("feeder stalls" <<
+                V_(n_consumer_stalls_.load()) <<
+                V_(consumer_stall_usec_.load()) <<
+                V_(n_producer_stalls_.load()) <<
+                V_(collector_->n_backpressure_waits()));
+    }
+    
     switch( last_state_ )
     {
       case ST_COMPLETE_:
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <engine/collector.hh>
+#include <engine/column_batch.hh>
 #include <util/value_type_reader.hh>
 #include <util/timer_service.hh>
 #include <util/relative_time.hh>
@@ -25,10 +26,16 @@ namespace virtdb { namespace engine {
     util::timer_service          timer_svc_;
     util::relative_time          timer_;
     std::atomic<uint64_t>        next_block_timeout_ms_;
+    std::atomic<uint64_t>        read_ahead_;
+    int64_t                      prefetched_block_;
+    std::atomic<uint64_t>        n_consumer_stalls_;
+    std::atomic<uint64_t>        consumer_stall_usec_;
+    std::atomic<uint64_t>        n_producer_stalls_;
     fsm::state_machine           state_machine_;
     uint16_t                     last_state_;
     
     vtr::status next_block();
+    void prefetch();
     
     void trace(uint16_t seqno,
                const std::string & desc,
@@ -111,6 +118,11 @@ namespace virtdb { namespace engine {
     
     bool fetch_next();
     
+    // fetches the next block like fetch_next() and decodes all of its
+    // columns into batch. the block's readers are consumed, so this is
+    // not to be mixed with the read_* calls on the same block
+    bool next_batch(column_batch & batch);
+    
     inline void
     next_block_timeout_ms(uint64_t val)
     {
@@ -123,6 +135,28 @@ namespace virtdb { namespace engine {
       return next_block_timeout_ms_.load();
     }
     
+    // number of blocks after the actual one that are decompressed in
+    // the background, so they are ready when the consumer gets there
+    inline void
+    read_ahead(uint64_t val)
+    {
+      read_ahead_ = val;
+    }
+    
+    inline uint64_t
+    read_ahead() const
+    {
+      return read_ahead_.load();
+    }
+    
+    // fetch_next() had to wait for the next block
+    uint64_t n_consumer_stalls() const;
+    uint64_t consumer_stall_usec() const;
+    
+    // fetch_next() found the whole read-ahead window ready, so data
+    // arrived faster than it was consumed
+    uint64_t n_producer_stalls() const;
+    
     const util::relative_time & timer() const;
   };
   
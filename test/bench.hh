@@ -0,0 +1,66 @@
+#pragma once
+
+#include <util/relative_time.hh>
+#include <functional>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace virtdb { namespace bench {
+
+  // one benchmark run. the benchmark function prepares its input, then
+  // hands the measured part to run() together with the number of rows
+  // and bytes a single iteration processes
+  class state
+  {
+  public:
+    typedef std::function<void()>  body;
+
+  private:
+    size_t                 iterations_;
+    std::vector<uint64_t>  usecs_;
+    uint64_t               rows_;
+    uint64_t               bytes_;
+
+  public:
+    state(size_t iterations);
+    
+    void run(uint64_t rows,
+             uint64_t bytes,
+             body b);
+    
+    size_t iterations() const;
+    uint64_t rows() const;
+    uint64_t bytes() const;
+    uint64_t best_usec() const;
+    uint64_t median_usec() const;
+
+  private:
+    state() = delete;
+  };
+
+  typedef std::function<void(state &)>  bench_function;
+
+  class registry
+  {
+  public:
+    static bool add(const char * name,
+                    bench_function fun);
+    
+    // runs the benchmarks whose name contains filter and prints the
+    // results. returns the number of benchmarks that didn't report
+    static int run(const std::string & filter,
+                   size_t iterations);
+  };
+
+}}
+
+// macro helpers for a unique registration variable
+#define BENCH_MACRO_CONCAT(A,B) __BENCH__##A##B
+#define BENCH_MACRO_CONCAT2(A,B) BENCH_MACRO_CONCAT(A,B)
+
+#define BENCHMARK_(NAME) \
+  static void NAME(virtdb::bench::state &); \
+  static bool BENCH_MACRO_CONCAT2(NAME,__LINE__) = \
+    virtdb::bench::registry::add(#NAME, &NAME); \
+  static void NAME(virtdb::bench::state & st)
@@ -0,0 +1,162 @@
+#include "bench.hh"
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <map>
+#include <cstring>
+#include <cstdlib>
+
+namespace virtdb { namespace bench {
+
+  namespace
+  {
+    typedef std::map<std::string, bench_function> bench_map;
+    
+    bench_map & benchmarks()
+    {
+      // function local so registration works from any static initializer
+      static bench_map instance;
+      return instance;
+    }
+  }
+
+  state::state(size_t iterations)
+  : iterations_{iterations ? iterations : 1},
+    rows_{0},
+    bytes_{0}
+  {
+  }
+
+  void
+  state::run(uint64_t rows,
+             uint64_t bytes,
+             body b)
+  {
+    rows_  = rows;
+    bytes_ = bytes;
+    usecs_.clear();
+    
+    // warm up caches and allocators, not measured
+    b();
+    
+    for( size_t i=0; i<iterations_; ++i )
+    {
+      util::relative_time rt;
+      b();
+      usecs_.push_back(std::max(rt.get_usec(), static_cast<uint64_t>(1)));
+    }
+  }
+
+  size_t
+  state::iterations() const
+  {
+    return iterations_;
+  }
+
+  uint64_t
+  state::rows() const
+  {
+    return rows_;
+  }
+
+  uint64_t
+  state::bytes() const
+  {
+    return bytes_;
+  }
+
+  uint64_t
+  state::best_usec() const
+  {
+    if( usecs_.empty() ) return 0;
+    return *std::min_element(usecs_.begin(), usecs_.end());
+  }
+
+  uint64_t
+  state::median_usec() const
+  {
+    if( usecs_.empty() ) return 0;
+    std::vector<uint64_t> tmp{usecs_};
+    std::sort(tmp.begin(), tmp.end());
+    return tmp[tmp.size()/2];
+  }
+
+  bool
+  registry::add(const char * name,
+                bench_function fun)
+  {
+    benchmarks()[name] = fun;
+    return true;
+  }
+
+  int
+  registry::run(const std::string & filter,
+                size_t iterations)
+  {
+    int failed = 0;
+    
+    std::cout << std::left << std::setw(40) << "benchmark"
+              << std::right
+              << std::setw(12) << "median ms"
+              << std::setw(12) << "best ms"
+              << std::setw(16) << "rows/s"
+              << std::setw(12) << "MB/s" << "\n";
+    
+    for( auto const & b : benchmarks() )
+    {
+      if( !filter.empty() && b.first.find(filter) == std::string::npos )
+        continue;
+      
+      state st{iterations};
+      b.second(st);
+      
+      if( !st.best_usec() )
+      {
+        std::cout << b.first << ": no measurement\n";
+        ++failed;
+        continue;
+      }
+      
+      // throughput is reported for the best iteration, the median shows
+      // how noisy the run was
+      double best_sec = st.best_usec() / 1000000.0;
+      std::cout << std::left << std::setw(40) << b.first
+                << std::right << std::fixed << std::setprecision(3)
+                << std::setw(12) << (st.median_usec() / 1000.0)
+                << std::setw(12) << (st.best_usec() / 1000.0)
+                << std::setprecision(0)
+                << std::setw(16) << (st.rows() / best_sec)
+                << std::setprecision(1)
+                << std::setw(12) << (st.bytes() / best_sec / 1048576.0) << "\n";
+    }
+    return failed;
+  }
+
+}}
+
+int main(int argc, char **argv)
+{
+  using namespace virtdb::bench;
+
+  std::string filter;
+  size_t iterations = 5;
+
+  for( int i=1; i<argc; ++i )
+  {
+    if( ::strncmp(argv[i], "--filter=", 9) == 0 )
+    {
+      filter = argv[i]+9;
+    }
+    else if( ::strncmp(argv[i], "--iterations=", 13) == 0 )
+    {
+      iterations = ::atoi(argv[i]+13);
+    }
+    else
+    {
+      std::cerr << "usage: " << argv[0] << " [--filter=<name part>] [--iterations=<n>]\n";
+      return 1;
+    }
+  }
+
+  return registry::run(filter, iterations);
+}
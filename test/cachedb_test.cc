@@ -3,8 +3,12 @@
 #include <cachedb/hash_util.hh>
 #include <cachedb/column_data.hh>
 #include <cachedb/query_table_log.hh>
+#include <cachedb/query_table_block.hh>
+#include <cachedb/query_column_block.hh>
 
 #include <cachedb/db.hh>
+#include <cachedb/writer.hh>
+#include <cachedb/evictor.hh>
 #include <memory>
 #include <iostream>
 #include <set>
@@ -58,6 +62,454 @@ TEST_F(CachedbDBTest, QueryTableLogTest)
   system("rm -Rf /tmp/CachedbDBTestQueryTableLogTest");
 }
 
+TEST_F(CachedbDBTest, FetchMany)
+{
+  {
+    const size_t n_items = 3000;
+    query_table_log   dl;
+    db                cache;
+    
+    dl.default_columns();
+    db::storeable_ptr_vec_t v{&dl};
+    EXPECT_TRUE(cache.init("/tmp/CachedbDBTestFetchMany", v));
+    
+    for( size_t i=0; i<n_items; ++i )
+    {
+      query_table_log item;
+      item.key("0123456789abcdef-" + std::to_string(i));
+      item.data("data-" + std::to_string(i));
+      item.n_columns(i);
+      EXPECT_EQ(cache.set(item), 2);
+    }
+    
+    // every second key is missing, spans more than one MultiGet batch
+    std::vector<std::unique_ptr<query_table_log>> items;
+    db::storeable_ptr_vec_t ptrs;
+    for( size_t i=0; i<n_items; ++i )
+    {
+      items.emplace_back(new query_table_log);
+      items.back()->key("0123456789abcdef-" + std::to_string(i*2));
+      ptrs.push_back(items.back().get());
+    }
+    
+    std::vector<size_t> found;
+    // the first half is there with two columns each
+    EXPECT_EQ(cache.fetch_many(ptrs, &found), (n_items/2)*2);
+    ASSERT_EQ(found.size(), n_items);
+    for( size_t i=0; i<n_items; ++i )
+    {
+      if( i*2 < n_items )
+      {
+        EXPECT_EQ(found[i], 2);
+        EXPECT_EQ(items[i]->data(), "data-" + std::to_string(i*2));
+        EXPECT_EQ(items[i]->n_columns(), i*2);
+      }
+      else
+      {
+        EXPECT_EQ(found[i], 0);
+        EXPECT_TRUE(items[i]->data().empty());
+      }
+    }
+  }
+  system("rm -Rf /tmp/CachedbDBTestFetchMany");
+}
+
+TEST_F(CachedbDBTest, ExistsMany)
+{
+  {
+    const size_t n_items = 2000;
+    query_table_log   dl;
+    db                cache;
+    
+    dl.default_columns();
+    db::storeable_ptr_vec_t v{&dl};
+    EXPECT_TRUE(cache.init("/tmp/CachedbDBTestExistsMany", v));
+    
+    for( size_t i=0; i<n_items; ++i )
+    {
+      query_table_log item;
+      item.key("0123456789abcdef-" + std::to_string(i));
+      item.n_columns(i);
+      EXPECT_EQ(cache.set(item), 1);
+      // half of them are flushed to the SST files
+      if( i == n_items/2 ) EXPECT_TRUE(cache.flush(true));
+    }
+    
+    std::vector<std::unique_ptr<query_table_log>> items;
+    db::storeable_ptr_vec_t ptrs;
+    for( size_t i=0; i<n_items; ++i )
+    {
+      items.emplace_back(new query_table_log);
+      // odd keys don't exist, t1_nblocks is never stored
+      items.back()->key("0123456789abcdef-" + std::to_string((i%2) ? i+n_items : i));
+      items.back()->column(query_table_log::qn_n_columns);
+      items.back()->column(query_table_log::qn_t1_nblocks);
+      ptrs.push_back(items.back().get());
+    }
+    
+    std::vector<size_t> found;
+    EXPECT_EQ(cache.exists_many(ptrs, &found), n_items/2);
+    ASSERT_EQ(found.size(), n_items);
+    for( size_t i=0; i<n_items; ++i )
+    {
+      EXPECT_EQ(found[i], (i%2) ? 0 : 1);
+      EXPECT_EQ(cache.exists(*(items[i])), found[i]);
+    }
+  }
+  system("rm -Rf /tmp/CachedbDBTestExistsMany");
+}
+
+TEST_F(CachedbDBTest, WriterGroupCommit)
+{
+  {
+    const size_t n_items = 1000;
+    query_table_log   dl;
+    db                cache;
+    
+    dl.default_columns();
+    db::storeable_ptr_vec_t v{&dl};
+    EXPECT_TRUE(cache.init("/tmp/CachedbDBTestWriter", v));
+    
+    for( bool disable_wal : { false, true } )
+    {
+      writer::options opts;
+      opts.max_bytes_     = 16*1024;
+      opts.max_delay_ms_  = 60000;
+      opts.disable_wal_   = disable_wal;
+      writer::stats st;
+      {
+        writer wr{cache, opts};
+        for( size_t i=0; i<n_items; ++i )
+        {
+          query_table_log item;
+          item.key("0123456789abcdef-" + std::to_string(i) + (disable_wal ? "-nowal" : ""));
+          item.data(std::string(100, 'x'));
+          item.n_columns(i);
+          EXPECT_EQ(wr.add(item), 2);
+        }
+        EXPECT_GT(wr.pending_items(), 0);
+        EXPECT_LT(wr.pending_bytes(), opts.max_bytes_);
+        st = wr.get_stats();
+        // the rest is committed by the destructor
+      }
+      
+      EXPECT_EQ(st.n_items_, n_items);
+      EXPECT_EQ(st.n_columns_, 2*n_items);
+      EXPECT_GT(st.n_commits_, 1);
+      EXPECT_LT(st.n_commits_, n_items/10);
+      EXPECT_EQ(st.n_failed_commits_, 0);
+      EXPECT_GT(st.write_amplification(), 0.0);
+      if( disable_wal ) EXPECT_EQ(st.wal_bytes_, 0);
+      else              EXPECT_EQ(st.wal_bytes_, st.batch_bytes_);
+      
+      for( size_t i=0; i<n_items; i+=97 )
+      {
+        query_table_log item;
+        item.key("0123456789abcdef-" + std::to_string(i) + (disable_wal ? "-nowal" : ""));
+        EXPECT_EQ(cache.fetch(item), 2);
+        EXPECT_EQ(item.n_columns(), i);
+      }
+    }
+  }
+  system("rm -Rf /tmp/CachedbDBTestWriter");
+}
+
+TEST_F(CachedbDBTest, Remove)
+{
+  {
+    query_table_log   dl;
+    db                cache;
+    
+    dl.default_columns();
+    db::storeable_ptr_vec_t v{&dl};
+    EXPECT_TRUE(cache.init("/tmp/CachedbDBTestRemove", v));
+    
+    query_table_log item;
+    item.key("0123456789abcdef-remove");
+    item.data("Hello");
+    item.n_columns(10);
+    item.t0_nblocks(20);
+    EXPECT_EQ(cache.set(item), 3);
+    
+    // only the listed column goes
+    query_table_log one;
+    one.key(item.key());
+    one.column(query_table_log::qn_n_columns);
+    EXPECT_EQ(cache.remove(one), 1);
+    
+    query_table_log check;
+    check.key(item.key());
+    EXPECT_EQ(cache.fetch(check), 2);
+    EXPECT_EQ(check.data(), "Hello");
+    EXPECT_EQ(check.n_columns(), 0);
+    
+    // an empty column set removes from all families of the class
+    query_table_log all;
+    all.key(item.key());
+    EXPECT_EQ(cache.remove(all), 6);
+    
+    query_table_log check2;
+    check2.key(item.key());
+    EXPECT_EQ(cache.fetch(check2), 0);
+  }
+  system("rm -Rf /tmp/CachedbDBTestRemove");
+}
+
+TEST_F(CachedbDBTest, RemovePrefix)
+{
+  {
+    const size_t n_items = 3000;
+    query_table_block   tb;
+    db                  cache;
+    
+    tb.default_columns();
+    db::storeable_ptr_vec_t v{&tb};
+    EXPECT_TRUE(cache.init("/tmp/CachedbDBTestRemovePrefix", v));
+    
+    auto now = std::chrono::system_clock::now();
+    for( auto const & hash : { "00000000000000a1", "00000000000000b2" } )
+    {
+      for( size_t i=0; i<n_items; ++i )
+      {
+        query_table_block item;
+        item.key(hash, now, i);
+        item.n_columns(i);
+        item.is_complete(true);
+        EXPECT_EQ(cache.set(item), 2);
+      }
+    }
+    EXPECT_TRUE(cache.flush(true));
+    
+    EXPECT_EQ(cache.remove_prefix(query_table_block::clazz_static(), ""), 0);
+    // spans more than one delete batch, counted in both families the
+    // items were set in
+    EXPECT_EQ(cache.remove_prefix(query_table_block::clazz_static(), "00000000000000a1 "), 2*n_items);
+    EXPECT_TRUE(cache.compact(query_table_block::clazz_static()));
+    
+    auto count = [](const std::string &, const storeable::data_t &) { return true; };
+    EXPECT_EQ(cache.scan(query_table_block::qn_n_columns, "00000000000000a1", count), 0);
+    EXPECT_EQ(cache.scan(query_table_block::qn_n_columns, "00000000000000b2", count), n_items);
+    EXPECT_EQ(cache.scan(query_table_block::qn_is_complete, "", count), n_items);
+    EXPECT_GT(cache.disk_usage(), 0);
+  }
+  system("rm -Rf /tmp/CachedbDBTestRemovePrefix");
+}
+
+TEST_F(CachedbDBTest, Evict)
+{
+  {
+    query_table_log     dl;
+    query_table_block   tb;
+    query_column_block  cb;
+    column_data         cd;
+    db                  cache;
+    
+    dl.default_columns();
+    tb.default_columns();
+    cb.default_columns();
+    cd.default_columns();
+    db::storeable_ptr_vec_t v{&dl, &tb, &cb, &cd};
+    EXPECT_TRUE(cache.init("/tmp/CachedbDBTestEvict", v));
+    
+    auto now = std::chrono::system_clock::now();
+    auto old = now - std::chrono::hours(2);
+    
+    query_table_log old_log;
+    old_log.key("00000000000000a1");
+    old_log.t0_completed_at(old);
+    EXPECT_EQ(cache.set(old_log), 1);
+    
+    // the later completion time counts
+    query_table_log new_log;
+    new_log.key("00000000000000b2");
+    new_log.t0_completed_at(now - std::chrono::hours(3));
+    new_log.t1_completed_at(now);
+    EXPECT_EQ(cache.set(new_log), 2);
+    
+    for( size_t i=0; i<3; ++i )
+    {
+      query_table_block old_block;
+      old_block.key(old_log.key(), old, i);
+      old_block.n_columns(1);
+      EXPECT_EQ(cache.set(old_block), 1);
+      
+      query_table_block new_block;
+      new_block.key(new_log.key(), now, i);
+      new_block.n_columns(1);
+      EXPECT_EQ(cache.set(new_block), 1);
+    }
+    
+    // d-shared is still referred to by a new block
+    std::vector<std::pair<std::chrono::system_clock::time_point, std::string>> blocks{
+      { old, "d-old" }, { old, "d-shared" }, { now, "d-shared" }, { now, "d-new" } };
+    std::vector<std::string> block_keys;
+    for( size_t i=0; i<blocks.size(); ++i )
+    {
+      query_column_block item;
+      item.key("00000000000000c3", blocks[i].first, i);
+      item.column_hash(blocks[i].second);
+      EXPECT_EQ(cache.set(item), 1);
+      block_keys.push_back(item.key());
+    }
+    
+    for( auto const & h : { "d-old", "d-shared", "d-new" } )
+    {
+      column_data item;
+      item.key(h);
+      item.property(column_data::qn_data, "x");
+      EXPECT_EQ(cache.set(item), 1);
+    }
+    
+    auto count = [](const std::string &, const storeable::data_t &) { return true; };
+    
+    // only the SST files count as disk usage
+    EXPECT_TRUE(cache.flush(true));
+    
+    {
+      evictor::options opts;
+      opts.max_age_sec_ = 3600;
+      evictor ev{cache, opts};
+      EXPECT_EQ(ev.run(), 1);
+      
+      auto st = ev.get_stats();
+      EXPECT_EQ(st.n_runs_, 1);
+      EXPECT_EQ(st.n_queries_, 1);
+      EXPECT_EQ(st.n_column_blocks_, 2);
+      EXPECT_EQ(st.n_column_data_, 1);
+      EXPECT_GT(st.n_deletes_, 0);
+      EXPECT_GT(st.disk_bytes_before_, 0);
+    }
+    
+    query_table_log check_old;
+    check_old.key(old_log.key());
+    EXPECT_EQ(cache.fetch(check_old), 0);
+    query_table_log check_new;
+    check_new.key(new_log.key());
+    EXPECT_EQ(cache.fetch(check_new), 2);
+    
+    EXPECT_EQ(cache.scan(query_table_block::qn_n_columns, "00000000000000a1", count), 0);
+    EXPECT_EQ(cache.scan(query_table_block::qn_n_columns, "00000000000000b2", count), 3);
+    EXPECT_EQ(cache.scan(query_column_block::qn_column_hash, "", count), 2);
+    for( size_t i=0; i<block_keys.size(); ++i )
+    {
+      query_column_block item;
+      static_cast<storeable &>(item).key(block_keys[i]);
+      item.column(query_column_block::qn_column_hash);
+      EXPECT_EQ(cache.exists(item), (i < 2) ? 0 : 1);
+    }
+    EXPECT_EQ(cache.scan(column_data::qn_data, "", count), 2);
+    EXPECT_EQ(cache.scan(column_data::qn_data, "d-old", count), 0);
+    
+    // over the disk budget the remaining queries go too
+    {
+      evictor::options opts;
+      opts.max_age_sec_     = 0;
+      opts.max_disk_bytes_  = 1;
+      evictor ev{cache, opts};
+      EXPECT_EQ(ev.run(), 1);
+      
+      auto st = ev.get_stats();
+      EXPECT_GT(st.disk_bytes_before_, opts.max_disk_bytes_);
+      EXPECT_LT(st.disk_bytes_after_, st.disk_bytes_before_);
+    }
+    
+    query_table_log check_new2;
+    check_new2.key(new_log.key());
+    EXPECT_EQ(cache.fetch(check_new2), 0);
+    EXPECT_EQ(cache.scan(query_table_block::qn_n_columns, "", count), 0);
+    EXPECT_EQ(cache.scan(query_column_block::qn_column_hash, "", count), 0);
+    EXPECT_EQ(cache.scan(column_data::qn_data, "", count), 0);
+  }
+  system("rm -Rf /tmp/CachedbDBTestEvict");
+}
+
+TEST_F(CachedbDBTest, EvictStraddle)
+{
+  {
+    query_table_log     dl;
+    query_table_block   tb;
+    query_column_block  cb;
+    column_data         cd;
+    db                  cache;
+    
+    dl.default_columns();
+    tb.default_columns();
+    cb.default_columns();
+    cd.default_columns();
+    db::storeable_ptr_vec_t v{&dl, &tb, &cb, &cd};
+    EXPECT_TRUE(cache.init("/tmp/CachedbDBTestEvictStraddle", v));
+    
+    auto now = std::chrono::system_clock::now();
+    
+    // started before the cutoff and completed after it, so it stays and
+    // its blocks are older than the cutoff
+    struct query
+    {
+      const char *  hash_;
+      int           started_h_;
+      int           completed_min_;
+      const char *  data_;
+    };
+    std::vector<query> queries{
+      { "00000000000000a1", 3, 150, "d-evicted" },
+      { "00000000000000b2", 2,  50, "d-straddle" } };
+    
+    std::vector<std::string> block_keys;
+    for( auto const & q : queries )
+    {
+      auto started = now - std::chrono::hours(q.started_h_);
+      
+      query_table_log log;
+      log.key(q.hash_);
+      log.t0_completed_at(now - std::chrono::minutes(q.completed_min_));
+      EXPECT_EQ(cache.set(log), 1);
+      
+      query_table_block tblock;
+      tblock.key(q.hash_, started, 0);
+      tblock.n_columns(1);
+      EXPECT_EQ(cache.set(tblock), 1);
+      
+      // the column hash is not derived from the table hash
+      query_column_block cblock;
+      cblock.key(std::string("c3")+q.hash_, started, 0);
+      cblock.column_hash(q.data_);
+      EXPECT_EQ(cache.set(cblock), 1);
+      block_keys.push_back(cblock.key());
+      
+      column_data data;
+      data.key(q.data_);
+      data.property(column_data::qn_data, "x");
+      EXPECT_EQ(cache.set(data), 1);
+    }
+    
+    auto count = [](const std::string &, const storeable::data_t &) { return true; };
+    
+    {
+      evictor::options opts;
+      opts.max_age_sec_ = 3600;
+      evictor ev{cache, opts};
+      EXPECT_EQ(ev.run(), 1);
+      
+      auto st = ev.get_stats();
+      EXPECT_EQ(st.n_column_blocks_, 1);
+      EXPECT_EQ(st.n_column_data_, 1);
+    }
+    
+    EXPECT_EQ(cache.scan(query_table_block::qn_n_columns, "00000000000000a1", count), 0);
+    EXPECT_EQ(cache.scan(query_table_block::qn_n_columns, "00000000000000b2", count), 1);
+    for( size_t i=0; i<block_keys.size(); ++i )
+    {
+      query_column_block item;
+      static_cast<storeable &>(item).key(block_keys[i]);
+      item.column(query_column_block::qn_column_hash);
+      EXPECT_EQ(cache.exists(item), i);
+    }
+    EXPECT_EQ(cache.scan(column_data::qn_data, "d-evicted", count), 0);
+    EXPECT_EQ(cache.scan(column_data::qn_data, "d-straddle", count), 1);
+  }
+  system("rm -Rf /tmp/CachedbDBTestEvictStraddle");
+}
+
 TEST_F(CachedbStoreableTest, ConvertTimeAndDate)
 {
   auto now = std::chrono::system_clock::now();
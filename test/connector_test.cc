@@ -8,11 +8,14 @@
 #include <connector/cert_store_client.hh>
 #include <connector/srcsys_credential_client.hh>
 #include <connector/ip_discovery_client.hh>
+#include <connector/column_client.hh>
 #include <connector/monitoring_server.hh>
 #include <connector/monitoring_client.hh>
 #include <test/cfgsvc_mock.hh>
 #include <atomic>
 #include <thread>
+#include <map>
+#include <set>
 #include <util/barrier.hh>
 #include <util/exception.hh>
 
@@ -925,6 +928,11 @@ TEST_F(ConnConfigTest, CheckSubChannel)
   
   EXPECT_EQ(on_cfg.wait_for(std::chrono::seconds(10)), std::future_status::ready);
   EXPECT_EQ(cnt.load(), 1);
+  
+  auto st = cfg_clnt.get_sub_stats();
+  EXPECT_GE(st.n_frames_, 1);
+  EXPECT_GT(st.n_bytes_, 0);
+  EXPECT_EQ(st.n_parse_errors_, 0);
 }
 
 TEST_F(ConnServerBaseTest, ConstuctHostSet)
@@ -1577,6 +1585,278 @@ TEST_F(ConnIpDiscoveryTest, SimpleConnect)
   EXPECT_FALSE(res.empty());
 }
 
+void
+ConnColumnTest::register_column_ep(endpoint_client & ep_clnt,
+                                   const std::string & name,
+                                   const std::string & addr)
+{
+  pb::EndpointData ep_data;
+  ep_data.set_name(name);
+  ep_data.set_svctype(pb::ServiceType::COLUMN);
+  ep_data.set_validforms(DEFAULT_ENDPOINT_EXPIRY_MS);
+  auto conn = ep_data.add_connections();
+  conn->set_type(pb::ConnectionType::PUB_SUB);
+  *(conn->add_address()) = addr;
+  ep_clnt.register_endpoint(ep_data);
+}
+
+namespace {
+  
+  // publishes hand made frames, so the tests decide what the
+  // column_client receives
+  struct raw_column_pub
+  {
+    zmq::context_t  ctx_;
+    zmq::socket_t   socket_;
+    std::string     addr_;
+    
+    raw_column_pub()
+    : ctx_(1),
+      socket_(ctx_, ZMQ_PUB)
+    {
+      socket_.bind("tcp://127.0.0.1:*");
+      char buf[256];
+      size_t len = sizeof(buf);
+      socket_.getsockopt(ZMQ_LAST_ENDPOINT, buf, &len);
+      addr_ = buf;
+    }
+    
+    void send(const std::string & subscription,
+              const std::string & data)
+    {
+      socket_.send(subscription.c_str(), subscription.size(), ZMQ_SNDMORE);
+      socket_.send(data.c_str(), data.size());
+    }
+    
+    static std::string column(const std::string & query_id,
+                              uint64_t seq_no)
+    {
+      pb::Column col;
+      col.set_queryid(query_id);
+      col.set_name("col");
+      col.set_seqno(seq_no);
+      auto data = col.mutable_data();
+      data->set_type(pb::Kind::INT64);
+      for( int64_t i=0; i<100; ++i )
+        data->add_int64value(i);
+      return col.SerializeAsString();
+    }
+    
+    // the subscription reaches the PUB socket some time after the
+    // connect, until then the frames are dropped
+    bool wait_subscribed(std::function<bool()> arrived)
+    {
+      for( int i=0; i<100; ++i )
+      {
+        send("probe ", column("probe", 0));
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        if( arrived() ) return true;
+      }
+      return false;
+    }
+  };
+}
+
+TEST_F(ConnColumnTest, LaneOrder)
+{
+  const char * name = "ConnColumnTest-LaneOrder";
+  const size_t n_queries  = 10;
+  const size_t n_columns  = 500;
+  
+  endpoint_client ep_clnt(cctx_, global_mock_ep, name);
+  raw_column_pub pub;
+  column_client col_clnt(cctx_, ep_clnt, name, 4);
+  
+  std::mutex mtx;
+  std::map<std::string, uint64_t> next_seq;
+  std::map<std::string, std::set<std::thread::id>> threads;
+  std::atomic<size_t> n_probes{0};
+  size_t n_received = 0;
+  size_t n_out_of_order = 0;
+  std::promise<void> done_promise;
+  std::future<void> on_done{done_promise.get_future()};
+  
+  col_clnt.watch("*", [&](const std::string & provider_name,
+                          const std::string & channel,
+                          const std::string & subscription,
+                          std::shared_ptr<pb::Column> col)
+  {
+    if( col->queryid() == "probe" )
+    {
+      ++n_probes;
+      return;
+    }
+    std::lock_guard<std::mutex> l(mtx);
+    if( col->seqno() != next_seq[channel] )
+      ++n_out_of_order;
+    next_seq[channel] = col->seqno()+1;
+    threads[channel].insert(std::this_thread::get_id());
+    if( ++n_received == n_queries*n_columns )
+      done_promise.set_value();
+  });
+  
+  register_column_ep(ep_clnt, name, pub.addr_);
+  EXPECT_TRUE(col_clnt.wait_valid(10000));
+  ASSERT_TRUE(pub.wait_subscribed([&n_probes]() { return n_probes > 0; }));
+  
+  // the queries interleave on the wire, like concurrent queries do
+  for( uint64_t c=0; c<n_columns; ++c )
+  {
+    for( size_t q=0; q<n_queries; ++q )
+    {
+      std::string query_id{std::string("query-")+std::to_string(q)};
+      pub.send(query_id+" ", raw_column_pub::column(query_id, c));
+    }
+  }
+  
+  ASSERT_EQ(on_done.wait_for(std::chrono::seconds(20)), std::future_status::ready);
+  
+  std::set<std::thread::id> all_threads;
+  {
+    std::lock_guard<std::mutex> l(mtx);
+    EXPECT_EQ(n_out_of_order, 0);
+    EXPECT_EQ(next_seq.size(), n_queries);
+    for( auto const & t : threads )
+    {
+      // a subscription stays on its lane
+      EXPECT_EQ(t.second.size(), 1) << t.first;
+      all_threads.insert(t.second.begin(), t.second.end());
+    }
+  }
+  // and the subscriptions are spread over the lanes
+  EXPECT_GT(all_threads.size(), 1);
+  
+  auto st = col_clnt.get_sub_stats();
+  EXPECT_GE(st.n_frames_, n_queries*n_columns);
+  EXPECT_GT(st.decode_usec_, 0);
+  EXPECT_EQ(st.n_parse_errors_, 0);
+  
+  col_clnt.remove_watches();
+  col_clnt.cleanup();
+}
+
+TEST_F(ConnColumnTest, SlowSubscription)
+{
+  const char * name = "ConnColumnTest-SlowSubscription";
+  const size_t n_lanes    = 4;
+  const size_t n_columns  = 3000;
+  
+  endpoint_client ep_clnt(cctx_, global_mock_ep, name);
+  raw_column_pub pub;
+  column_client col_clnt(cctx_, ep_clnt, name, n_lanes);
+  
+  // the two queries must be decoded on different lanes
+  auto lane = [n_lanes](const std::string & sub) {
+    return std::hash<std::string>()(sub) % n_lanes;
+  };
+  std::string slow_id{"slow"};
+  std::string fast_id{"fast"};
+  for( int i=0; lane(fast_id+" ") == lane(slow_id+" "); ++i )
+    fast_id = std::string("fast-")+std::to_string(i);
+  
+  std::promise<void> release_promise;
+  std::shared_future<void> on_release{release_promise.get_future().share()};
+  std::promise<void> fast_promise;
+  std::future<void> on_fast{fast_promise.get_future()};
+  std::atomic<size_t> n_probes{0};
+  std::atomic<size_t> n_slow{0};
+  std::atomic<size_t> n_fast{0};
+  
+  col_clnt.watch("*", [&](const std::string & provider_name,
+                          const std::string & channel,
+                          const std::string & subscription,
+                          std::shared_ptr<pb::Column> col)
+  {
+    if( col->queryid() == "probe" )
+    {
+      ++n_probes;
+    }
+    else if( col->queryid() == slow_id )
+    {
+      // holds its lane, but not the other lanes
+      on_release.wait_for(std::chrono::seconds(20));
+      ++n_slow;
+    }
+    else if( ++n_fast == n_columns )
+    {
+      fast_promise.set_value();
+    }
+  });
+  
+  register_column_ep(ep_clnt, name, pub.addr_);
+  EXPECT_TRUE(col_clnt.wait_valid(10000));
+  ASSERT_TRUE(pub.wait_subscribed([&n_probes]() { return n_probes > 0; }));
+  
+  // more slow columns pile up than a bounded lane would take
+  for( uint64_t c=0; c<n_columns; ++c )
+  {
+    pub.send(slow_id+" ", raw_column_pub::column(slow_id, c));
+    pub.send(fast_id+" ", raw_column_pub::column(fast_id, c));
+  }
+  
+  EXPECT_EQ(on_fast.wait_for(std::chrono::seconds(20)), std::future_status::ready);
+  EXPECT_LT(n_slow, n_columns);
+  release_promise.set_value();
+  
+  for( int i=0; i<200 && n_slow < n_columns; ++i )
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  EXPECT_EQ(n_slow, n_columns);
+  
+  col_clnt.remove_watches();
+  col_clnt.cleanup();
+}
+
+TEST_F(ConnColumnTest, ParseError)
+{
+  const char * name = "ConnColumnTest-ParseError";
+  
+  endpoint_client ep_clnt(cctx_, global_mock_ep, name);
+  raw_column_pub pub;
+  column_client col_clnt(cctx_, ep_clnt, name, 2);
+  
+  std::atomic<size_t> n_probes{0};
+  std::atomic<size_t> n_received{0};
+  std::promise<void> done_promise;
+  std::future<void> on_done{done_promise.get_future()};
+  
+  col_clnt.watch("*", [&](const std::string & provider_name,
+                          const std::string & channel,
+                          const std::string & subscription,
+                          std::shared_ptr<pb::Column> col)
+  {
+    if( col->queryid() == "probe" )
+    {
+      ++n_probes;
+      return;
+    }
+    EXPECT_EQ(col->seqno(), 1);
+    if( ++n_received == 1 )
+      done_promise.set_value();
+  });
+  
+  register_column_ep(ep_clnt, name, pub.addr_);
+  EXPECT_TRUE(col_clnt.wait_valid(10000));
+  ASSERT_TRUE(pub.wait_subscribed([&n_probes]() { return n_probes > 0; }));
+  
+  auto before = col_clnt.get_sub_stats();
+  
+  // a truncated varint never parses. the good column follows it on the
+  // same lane, so once that is delivered the bad one was dropped
+  pub.send("query ", std::string("\xff\xff\xff", 3));
+  pub.send("query ", raw_column_pub::column("query", 1));
+  
+  ASSERT_EQ(on_done.wait_for(std::chrono::seconds(10)), std::future_status::ready);
+  
+  auto st = col_clnt.get_sub_stats();
+  EXPECT_EQ(st.n_parse_errors_, 1);
+  EXPECT_EQ(before.n_parse_errors_, 0);
+  EXPECT_GE(st.n_frames_-before.n_frames_, 2);
+  EXPECT_EQ(n_received, 1);
+  
+  col_clnt.remove_watches();
+  col_clnt.cleanup();
+}
+
 /*
 TEST_F(ConnLogRecordTest, ImplementMe) { EXPECT_TRUE(false); }
 TEST_F(ConnQueryTest, ImplementMe) { EXPECT_TRUE(false); }
@@ -101,7 +101,15 @@ namespace virtdb { namespace test {
   class ConnLogRecordTest : public ConnectorCommon { };
   
   class ConnQueryTest : public ConnectorCommon { };
-  class ConnColumnTest : public ConnectorCommon { };
+  class ConnColumnTest : public ConnectorCommon
+  {
+  protected:
+    // registers addr as the COLUMN publisher of name, so the tests can
+    // feed column_clients from a bare PUB socket
+    void register_column_ep(connector::endpoint_client & ep_clnt,
+                            const std::string & name,
+                            const std::string & addr);
+  };
   class ConnMetaDataTest : public ConnectorCommon { };
   
   class ConnPubSubTest : public ConnectorCommon { };
@@ -0,0 +1,118 @@
+#include "bench.hh"
+#include <datasrc/int32_column.hh>
+#include <datasrc/string_column.hh>
+#include <datasrc/pool.hh>
+#include <util/active_queue.hh>
+#include <string>
+#include <vector>
+
+using namespace virtdb::datasrc;
+using virtdb::util::active_queue;
+
+namespace
+{
+  const size_t n_rows = 100000;
+  
+  void
+  fill_int32(int32_column & col)
+  {
+    col.prepare();
+    int32_t * vals = col.get_typed_ptr();
+    for( size_t i=0; i<n_rows; ++i )
+      vals[i] = static_cast<int32_t>(i%1000);
+    col.n_rows(n_rows);
+  }
+  
+  size_t
+  fill_var_string(var_string_column & col)
+  {
+    size_t n_bytes = 0;
+    col.prepare();
+    for( size_t i=0; i<n_rows; ++i )
+    {
+      std::string v{"value-" + std::to_string(i%10000)};
+      col.append(v.data(), v.size());
+      n_bytes += v.size();
+    }
+    return n_bytes;
+  }
+}
+
+BENCHMARK_(column_compress_int32)
+{
+  int32_column col{n_rows};
+
+  st.run(n_rows, n_rows*sizeof(int32_t), [&]() {
+    fill_int32(col);
+    col.convert_pb();
+    col.compress();
+  });
+}
+
+BENCHMARK_(column_encode_int32)
+{
+  int32_column col{n_rows};
+
+  st.run(n_rows, n_rows*sizeof(int32_t), [&]() {
+    fill_int32(col);
+    col.encode(virtdb::util::lz4_options());
+  });
+}
+
+BENCHMARK_(column_compress_var_string)
+{
+  var_string_column col{n_rows, 4000};
+  size_t n_bytes = fill_var_string(col);
+
+  st.run(n_rows, n_bytes, [&]() {
+    fill_var_string(col);
+    col.convert_pb();
+    col.compress();
+  });
+}
+
+BENCHMARK_(column_encode_var_string)
+{
+  var_string_column col{n_rows, 4000};
+  size_t n_bytes = fill_var_string(col);
+
+  st.run(n_rows, n_bytes, [&]() {
+    fill_var_string(col);
+    col.encode(virtdb::util::lz4_options());
+  });
+}
+
+BENCHMARK_(pool_allocate_dispose)
+{
+  const size_t n_ops = 1000000;
+  pool p{1000};
+  std::vector<column::sptr> cols;
+
+  st.run(n_ops, 0, [&]() {
+    for( size_t i=0; i<n_ops; i+=16 )
+    {
+      for( size_t c=0; c<16; ++c )
+        cols.push_back(p.allocate<int32_column>());
+      for( auto & c : cols )
+        c->dispose(std::move(c));
+      cols.clear();
+    }
+  });
+}
+
+BENCHMARK_(pool_allocate_dispose_async)
+{
+  // disposed by another thread, as the compressor does
+  const size_t n_ops = 200000;
+  pool p{1000, 64};
+  active_queue<column::sptr> q{2, [](column::sptr col) {
+    column::sptr col_copy = col;
+    col->dispose(std::move(col_copy));
+  }};
+
+  st.run(n_ops, 0, [&]() {
+    for( size_t i=0; i<n_ops; ++i )
+      q.push(p.allocate<int32_column>());
+    p.wait_all_disposed(10000);
+  });
+}
@@ -1,7 +1,15 @@
 #include "datasrc_test.hh"
 #include <util/active_queue.hh>
+#include <util/value_type.hh>
 #include <thread>
+#include <atomic>
+#include <memory>
 #include <iostream>
+#include <cstring>
+#include <string>
+#include <map>
+#include <mutex>
+#include <vector>
 
 using namespace virtdb::util;
 using namespace virtdb::test;
@@ -112,3 +120,407 @@ TEST_F(PoolTest, AsyncBounded)
     std::cout << "allocated:" << p.n_allocated() << "\n";
   }
 }
+
+TEST_F(PoolTest, LifoReuse)
+{
+  size_t max_rows{10};
+  pool p{max_rows};
+  column::sptr a = p.allocate<int32_column>();
+  column::sptr b = p.allocate<int32_column>();
+  column * a_ptr = a.get();
+  column * b_ptr = b.get();
+  
+  a->dispose(std::move(a));
+  column::sptr b_copy = b;
+  b->dispose(std::move(b));
+  // disposing a copy of a free column again is ignored
+  b_copy->dispose(std::move(b_copy));
+  EXPECT_EQ( p.n_disposed(), 2 );
+  
+  // the most recently disposed column comes back first
+  column::sptr c = p.allocate<int32_column>();
+  column::sptr d = p.allocate<int32_column>();
+  EXPECT_EQ( c.get(), b_ptr );
+  EXPECT_EQ( d.get(), a_ptr );
+  EXPECT_EQ( p.n_allocated(), 2 );
+  EXPECT_EQ( p.n_disposed(), 0 );
+}
+
+TEST_F(PoolTest, MemoryBudget)
+{
+  size_t max_rows{1000};
+  size_t col_bytes = double_column::footprint(max_rows);
+  size_t base = memory_budget::current();
+  memory_budget::limit(base+(2*col_bytes));
+  memory_budget::reset_peak();
+  
+  {
+    pool p1{max_rows};
+    pool p2{max_rows};
+    column::sptr c1 = p1.allocate<double_column>();
+    column::sptr c2 = p1.allocate<double_column>();
+    EXPECT_EQ(p1.charged_bytes(), 2*col_bytes);
+    EXPECT_EQ(memory_budget::current(), base+(2*col_bytes));
+    
+    // p2 has no columns, so it may go over the limit
+    column::sptr c3 = p2.allocate<double_column>();
+    EXPECT_EQ(memory_budget::peak(), base+(3*col_bytes));
+    EXPECT_GE(memory_budget::get_stats().n_overcommits_, 1);
+    
+    // p1 blocks until one of its columns is disposed
+    uint64_t n_waits = memory_budget::get_stats().n_waits_;
+    std::thread t([&c1](){
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      c1->dispose(std::move(c1));
+    });
+    column::sptr c4 = p1.allocate<double_column>();
+    t.join();
+    EXPECT_TRUE(c4.get() != nullptr);
+    EXPECT_EQ(p1.n_allocated(), 2);
+    EXPECT_EQ(memory_budget::get_stats().n_waits_, n_waits+1);
+  }
+  
+  // the pools give their bytes back
+  EXPECT_EQ(memory_budget::current(), base);
+  memory_budget::limit(0);
+}
+
+TEST_F(PoolTest, MemoryBudgetOtherPool)
+{
+  size_t max_rows{1000};
+  size_t col_bytes = string_column::footprint(max_rows, 64);
+  size_t base = memory_budget::current();
+  memory_budget::limit(base+(2*col_bytes));
+  
+  pool p1{max_rows};
+  column::sptr c1 = p1.allocate<string_column>(64);
+  std::unique_ptr<pool> p2{new pool{max_rows}};
+  column::sptr c2 = p2->allocate<string_column>(64);
+  
+  // a waiting pool notices the budget given back by another one
+  std::thread t([&p2,&c2](){
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    c2.reset();
+    p2.reset();
+  });
+  column::sptr c3 = p1.allocate<string_column>(64);
+  t.join();
+  EXPECT_TRUE(c3.get() != nullptr);
+  EXPECT_EQ(memory_budget::current(), base+(2*col_bytes));
+  memory_budget::limit(0);
+}
+
+TEST_F(CompressorTest, CompressPooled)
+{
+  size_t max_rows{1000};
+  std::atomic<size_t> n_compressed{0};
+  
+  pool p{max_rows,8};
+  compressor comp{[&n_compressed](column::sptr col,
+                                  const compressor::stats & st) {
+    EXPECT_EQ(st.name_, "col");
+    EXPECT_GT(st.uncompressed_size_, 0);
+    EXPECT_TRUE(col->get_pb_column().has_compresseddata());
+    ++n_compressed;
+    column::sptr col_copy = col;
+    col->dispose(std::move(col_copy));
+  }, 4};
+  
+  for( int i=0;i<100;++i )
+  {
+    column::sptr c = p.allocate<int32_column>();
+    c->prepare();
+    c->get_pb_column().set_name("col");
+    int32_t * vals = reinterpret_cast<int32_t *>(c->get_ptr());
+    for( size_t r=0; r<max_rows; ++r ) vals[r] = (int32_t)(r%10);
+    c->n_rows(max_rows);
+    comp.push(c);
+  }
+  
+  EXPECT_TRUE(comp.wait_empty(5000));
+  EXPECT_TRUE(p.wait_all_disposed(1000));
+  EXPECT_EQ(n_compressed, 100);
+  EXPECT_EQ(comp.n_done(), 100);
+  EXPECT_GT(comp.ratio(), 1.0);
+}
+
+TEST_F(CompressorTest, QueryDictionary)
+{
+  size_t max_rows{1000};
+  std::string values;
+  for( int32_t v=0; v<10; ++v )
+    values.append(reinterpret_cast<const char *>(&v), sizeof(v));
+  lz4_dictionary::sptr dict{new lz4_dictionary{values}};
+  
+  std::mutex mtx;
+  std::map<std::string, std::vector<std::pair<std::string,size_t>>> blocks;
+  
+  pool p{max_rows,8};
+  // a single worker hands over the blocks in order
+  compressor comp{[&](column::sptr col,
+                      const compressor::stats & st) {
+    {
+      std::lock_guard<std::mutex> l(mtx);
+      auto & c = col->get_pb_column();
+      blocks[c.queryid()].push_back(std::make_pair(c.compresseddata(),
+                                                   (size_t)c.uncompressedsize()));
+    }
+    column::sptr col_copy = col;
+    col->dispose(std::move(col_copy));
+  }, 1};
+  
+  comp.set_query_options("hinted", lz4_options::hc().with_dictionary(dict, lz4_options::REFERENCE));
+  
+  for( int i=0;i<20;++i )
+  {
+    for( auto const & query_id : { "hinted", "other" } )
+    {
+      column::sptr c = p.allocate<int32_column>();
+      c->prepare();
+      c->get_pb_column().set_name("col");
+      c->get_pb_column().set_queryid(query_id);
+      int32_t * vals = reinterpret_cast<int32_t *>(c->get_ptr());
+      for( size_t r=0; r<max_rows; ++r ) vals[r] = (int32_t)((r*7)%10);
+      c->n_rows(max_rows);
+      comp.push(c);
+    }
+  }
+  
+  EXPECT_TRUE(comp.wait_empty(5000));
+  EXPECT_TRUE(p.wait_all_disposed(1000));
+  comp.remove_query_options("hinted");
+  
+  std::lock_guard<std::mutex> l(mtx);
+  ASSERT_EQ(blocks["hinted"].size(), 20);
+  ASSERT_EQ(blocks["other"].size(), 20);
+  
+  // only the first block of the hinted query carries the dictionary.
+  // the rest refer to it or are plain blocks when that is smaller
+  for( size_t i=0; i<blocks["hinted"].size(); ++i )
+  {
+    auto const & b = blocks["hinted"][i];
+    EXPECT_EQ(lz4_utils::learn_dictionary(b.first.c_str(), b.first.size()), i == 0) << i;
+    std::string output(b.second, 0);
+    EXPECT_EQ(lz4_utils::decompress(b.first.c_str(),
+                                    b.first.size(),
+                                    &output[0],
+                                    output.size()), (int)b.second) << i;
+  }
+  
+  for( auto const & b : blocks["other"] )
+  {
+    uint32_t dict_id = 0;
+    EXPECT_FALSE(lz4_utils::has_dictionary(b.first.c_str(), b.first.size(), dict_id));
+  }
+}
+
+TEST_F(ColumnTest, VarStringArena)
+{
+  size_t max_rows{10000};
+  pool p{max_rows,2};
+  column::sptr c = p.allocate<var_string_column>(4000);
+  auto * vc = dynamic_cast<var_string_column *>(c.get());
+  ASSERT_NE(vc, nullptr);
+  
+  for( int pass=0; pass<2; ++pass )
+  {
+    vc->prepare();
+    for( size_t r=0; r<max_rows; ++r )
+    {
+      if( r%5 == pass )
+      {
+        vc->append_null();
+      }
+      else
+      {
+        std::string v{"value " + std::to_string(r)};
+        vc->append(v.c_str(), v.size());
+      }
+    }
+    
+    EXPECT_EQ(vc->n_rows(), max_rows);
+    EXPECT_EQ(vc->offsets().size(), max_rows+1);
+    // the arena follows the actual sizes, not max_rows*max_size
+    EXPECT_LT(vc->data_capacity(), max_rows*100);
+    
+    vc->convert_pb();
+    auto & data = *(vc->get_pb_column().mutable_data());
+    EXPECT_EQ(data.type(), virtdb::interface::pb::Kind::STRING);
+    ASSERT_EQ(data.stringvalue_size(), max_rows);
+    for( size_t r=0; r<max_rows; ++r )
+    {
+      bool is_null = value_type_base::is_null(data, r);
+      EXPECT_EQ(is_null, (r%5 == pass));
+      if( !is_null )
+        EXPECT_EQ(data.stringvalue(r), "value " + std::to_string(r));
+      else
+        EXPECT_TRUE(data.stringvalue(r).empty());
+    }
+  }
+  
+  EXPECT_THROW(vc->append("x",1), std::exception);
+}
+
+TEST_F(ColumnTest, NullBitmap)
+{
+  size_t max_rows{1000};
+  int32_column c{max_rows};
+  c.prepare();
+  int32_t * vals = c.get_typed_ptr();
+  for( size_t r=0; r<max_rows; ++r )
+  {
+    vals[r] = (int32_t)r+1;
+    c.nulls()[r] = (r%10 == 3 && r < 500);
+  }
+  c.n_rows(max_rows);
+  c.convert_pb();
+  
+  auto & data = *(c.get_pb_column().mutable_data());
+  ASSERT_EQ(data.int32value_size(), max_rows);
+  // IsNull only goes up to the last null
+  EXPECT_EQ(data.isnull_size(), 494);
+  for( size_t r=0; r<max_rows; ++r )
+  {
+    bool is_null = value_type_base::is_null(data, r);
+    EXPECT_EQ(is_null, (r%10 == 3 && r < 500));
+    EXPECT_EQ(data.int32value(r), is_null ? 0 : (int32_t)r+1);
+  }
+}
+
+TEST_F(ColumnTest, VarBytesReserve)
+{
+  size_t max_rows{100};
+  var_bytes_column c{max_rows, 16};
+  c.prepare();
+  for( size_t r=0; r<max_rows; ++r )
+  {
+    // write in place, ask for more than max_size: gets truncated
+    char * p = c.reserve(64);
+    ::memset(p, (int)r, 16);
+    c.commit(64);
+  }
+  EXPECT_EQ(c.data_size(), max_rows*16);
+  
+  c.convert_pb();
+  auto & data = *(c.get_pb_column().mutable_data());
+  EXPECT_EQ(data.type(), virtdb::interface::pb::Kind::BYTES);
+  ASSERT_EQ(data.bytesvalue_size(), max_rows);
+  for( size_t r=0; r<max_rows; ++r )
+  {
+    EXPECT_EQ(data.bytesvalue(r), std::string(16, (char)r));
+  }
+}
+
+namespace
+{
+  virtdb::interface::pb::ValueType
+  decompressed_data(column & c)
+  {
+    auto & pb = c.get_pb_column();
+    virtdb::interface::pb::ValueType ret;
+    EXPECT_TRUE(pb.has_compresseddata());
+    if( !pb.has_compresseddata() ) return ret;
+    
+    std::unique_ptr<char[]> buf{new char[pb.uncompressedsize()+1]};
+    int sz = lz4_utils::decompress(pb.compresseddata().data(),
+                                   pb.compresseddata().size(),
+                                   buf.get(),
+                                   pb.uncompressedsize());
+    EXPECT_EQ(sz, (int)pb.uncompressedsize());
+    EXPECT_TRUE(ret.ParseFromArray(buf.get(), sz));
+    EXPECT_EQ(ret.type(), pb.data().type());
+    return ret;
+  }
+  
+  // encode() must produce the same values as convert_pb() and compress()
+  template <typename COL, typename FILL>
+  void
+  check_encode(COL & a, COL & b, FILL fill)
+  {
+    // prepare() may be protected in the derived types
+    static_cast<column &>(a).prepare();
+    static_cast<column &>(b).prepare();
+    fill(a);
+    fill(b);
+    a.convert_pb();
+    a.compress();
+    b.encode(lz4_options());
+    
+    auto va = decompressed_data(a);
+    auto vb = decompressed_data(b);
+    EXPECT_EQ(va.type(), vb.type());
+    EXPECT_EQ(va.DebugString(), vb.DebugString());
+  }
+}
+
+TEST_F(ColumnTest, EncodeDirect)
+{
+  size_t max_rows{1000};
+  
+  {
+    int32_column a{max_rows}, b{max_rows};
+    check_encode(a, b, [max_rows](int32_column & c) {
+      for( size_t r=0; r<max_rows; ++r )
+      {
+        c.get_typed_ptr()[r] = (int32_t)(r*7919)-100000;
+        c.nulls()[r] = (r%7 == 2);
+      }
+      c.n_rows(max_rows);
+    });
+  }
+  
+  {
+    double_column a{max_rows}, b{max_rows};
+    check_encode(a, b, [max_rows](double_column & c) {
+      for( size_t r=0; r<max_rows; ++r )
+      {
+        c.get_typed_ptr()[r] = r*0.5;
+        c.nulls()[r] = (r == 999);
+      }
+      c.n_rows(max_rows);
+    });
+  }
+  
+  {
+    // fixed width values with an in-field offset
+    string_column a{max_rows, 40}, b{max_rows, 40};
+    check_encode(a, b, [max_rows](string_column & c) {
+      c.in_field_offset(2);
+      for( size_t r=0; r<max_rows; ++r )
+      {
+        std::string v{"value " + std::to_string(r)};
+        ::memcpy(c.get_ptr()+(r*40)+2, v.c_str(), v.size());
+        c.actual_sizes()[r] = v.size();
+        c.nulls()[r] = (r%11 == 0);
+      }
+      c.n_rows(max_rows);
+    });
+  }
+  
+  {
+    var_bytes_column a{max_rows, 64}, b{max_rows, 64};
+    check_encode(a, b, [max_rows](var_bytes_column & c) {
+      for( size_t r=0; r<max_rows; ++r )
+      {
+        std::string v(r%50, (char)r);
+        if( r%13 == 5 ) c.append_null();
+        else            c.append(v.c_str(), v.size());
+      }
+    });
+  }
+  
+  {
+    // the invalid dates become nulls on both paths
+    datetime_column a{max_rows}, b{max_rows};
+    check_encode(a, b, [max_rows](datetime_column & c) {
+      for( size_t r=0; r<max_rows; ++r )
+      {
+        std::string v{(r%3 == 0) ? "2015-02-30 10:00:00" : "2015-03-21 10:00:00"};
+        ::memcpy(c.get_ptr()+(r*32), v.c_str(), v.size());
+        c.actual_sizes()[r] = v.size();
+        c.nulls()[r] = false;
+      }
+      c.n_rows(max_rows);
+    });
+  }
+}
@@ -7,5 +7,6 @@ namespace virtdb { namespace test {
   
   class ColumnTest : public ::testing::Test { };
   class PoolTest : public ::testing::Test { };
+  class CompressorTest : public ::testing::Test { };
 }}
 
@@ -0,0 +1,104 @@
+#include "bench.hh"
+#include <datasrc/int64_column.hh>
+#include <engine/collector.hh>
+#include <util/zmq_utils.hh>
+#include <zmq.hpp>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace virtdb;
+
+namespace
+{
+  const size_t n_rows     = 10000;
+  const size_t n_columns  = 8;
+  const size_t n_blocks   = 50;
+}
+
+// datasrc column -> compress -> inproc zmq -> engine::collector -> reader
+BENCHMARK_(inproc_publish_collect)
+{
+  zmq::context_t ctx{1};
+  zmq::socket_t  sender{ctx, ZMQ_PUSH};
+  zmq::socket_t  receiver{ctx, ZMQ_PULL};
+  receiver.bind("inproc://bench-publish-collect");
+  sender.connect("inproc://bench-publish-collect");
+
+  // columns are compressed once, the measured part is the transport,
+  // the collection and the decoding of the values
+  std::vector<std::vector<zmq::message_t>> messages;
+  uint64_t n_bytes = 0;
+  {
+    datasrc::int64_column col{n_rows};
+    for( size_t b=0; b<n_blocks; ++b )
+    {
+      messages.push_back(std::vector<zmq::message_t>());
+      for( size_t c=0; c<n_columns; ++c )
+      {
+        col.prepare();
+        int64_t * vals = col.get_typed_ptr();
+        for( size_t r=0; r<n_rows; ++r )
+          vals[r] = static_cast<int64_t>((b*n_rows+r)*(c+1));
+        col.n_rows(n_rows);
+        col.convert_pb();
+        col.compress();
+        auto & pb_col = col.get_pb_column();
+        pb_col.set_name(std::to_string(c));
+        pb_col.set_seqno(b);
+        if( b == n_blocks-1 ) pb_col.set_endofdata(true);
+        
+        zmq::message_t msg;
+        int byte_size = pb_col.ByteSize();
+        util::zmq_socket_wrapper::serialize_to_message(pb_col, byte_size, msg);
+        n_bytes += byte_size;
+        messages.back().push_back(std::move(msg));
+      }
+    }
+  }
+
+  std::vector<int64_t> out(1024);
+  std::vector<uint8_t> out_nulls(1024);
+
+  st.run(n_rows*n_columns*n_blocks, n_bytes, [&]() {
+    engine::collector coll{n_columns};
+    
+    std::thread recv_thread{[&]() {
+      for( size_t i=0; i<n_blocks*n_columns; ++i )
+      {
+        zmq::message_t msg;
+        if( !receiver.recv(&msg) ) break;
+        engine::collector::column_sptr col{new interface::pb::Column};
+        if( !col->ParseFromArray(msg.data(), msg.size()) ) continue;
+        size_t col_id = std::stoul(col->name());
+        coll.push(col->seqno(), col_id, col);
+      }
+    }};
+    
+    for( auto & block : messages )
+    {
+      for( auto & m : block )
+      {
+        // keep the prepared buffers for the next iteration
+        zmq::message_t copy;
+        copy.copy(&m);
+        sender.send(copy);
+      }
+    }
+    
+    engine::collector::reader_sptr_vec readers;
+    for( size_t b=0; b<n_blocks; ++b )
+    {
+      coll.get(b, 10000, 10000, readers);
+      for( auto & rdr : readers )
+      {
+        if( !rdr ) continue;
+        while( rdr->read_int64_batch(out.data(), out_nulls.data(), out.size()) > 0 ) {}
+      }
+      coll.erase(b);
+    }
+    recv_thread.join();
+  });
+}
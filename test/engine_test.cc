@@ -6,6 +6,10 @@
 #include <engine/util.hh>
 #include <engine/collector.hh>
 #include <engine/feeder.hh>
+#include <engine/column_batch.hh>
+#include <util/value_type_writer.hh>
+#include <util/value_type_reader.hh>
+#include <cstring>
 
 using namespace virtdb::util;
 using namespace virtdb::engine;
@@ -31,3 +35,82 @@ public:
     }
 };
 
+
+namespace
+{
+  value_type_reader::sptr
+  to_reader(value_type_writer::sptr wr)
+  {
+    size_t sz = 0;
+    for( auto const * p = wr->get_parts(); p; p = p->next_ )
+      for( size_t i=0; i<p->n_parts_; ++i )
+        sz += p->parts_[i].n_used_;
+    
+    value_type_reader::buffer buf{new char[sz+1]};
+    char * tmp = buf.get();
+    for( auto const * p = wr->get_parts(); p; p = p->next_ )
+    {
+      for( size_t i=0; i<p->n_parts_; ++i )
+      {
+        ::memcpy(tmp, p->parts_[i].data_, p->parts_[i].n_used_);
+        tmp += p->parts_[i].n_used_;
+      }
+    }
+    return value_type_reader::construct(std::move(buf), sz);
+  }
+}
+
+TEST_F(ColumnBatchTest, Int64)
+{
+  const size_t n = 3000;
+  std::vector<int64_t> input;
+  std::unique_ptr<bool[]> nulls{new bool[n]};
+  for( size_t i=0; i<n; ++i )
+  {
+    input.push_back(static_cast<int64_t>(i*1000)-7);
+    nulls[i] = (i%7 == 0);
+  }
+  auto wr = value_type_writer::construct(Kind::INT64, n);
+  wr->write_int64_batch(input.data(), nulls.get(), n);
+  
+  column_vector cv;
+  EXPECT_TRUE(cv.load(to_reader(wr)));
+  EXPECT_EQ(cv.kind(), Kind::INT64);
+  ASSERT_EQ(cv.size(), n);
+  EXPECT_EQ(cv.n_nulls(), (n+6)/7);
+  for( size_t i=0; i<n; ++i )
+  {
+    EXPECT_EQ(cv.is_null(i), nulls[i]);
+    if( !nulls[i] )
+      EXPECT_EQ(cv.values<int64_t>()[i], input[i]);
+  }
+  EXPECT_EQ(cv.null_bitmap()[0] & 0xff, 0x81);
+  
+  // an empty reader has no data
+  EXPECT_FALSE(cv.load(value_type_reader::construct(value_type_reader::buffer(), 0)));
+  EXPECT_EQ(cv.size(), 0);
+}
+
+TEST_F(ColumnBatchTest, Strings)
+{
+  auto wr = value_type_writer::construct(Kind::STRING, 2000);
+  std::vector<std::string> input;
+  for( size_t i=0; i<2000; ++i )
+  {
+    input.push_back(std::string("value-")+std::to_string(i));
+    auto const & v = input.back();
+    wr->write_string(v.size(), [&v](char * p, size_t) {
+      ::memcpy(p, v.c_str(), v.size());
+      return v.size();
+    });
+  }
+  wr->set_null(5);
+  
+  column_vector cv;
+  EXPECT_TRUE(cv.load(to_reader(wr)));
+  ASSERT_EQ(cv.size(), input.size());
+  EXPECT_EQ(cv.n_nulls(), 1);
+  EXPECT_TRUE(cv.is_null(5));
+  for( size_t i=0; i<input.size(); ++i )
+    EXPECT_EQ(std::string(cv.ptrs()[i], cv.lens()[i]), input[i]);
+}
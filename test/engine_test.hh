@@ -6,6 +6,7 @@
 namespace virtdb { namespace test {
 
     class ColumnChunkTest : public ::testing::Test { };
+    class ColumnBatchTest : public ::testing::Test { };
 
     // class ChunkStoreTest : public ::testing::Test { };
     // class DataChunkTest : public ::testing::Test { };
@@ -0,0 +1,387 @@
+#include "bench.hh"
+#include <util/value_type_writer.hh>
+#include <util/value_type_reader.hh>
+#include <util/active_queue.hh>
+#include <util/work_stealing_queue.hh>
+#include <util/table_collector.hh>
+#include <util/ring_table_collector.hh>
+#include <util/mempool.hh>
+#include <util/cached_mempool.hh>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace virtdb::util;
+using namespace virtdb::interface;
+
+namespace
+{
+  const size_t n_rows = 1000000;
+
+  size_t
+  writer_bytes(value_type_writer::sptr wr)
+  {
+    size_t ret = 0;
+    auto const * p = wr->get_parts();
+    while( p )
+    {
+      for( size_t i=0; i<p->n_parts_; ++i )
+        ret += p->parts_[i].n_used_;
+      p = p->next_;
+    }
+    return ret;
+  }
+
+  std::pair<value_type_reader::buffer, size_t>
+  writer_buffer(value_type_writer::sptr wr)
+  {
+    size_t sz = writer_bytes(wr);
+    value_type_reader::buffer ret{new char[sz+1]};
+    char * tmp = ret.get();
+    auto const * p = wr->get_parts();
+    while( p )
+    {
+      for( size_t i=0; i<p->n_parts_; ++i )
+      {
+        ::memcpy(tmp, p->parts_[i].data_, p->parts_[i].n_used_);
+        tmp += p->parts_[i].n_used_;
+      }
+      p = p->next_;
+    }
+    return std::make_pair(std::move(ret), sz);
+  }
+
+  // deterministic input, so runs are comparable with each other
+  std::vector<int64_t>
+  int64_input()
+  {
+    std::vector<int64_t> ret;
+    ret.reserve(n_rows);
+    for( size_t i=0; i<n_rows; ++i )
+      ret.push_back(static_cast<int64_t>((i*2654435761ULL)%1000000007ULL));
+    return ret;
+  }
+
+  std::unique_ptr<bool[]>
+  null_input()
+  {
+    std::unique_ptr<bool[]> ret{new bool[n_rows]};
+    for( size_t i=0; i<n_rows; ++i )
+      ret[i] = (i%10 == 0);
+    return ret;
+  }
+
+  void
+  string_input(std::string & arena,
+               std::vector<uint32_t> & offsets)
+  {
+    offsets.clear();
+    offsets.push_back(0);
+    for( size_t i=0; i<n_rows; ++i )
+    {
+      arena += "value-" + std::to_string(i%100000);
+      offsets.push_back(arena.size());
+    }
+  }
+
+  template <typename QUEUE>
+  void
+  queue_bench(virtdb::bench::state & st)
+  {
+    const size_t n_items = 200000;
+    std::atomic<uint64_t> sum{0};
+    QUEUE q{4, [&sum](uint64_t v) { sum += v; }};
+    
+    st.run(n_items, n_items*sizeof(uint64_t), [&]() {
+      for( uint64_t i=0; i<n_items; ++i )
+        q.push(i);
+      q.wait_empty(std::chrono::milliseconds(10000));
+    });
+  }
+  
+  // as many producer threads as workers
+  template <typename QUEUE>
+  void
+  queue_mpmc_bench(virtdb::bench::state & st,
+                   unsigned int n_threads)
+  {
+    const size_t n_items = 200000;
+    std::atomic<uint64_t> sum{0};
+    QUEUE q{n_threads, [&sum](uint64_t v) { sum += v; }};
+    
+    st.run(n_items, n_items*sizeof(uint64_t), [&]() {
+      std::vector<std::thread> producers;
+      for( unsigned int p=0; p<n_threads; ++p )
+      {
+        producers.push_back(std::thread([&q,n_threads]() {
+          for( uint64_t i=0; i<n_items/n_threads; ++i )
+            q.push(i);
+        }));
+      }
+      for( auto & p : producers ) p.join();
+      q.wait_empty(std::chrono::milliseconds(20000));
+    });
+  }
+}
+
+BENCHMARK_(value_type_writer_int64)
+{
+  auto input = int64_input();
+  auto nulls = null_input();
+  value_type_writer::sptr wr;
+
+  st.run(n_rows, n_rows*sizeof(int64_t), [&]() {
+    wr = value_type_writer::construct(pb::Kind::INT64, n_rows);
+    for( size_t i=0; i<n_rows; ++i )
+    {
+      wr->write_int64(input[i]);
+      if( nulls[i] ) wr->set_null(i);
+    }
+  });
+}
+
+BENCHMARK_(value_type_writer_int64_batch)
+{
+  auto input = int64_input();
+  auto nulls = null_input();
+  value_type_writer::sptr wr;
+
+  st.run(n_rows, n_rows*sizeof(int64_t), [&]() {
+    wr = value_type_writer::construct(pb::Kind::INT64, n_rows);
+    wr->write_int64_batch(input.data(), nulls.get(), n_rows);
+  });
+}
+
+BENCHMARK_(value_type_writer_string)
+{
+  std::string arena;
+  std::vector<uint32_t> offsets;
+  string_input(arena, offsets);
+  value_type_writer::sptr wr;
+
+  st.run(n_rows, arena.size(), [&]() {
+    wr = value_type_writer::construct(pb::Kind::STRING, n_rows);
+    for( size_t i=0; i<n_rows; ++i )
+    {
+      const char * src = arena.data()+offsets[i];
+      size_t len = offsets[i+1]-offsets[i];
+      wr->write_string(len, [src,len](char * p, size_t) {
+        ::memcpy(p, src, len);
+        return len;
+      });
+    }
+  });
+}
+
+BENCHMARK_(value_type_writer_string_batch)
+{
+  std::string arena;
+  std::vector<uint32_t> offsets;
+  string_input(arena, offsets);
+  value_type_writer::sptr wr;
+
+  st.run(n_rows, arena.size(), [&]() {
+    wr = value_type_writer::construct(pb::Kind::STRING, n_rows);
+    wr->write_strings(arena.data(), offsets.data(), nullptr, n_rows);
+  });
+}
+
+BENCHMARK_(value_type_reader_int64)
+{
+  auto input = int64_input();
+  auto nulls = null_input();
+  auto wr = value_type_writer::construct(pb::Kind::INT64, n_rows);
+  wr->write_int64_batch(input.data(), nulls.get(), n_rows);
+
+  st.run(n_rows, writer_bytes(wr), [&]() {
+    auto buf = writer_buffer(wr);
+    auto rdr = value_type_reader::construct(std::move(buf.first), buf.second);
+    int64_t v = 0;
+    bool null = false;
+    while( rdr->read_int64(v, null) == value_type_reader::ok_ ) {}
+  });
+}
+
+BENCHMARK_(value_type_reader_int64_batch)
+{
+  auto input = int64_input();
+  auto nulls = null_input();
+  auto wr = value_type_writer::construct(pb::Kind::INT64, n_rows);
+  wr->write_int64_batch(input.data(), nulls.get(), n_rows);
+  std::vector<int64_t> out(1024);
+  std::vector<uint8_t> out_nulls(1024);
+
+  st.run(n_rows, writer_bytes(wr), [&]() {
+    auto buf = writer_buffer(wr);
+    auto rdr = value_type_reader::construct(std::move(buf.first), buf.second);
+    while( rdr->read_int64_batch(out.data(), out_nulls.data(), out.size()) > 0 ) {}
+  });
+}
+
+BENCHMARK_(value_type_reader_string_batch)
+{
+  std::string arena;
+  std::vector<uint32_t> offsets;
+  string_input(arena, offsets);
+  auto wr = value_type_writer::construct(pb::Kind::STRING, n_rows);
+  wr->write_strings(arena.data(), offsets.data(), nullptr, n_rows);
+  std::vector<char *> ptrs(1024);
+  std::vector<size_t> lens(1024);
+  std::vector<uint8_t> out_nulls(1024);
+
+  st.run(n_rows, writer_bytes(wr), [&]() {
+    auto buf = writer_buffer(wr);
+    auto rdr = value_type_reader::construct(std::move(buf.first), buf.second);
+    while( rdr->read_string_batch(ptrs.data(), lens.data(), out_nulls.data(), ptrs.size()) > 0 ) {}
+  });
+}
+
+BENCHMARK_(active_queue_mutex)
+{
+  queue_bench<active_queue<uint64_t,100>>(st);
+}
+
+BENCHMARK_(active_queue_lock_free)
+{
+  queue_bench<active_queue<uint64_t,100,1024>>(st);
+}
+
+BENCHMARK_(active_queue_mutex_mpmc_1)
+{
+  queue_mpmc_bench<active_queue<uint64_t,100>>(st, 1);
+}
+
+BENCHMARK_(active_queue_lock_free_mpmc_1)
+{
+  queue_mpmc_bench<active_queue<uint64_t,100,1024>>(st, 1);
+}
+
+BENCHMARK_(active_queue_mutex_mpmc_8)
+{
+  queue_mpmc_bench<active_queue<uint64_t,100>>(st, 8);
+}
+
+BENCHMARK_(active_queue_lock_free_mpmc_8)
+{
+  queue_mpmc_bench<active_queue<uint64_t,100,1024>>(st, 8);
+}
+
+BENCHMARK_(active_queue_mutex_mpmc_32)
+{
+  queue_mpmc_bench<active_queue<uint64_t,100>>(st, 32);
+}
+
+BENCHMARK_(active_queue_lock_free_mpmc_32)
+{
+  queue_mpmc_bench<active_queue<uint64_t,100,1024>>(st, 32);
+}
+
+BENCHMARK_(work_stealing_queue)
+{
+  queue_bench<work_stealing_queue<uint64_t,100>>(st);
+}
+
+BENCHMARK_(work_stealing_queue_mpmc_8)
+{
+  queue_mpmc_bench<work_stealing_queue<uint64_t,100>>(st, 8);
+}
+
+BENCHMARK_(work_stealing_queue_mpmc_32)
+{
+  queue_mpmc_bench<work_stealing_queue<uint64_t,100>>(st, 32);
+}
+
+BENCHMARK_(mempool_small_allocations)
+{
+  const size_t n_allocs = 1000000;
+
+  st.run(n_allocs, n_allocs*24, [&]() {
+    mempool pool{1024*1024};
+    for( size_t i=0; i<n_allocs; ++i )
+    {
+      char * p = pool.allocate<char>(24);
+      p[0] = static_cast<char>(i);
+    }
+  });
+}
+
+BENCHMARK_(short_lived_writers)
+{
+  // a writer per column chunk, like datasrc does for every block
+  const size_t n_writers = 2000;
+  const size_t n_values  = 1000;
+  auto input = int64_input();
+
+  st.run(n_writers*n_values, n_writers*n_values*sizeof(int64_t), [&]() {
+    for( size_t w=0; w<n_writers; ++w )
+    {
+      auto wr = value_type_writer::construct(pb::Kind::INT64, n_values);
+      wr->write_int64_batch(input.data()+w, nullptr, n_values);
+    }
+  });
+}
+
+BENCHMARK_(short_lived_mempools_plain)
+{
+  const size_t n_pools = 2000;
+
+  st.run(n_pools, n_pools*1536*1024, [&]() {
+    for( size_t i=0; i<n_pools; ++i )
+    {
+      mempool pool{1024*1024};
+      pool.allocate<char>(512*1024)[0] = 1;
+      pool.allocate<char>(1024*1024)[0] = 1;
+    }
+  });
+}
+
+BENCHMARK_(short_lived_mempools_cached)
+{
+  const size_t n_pools = 2000;
+
+  st.run(n_pools, n_pools*1536*1024, [&]() {
+    for( size_t i=0; i<n_pools; ++i )
+    {
+      cached_mempool pool{1024*1024};
+      pool.allocate<char>(512*1024)[0] = 1;
+      pool.allocate<char>(1024*1024)[0] = 1;
+    }
+  });
+}
+
+BENCHMARK_(table_collector_insert_get)
+{
+  const size_t n_columns = 16;
+  const size_t n_blocks  = 10000;
+
+  st.run(n_blocks*n_columns, 0, [&]() {
+    table_collector<int,10> tc{n_columns};
+    for( size_t b=0; b<n_blocks; ++b )
+    {
+      for( size_t c=0; c<n_columns; ++c )
+        tc.insert(b, c, new int(static_cast<int>(c)));
+      tc.get(b, 0);
+      tc.erase(b);
+    }
+  });
+}
+
+BENCHMARK_(ring_table_collector_insert_get)
+{
+  const size_t n_columns = 16;
+  const size_t n_blocks  = 10000;
+
+  st.run(n_blocks*n_columns, 0, [&]() {
+    ring_table_collector<int,10> tc{n_columns, 8};
+    for( size_t b=0; b<n_blocks; ++b )
+    {
+      for( size_t c=0; c<n_columns; ++c )
+        tc.insert(b, c, new int(static_cast<int>(c)));
+      tc.get(b, 0);
+      tc.erase(b);
+    }
+  });
+}
@@ -1,14 +1,21 @@
 #include "util_test.hh"
 #include <util/active_queue.hh>
+#include <util/work_stealing_queue.hh>
 #include <util/async_worker.hh>
 #include <util/net.hh>
 #include <util/exception.hh>
 #include <util/utf8.hh>
 #include <util/table_collector.hh>
+#include <util/ring_table_collector.hh>
+#include <util/object_pool.hh>
+#include <util/cached_mempool.hh>
+#include <util/null_bitmap.hh>
 #include <util/relative_time.hh>
 #include <util/hash_file.hh>
 #include <util/zmq_utils.hh>
 #include <util/field_helper.hh>
+#include <util/lz4_utils.hh>
+#include <data.pb.h>
 #include <future>
 #include <thread>
 
@@ -46,7 +53,162 @@ namespace
 
 #define MEASURE_ME measure INTERNAL_LOCAL_VAR(_m_) { __FILE__, __LINE__, __func__ };
 
-// UtilLZ4UtilTest
+TEST_F(UtilLZ4UtilTest, Modes)
+{
+  std::string input;
+  for( int i=0; i<1000; ++i ) input += "hello world ";
+  
+  std::vector<lz4_options> modes{
+    lz4_options::fast(),
+    lz4_options::fast(8),
+    lz4_options::hc(),
+    lz4_options::hc(16),
+  };
+  
+  for( auto const & opts : modes )
+  {
+    std::string compressed;
+    EXPECT_TRUE(lz4_utils::compress(input.c_str(), input.size(), compressed, opts));
+    EXPECT_LT(compressed.size(), input.size());
+    
+    uint32_t dict_id = 0;
+    EXPECT_FALSE(lz4_utils::has_dictionary(compressed.c_str(), compressed.size(), dict_id));
+    
+    std::string output(input.size(), 0);
+    int ret = lz4_utils::decompress(compressed.c_str(),
+                                    compressed.size(),
+                                    &output[0],
+                                    output.size());
+    EXPECT_EQ(ret, (int)input.size());
+    EXPECT_EQ(output, input);
+  }
+}
+
+TEST_F(UtilLZ4UtilTest, Dictionary)
+{
+  std::vector<std::string> samples{"Budapest", "Szeged", "Budapest", "Debrecen", "Budapest"};
+  auto dict = lz4_dictionary::train(samples);
+  ASSERT_TRUE(dict.get() != nullptr);
+  EXPECT_EQ(dict->data().size(), 8+6+8);
+  
+  // the most valuable sample goes to the end
+  EXPECT_EQ(dict->data().substr(dict->data().size()-8), "Budapest");
+  
+  lz4_dictionary_store::add("CITIES", dict);
+  EXPECT_EQ(lz4_dictionary_store::get("CITIES"), dict);
+  
+  std::string input{"BudapestDebrecenSzegedBudapest"};
+  for( auto opts : { lz4_options::fast(), lz4_options::hc() } )
+  {
+    // the embedded dictionary costs more than it saves in a block this
+    // small, so a plain block goes out
+    std::string embedded;
+    EXPECT_TRUE(lz4_utils::compress(input.c_str(),
+                                    input.size(),
+                                    embedded,
+                                    opts.with_dictionary(dict)));
+    
+    uint32_t dict_id = 0;
+    EXPECT_FALSE(lz4_utils::has_dictionary(embedded.c_str(), embedded.size(), dict_id));
+    
+    // the store knows the dictionary, so the id is enough
+    std::string compressed;
+    EXPECT_TRUE(lz4_utils::compress(input.c_str(),
+                                    input.size(),
+                                    compressed,
+                                    opts.with_dictionary(dict, lz4_options::REFERENCE)));
+    
+    EXPECT_TRUE(lz4_utils::has_dictionary(compressed.c_str(), compressed.size(), dict_id));
+    EXPECT_EQ(dict_id, dict->id());
+    EXPECT_LT(compressed.size(), embedded.size());
+    
+    for( auto const & c : { embedded, compressed } )
+    {
+      std::string output(input.size(), 0);
+      int ret = lz4_utils::decompress(c.c_str(),
+                                      c.size(),
+                                      &output[0],
+                                      output.size());
+      EXPECT_EQ(ret, (int)input.size());
+      EXPECT_EQ(output, input);
+    }
+  }
+  
+  lz4_dictionary_store::remove("CITIES");
+  EXPECT_FALSE(lz4_dictionary_store::get("CITIES"));
+}
+
+TEST_F(UtilLZ4UtilTest, DictionaryWithoutStore)
+{
+  // like the collector in another process: the store never saw the
+  // dictionary, the compressed data has to carry it
+  std::vector<std::string> samples;
+  for( int i=0; i<100; ++i ) samples.push_back("value-" + std::to_string(i%10));
+  auto dict = lz4_dictionary::train(samples);
+  ASSERT_TRUE(dict.get() != nullptr);
+  EXPECT_FALSE(lz4_dictionary_store::get("VALUES"));
+  
+  std::string input;
+  for( int i=0; i<1000; ++i ) input += "value-" + std::to_string((i*7)%10);
+  
+  std::string compressed;
+  auto opts = lz4_options::hc();
+  EXPECT_TRUE(lz4_utils::compress(input.c_str(),
+                                  input.size(),
+                                  compressed,
+                                  opts.with_dictionary(dict, lz4_options::ANNOUNCE)));
+  
+  uint32_t dict_id = 0;
+  EXPECT_TRUE(lz4_utils::has_dictionary(compressed.c_str(), compressed.size(), dict_id));
+  EXPECT_EQ(dict_id, dict->id());
+  
+  std::string output(input.size(), 0);
+  int ret = lz4_utils::decompress(compressed.c_str(),
+                                  compressed.size(),
+                                  &output[0],
+                                  output.size());
+  EXPECT_EQ(ret, (int)input.size());
+  EXPECT_EQ(output, input);
+  
+  // a damaged dictionary is detected, not used
+  std::string damaged{compressed};
+  damaged[12] ^= 1;
+  EXPECT_LT(lz4_utils::decompress(damaged.c_str(),
+                                  damaged.size(),
+                                  &output[0],
+                                  output.size()), 0);
+  
+  // so is a truncated header
+  EXPECT_LT(lz4_utils::decompress(compressed.c_str(),
+                                  10,
+                                  &output[0],
+                                  output.size()), 0);
+  
+  // the blocks after the announcing one only refer to the dictionary,
+  // they need the dictionary learnt from the first one
+  std::string referring;
+  EXPECT_TRUE(lz4_utils::compress(input.c_str(),
+                                  input.size(),
+                                  referring,
+                                  opts.with_dictionary(dict, lz4_options::REFERENCE)));
+  EXPECT_TRUE(lz4_utils::has_dictionary(referring.c_str(), referring.size(), dict_id));
+  EXPECT_LT(referring.size(), compressed.size());
+  EXPECT_LT(lz4_utils::decompress(referring.c_str(),
+                                  referring.size(),
+                                  &output[0],
+                                  output.size()), 0);
+  
+  EXPECT_FALSE(lz4_utils::learn_dictionary(damaged.c_str(), damaged.size()));
+  EXPECT_TRUE(lz4_utils::learn_dictionary(compressed.c_str(), compressed.size()));
+  EXPECT_EQ(lz4_dictionary_store::get_by_id(dict->id())->data(), dict->data());
+  
+  output.assign(input.size(), 0);
+  EXPECT_EQ(lz4_utils::decompress(referring.c_str(),
+                                  referring.size(),
+                                  &output[0],
+                                  output.size()), (int)input.size());
+  EXPECT_EQ(output, input);
+}
 
 TEST_F(UtilFieldHelperTest, GetSet)
 {
@@ -233,6 +395,379 @@ TEST_F(UtilTableCollectorTest, AllOps)
   }
 }
 
+TEST_F(UtilTableCollectorTest, OnComplete)
+{
+  table_collector<int> q(2);
+  std::vector<size_t> completed;
+  auto cb = [&completed](size_t block_id) { completed.push_back(block_id); };
+  
+  q.on_complete(0, cb);
+  q.insert(0, 0, new int{0});
+  EXPECT_TRUE(completed.empty());
+  q.insert(0, 1, new int{1});
+  ASSERT_EQ(completed.size(), 1);
+  EXPECT_EQ(completed[0], 0);
+  
+  // fired once only
+  q.insert(0, 1, new int{2});
+  EXPECT_EQ(completed.size(), 1);
+  
+  // complete block calls back right away
+  q.on_complete(0, cb);
+  EXPECT_EQ(completed.size(), 2);
+  
+  // erase drops the callbacks
+  q.on_complete(1, cb);
+  q.erase(1);
+  q.insert(1, 0, new int{3});
+  q.insert(1, 1, new int{4});
+  EXPECT_EQ(completed.size(), 2);
+  
+  // so does an erase before the callback is registered, both below and
+  // above the erased watermark
+  q.erase(3);
+  q.erase(2);
+  q.on_complete(2, cb);
+  q.on_complete(3, cb);
+  q.erase(5);
+  q.on_complete(5, cb);
+  for( size_t b=2; b<6; ++b )
+  {
+    q.insert(b, 0, new int{5});
+    q.insert(b, 1, new int{6});
+  }
+  EXPECT_EQ(completed.size(), 2);
+  
+  // block 4 was never erased
+  q.on_complete(4, cb);
+  ASSERT_EQ(completed.size(), 3);
+  EXPECT_EQ(completed[2], 4);
+  EXPECT_EQ(q.missing_columns(4), 0);
+  q.insert(4, 1, std::shared_ptr<int>());
+  EXPECT_EQ(q.missing_columns(4), 1);
+}
+
+TEST_F(UtilTableCollectorTest, WakeUp)
+{
+  // a long check period would show up if get() polled
+  table_collector<int,5000> q(1);
+  ring_table_collector<int,5000> r(1, 4);
+  
+  std::thread publisher([&q,&r](){
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    q.insert(0, 0, new int{0});
+    r.insert(0, 0, new int{0});
+  });
+  
+  relative_time rt;
+  EXPECT_EQ(q.get(0,10000).second, 1);
+  EXPECT_EQ(r.get(0,10000).second, 1);
+  EXPECT_LT(rt.get_msec(), 2500);
+  publisher.join();
+  
+  // the timeout is not rounded up to the check period either
+  relative_time rt2;
+  EXPECT_EQ(q.get(1,10).second, 0);
+  EXPECT_LT(rt2.get_msec(), 2500);
+}
+
+TEST_F(UtilTableCollectorTest, RingBasic)
+{
+  ring_table_collector<int,10> q(2, 4);
+  EXPECT_EQ(q.window(), 4);
+  EXPECT_TRUE(q.insert(0, 0, new int{0}));
+  EXPECT_TRUE(q.insert(0, 1, new int{1}));
+  EXPECT_TRUE(q.insert(3, 1, new int{7}));
+  EXPECT_THROW(q.insert(1, 2, new int{2}), std::exception);
+  
+  EXPECT_EQ(q.missing_columns(0), 0);
+  EXPECT_EQ(q.missing_columns(3), 1);
+  EXPECT_EQ(q.max_block_id(), 3);
+  
+  {
+    auto row = q.get(0,1);
+    EXPECT_EQ(row.first.size(), 2);
+    EXPECT_EQ(row.second, 2);
+    EXPECT_EQ(*row.first[1], 1);
+  }
+  
+  // erasing a block that is not the first doesn't move the window
+  q.erase(1);
+  EXPECT_EQ(q.first_block_id(), 0);
+  q.erase(0);
+  EXPECT_EQ(q.first_block_id(), 2);
+  EXPECT_EQ(q.missing_columns(0), 2);
+  
+  // the slots of block 0 and 1 are reused by block 4 and 5
+  EXPECT_FALSE(q.insert(1, 0, new int{9}));
+  EXPECT_TRUE(q.insert(5, 0, new int{5}));
+  EXPECT_TRUE(q.insert(5, 1, new int{6}));
+  {
+    auto row = q.get(5,1);
+    EXPECT_EQ(row.second, 2);
+    EXPECT_EQ(*row.first[0], 5);
+  }
+  {
+    auto row = q.get(1,1);
+    EXPECT_EQ(row.second, 0);
+  }
+  EXPECT_EQ(q.n_dropped(), 1);
+}
+
+TEST_F(UtilTableCollectorTest, RingBackpressure)
+{
+  const size_t n_blocks = 200;
+  ring_table_collector<int,10> q(3, 4);
+  
+  std::thread publisher([&q,n_blocks](){
+    for( size_t b=0; b<n_blocks; ++b )
+      for( size_t c=0; c<3; ++c )
+        q.insert(b, c, new int(b));
+  });
+  
+  for( size_t b=0; b<n_blocks; ++b )
+  {
+    auto row = q.get(b,30000);
+    ASSERT_EQ(row.second, 3);
+    EXPECT_EQ(*row.first[2], b);
+    // the publisher can never get ahead more than the window
+    EXPECT_LT(q.max_block_id(), b+q.window());
+    q.erase(b);
+  }
+  publisher.join();
+  EXPECT_EQ(q.n_dropped(), 0);
+  EXPECT_GT(q.n_backpressure_waits(), 0);
+}
+
+TEST_F(UtilTableCollectorTest, RingOnComplete)
+{
+  ring_table_collector<int,10> q(2, 2);
+  std::atomic<size_t> n_completed{0};
+  auto cb = [&n_completed](size_t) { ++n_completed; };
+  
+  q.on_complete(1, cb);
+  q.on_complete(2, cb);
+  q.insert(1, 0, new int{0});
+  q.insert(1, 1, new int{1});
+  EXPECT_EQ(n_completed, 1);
+  q.on_complete(1, cb);
+  EXPECT_EQ(n_completed, 2);
+  
+  // block 2 is beyond the window, its callback waits for the window to
+  // reach it. block 0 has left the window by then
+  q.on_complete(2, cb);
+  q.on_complete(3, cb);
+  q.erase(0);
+  q.erase(1);
+  q.on_complete(0, cb);
+  q.insert(2, 0, new int{2});
+  q.insert(2, 1, new int{3});
+  EXPECT_EQ(n_completed, 4);
+  q.erase(2);
+  q.insert(3, 0, new int{4});
+  q.insert(3, 1, new int{5});
+  EXPECT_EQ(n_completed, 5);
+}
+
+TEST_F(UtilTableCollectorTest, RingResendWhileErasing)
+{
+  const size_t n_blocks  = 20000;
+  const size_t n_columns = 2;
+  ring_table_collector<int,10> q(n_columns, 2);
+  std::vector<std::atomic<int>> n_completed(n_blocks);
+  std::atomic<size_t> n_bad{0};
+  std::atomic<bool> done{false};
+  
+  std::thread publisher([&q,n_blocks,n_columns](){
+    for( size_t b=0; b<n_blocks; ++b )
+      for( size_t c=0; c<n_columns; ++c )
+        q.insert(b, c, new int(b));
+  });
+  
+  // resends of recent blocks, many of them race with erase() and the
+  // reuse of their slots by the next round
+  std::vector<std::thread> resenders;
+  for( size_t t=0; t<3; ++t )
+  {
+    resenders.push_back(std::thread([&q,&done,t,n_columns](){
+      size_t i = t;
+      while( !done )
+      {
+        // mostly the oldest block, the one being erased
+        size_t b = q.first_block_id();
+        if( i%4 == 3 && b > 0 ) --b;
+        q.insert(b, i % n_columns, new int(b));
+        ++i;
+      }
+    }));
+  }
+  
+  for( size_t b=0; b<n_blocks; ++b )
+  {
+    q.on_complete(b, [&q,&n_completed,&n_bad,n_columns](size_t id) {
+      ++n_completed[id];
+      auto row = q.get(id, 0);
+      if( row.second == n_columns )
+        for( auto const & c : row.first )
+          if( *c != (int)id ) ++n_bad;
+    });
+    
+    auto row = q.get(b, 30000);
+    ASSERT_EQ(row.second, n_columns);
+    for( auto const & c : row.first )
+      EXPECT_EQ(*c, (int)b);
+    EXPECT_LE(q.missing_columns(b), n_columns);
+    q.erase(b);
+  }
+  
+  done = true;
+  publisher.join();
+  for( auto & r : resenders ) r.join();
+  
+  EXPECT_EQ(n_bad, 0);
+  for( size_t b=0; b<n_blocks; ++b )
+    EXPECT_LE(n_completed[b], 1);
+  // the late resends were dropped, not stored in the next round
+  EXPECT_GT(q.n_dropped(), 0);
+}
+
+TEST_F(UtilTableCollectorTest, RingStop)
+{
+  ring_table_collector<int,10> q(1, 2);
+  q.insert(0, 0, new int{0});
+  q.insert(1, 0, new int{1});
+  
+  // blocks until stop() as block 0 and 1 are never erased
+  auto ret = std::async(std::launch::async, [&q](){ return q.insert(2, 0, new int{2}); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(30));
+  q.stop();
+  EXPECT_FALSE(ret.get());
+  EXPECT_EQ(q.get(2,1000).second, 0);
+}
+
+TEST_F(UtilObjectPoolTest, Recycle)
+{
+  typedef virtdb::interface::pb::Column column;
+  object_pool<column> pool{2};
+  
+  column * first = nullptr;
+  {
+    auto c = pool.get();
+    c->set_name("col");
+    c->set_compresseddata(std::string(1000, 'x'));
+    first = c.get();
+  }
+  EXPECT_EQ(pool.n_free(), 1);
+  
+  {
+    // the same object comes back, cleared
+    auto c = pool.get();
+    EXPECT_EQ(c.get(), first);
+    EXPECT_FALSE(c->has_name());
+    EXPECT_TRUE(c->compresseddata().empty());
+    
+    // the whole group goes back together, but only 2 are kept
+    std::vector<object_pool<column>::sptr> block{pool.get(), pool.get(), pool.get()};
+  }
+  EXPECT_EQ(pool.n_free(), 2);
+  EXPECT_EQ(pool.n_created(), 4);
+  EXPECT_EQ(pool.n_reused(), 1);
+}
+
+TEST_F(UtilObjectPoolTest, OutlivesPool)
+{
+  typedef virtdb::interface::pb::Column column;
+  object_pool<column>::sptr c;
+  {
+    object_pool<column> pool;
+    c = pool.get();
+    c->set_seqno(1);
+  }
+  // released after the pool is gone
+  EXPECT_EQ(c->seqno(), 1);
+  c.reset();
+}
+
+TEST_F(UtilNullBitmapTest, Basic)
+{
+  null_bitmap nb{200};
+  EXPECT_EQ(nb.size(), 200);
+  EXPECT_EQ(nb.n_words(), 4);
+  EXPECT_FALSE(nb.any(200));
+  EXPECT_EQ(nb.end_of_nulls(200), 0);
+  
+  nb[3] = true;
+  nb.set(64);
+  nb.set(130);
+  nb[199] = nb[3];
+  EXPECT_TRUE(nb[3]);
+  EXPECT_FALSE(nb[4]);
+  EXPECT_TRUE(nb.any(4));
+  EXPECT_FALSE(nb.any(3));
+  EXPECT_EQ(nb.end_of_nulls(200), 200);
+  EXPECT_EQ(nb.end_of_nulls(199), 131);
+  EXPECT_EQ(nb.end_of_nulls(64), 4);
+  
+  std::vector<size_t> rows;
+  nb.for_each_null(131, [&rows](size_t i) { rows.push_back(i); });
+  EXPECT_EQ(rows, (std::vector<size_t>{3, 64, 130}));
+  
+  // shrinking drops the bits past the end
+  nb.resize(100);
+  nb.resize(200);
+  EXPECT_FALSE(nb[130]);
+  EXPECT_FALSE(nb[199]);
+  EXPECT_EQ(nb.end_of_nulls(200), 65);
+  
+  nb[64] = false;
+  nb.reset();
+  EXPECT_FALSE(nb.any(200));
+}
+
+TEST_F(UtilMempoolTest, CachedRecycle)
+{
+  cached_mempool::flush_thread_cache();
+  auto before = cached_mempool::get_stats();
+  char * first = nullptr;
+  {
+    cached_mempool pool{10000};
+    first = pool.allocate<char>(100);
+    // grows into a second chunk
+    pool.allocate<char>(20000);
+    EXPECT_GE(pool.allocated_bytes(), 30000);
+  }
+  auto mid = cached_mempool::get_stats();
+  EXPECT_GT(mid.allocated_bytes_, before.allocated_bytes_);
+  EXPECT_GE(mid.cached_bytes_, before.cached_bytes_+30000);
+  
+  {
+    // same size class comes from this thread's cache
+    cached_mempool pool{10000};
+    EXPECT_EQ(pool.allocate<char>(100), first);
+  }
+  auto after = cached_mempool::get_stats();
+  EXPECT_EQ(after.allocated_bytes_, mid.allocated_bytes_);
+  EXPECT_GT(after.reused_bytes_, mid.reused_bytes_);
+}
+
+TEST_F(UtilMempoolTest, CachedAcrossThreads)
+{
+  // chunks released by an exiting thread are reused by others
+  std::thread([](){
+    cached_mempool pool{300000};
+    pool.allocate<char>(1000);
+  }).join();
+  
+  auto before = cached_mempool::get_stats();
+  {
+    cached_mempool pool{300000};
+    pool.allocate<char>(1000);
+  }
+  auto after = cached_mempool::get_stats();
+  EXPECT_EQ(after.allocated_bytes_, before.allocated_bytes_);
+  EXPECT_GT(after.reused_bytes_, before.reused_bytes_);
+}
+
 UtilActiveQueueTest::UtilActiveQueueTest()
 : value_(0),
   queue_(10,[this](int v){ value_ += v; })
@@ -296,6 +831,56 @@ TEST_F(UtilActiveQueueTest, AddNumbers)
   EXPECT_EQ( this->value_, 50005000 );
 }
 
+TEST_F(UtilActiveQueueTest, LockFreeAddNumbers)
+{
+  std::atomic<int> value{0};
+  active_queue<int,100,64> q{4,[&value](int v){ value += v; }};
+  
+  // more items than the capacity, so push has to wait for the workers
+  for( int i=1; i<=10000; ++i )
+    q.push(i);
+  
+  EXPECT_TRUE( q.wait_empty(std::chrono::milliseconds(20000)) );
+  q.stop();
+  EXPECT_TRUE( q.stopped() );
+  EXPECT_EQ( q.n_enqueued(), 10000 );
+  EXPECT_EQ( q.n_done(), 10000 );
+  EXPECT_EQ( value, 50005000 );
+}
+
+TEST_F(UtilWorkStealingQueueTest, AddNumbers)
+{
+  std::atomic<int> value{0};
+  work_stealing_queue<int,100> q{8,[&value](int v){ value += v; }};
+  
+  for( int i=1; i<=10000; ++i )
+    q.push(i);
+  
+  EXPECT_TRUE( q.wait_empty(std::chrono::milliseconds(20000)) );
+  q.stop();
+  EXPECT_TRUE( q.stopped() );
+  EXPECT_EQ( q.n_done(), 10000 );
+  EXPECT_EQ( value, 50005000 );
+}
+
+TEST_F(UtilWorkStealingQueueTest, Steal)
+{
+  std::atomic<int> n_done{0};
+  work_stealing_queue<int,100> q{2,[&n_done](int v){
+    // items pushed to the first deque are slow, so the second
+    // worker has to steal them
+    if( v%2 == 0 ) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    ++n_done;
+  }};
+  
+  for( int i=0; i<100; ++i )
+    q.push(i);
+  
+  EXPECT_TRUE( q.wait_empty(std::chrono::milliseconds(5000)) );
+  EXPECT_EQ( n_done, 100 );
+  EXPECT_GT( q.n_stolen(), 0 );
+}
+
 TEST_F(UtilActiveQueueTest, Stop3Times)
 {
   this->queue_.stop();
@@ -395,7 +980,7 @@ TEST_F(UtilZmqTest, TestValid)
   {
     std::promise<bool> prom;
     std::future<bool> fut(prom.get_future());
-
+    
     std::thread valid_thread([&](){
       prom.set_value(srv.wait_valid(100));
     });
@@ -522,6 +1107,30 @@ TEST_F(UtilZmqTest, DeleteWhileWaitingForEver)
 }
 
 
+TEST_F(UtilZmqTest, SerializeToMessage)
+{
+  using namespace virtdb::interface;
+  
+  pb::Column col;
+  col.set_queryid("query");
+  col.set_name("serialized");
+  col.set_seqno(42);
+  col.mutable_data()->set_type(pb::Kind::STRING);
+  
+  zmq::message_t msg;
+  EXPECT_FALSE(zmq_socket_wrapper::serialize_to_message(col, 0, msg));
+  
+  int byte_size = col.ByteSize();
+  EXPECT_TRUE(zmq_socket_wrapper::serialize_to_message(col, byte_size, msg));
+  EXPECT_EQ(msg.size(), (size_t)byte_size);
+  
+  pb::Column parsed;
+  EXPECT_TRUE(parsed.ParseFromArray(msg.data(), msg.size()));
+  EXPECT_EQ(parsed.name(), "serialized");
+  EXPECT_EQ(parsed.seqno(), 42);
+}
+
+
 TEST_F(UtilUtf8Test, Valid)
 {
   char simple[] = u8"árvíztűrő tükörfúrógép. ÁRVÍZTŰRŐ TÜKÖRFÚRÓGÉP";
@@ -694,3 +1303,36 @@ TEST_F(UtilUtf8Test, Garbage)
   EXPECT_EQ(str2, str);
 }
 
+
+TEST_F(UtilUtf8Test, LongAsciiRuns)
+{
+  // long enough for the vectorized ASCII skipping
+  std::string str(100, 'a');
+  str[40] = 0;
+  str[70] = (char)0x80;
+  str += u8"árvíztűrő";
+  std::string expected{str};
+  expected[40] = ' ';
+  expected[70] = ' ';
+  
+  EXPECT_FALSE(utf8::valid(str.data(), str.size()));
+  utf8::sanitize(&str[0], str.size());
+  EXPECT_EQ(expected, str);
+  EXPECT_TRUE(utf8::valid(str.data(), str.size()));
+  EXPECT_EQ(utf8::ascii_prefix(str.data(), str.size()), 100);
+}
+
+TEST_F(UtilUtf8Test, Arena)
+{
+  // a sequence must not be completed by the next value
+  char tb = 128+64;
+  char c  = 128+1;
+  std::string arena{"hello"};
+  arena += tb;
+  arena += c;
+  arena += "world";
+  std::vector<uint32_t> offsets{0, 6, 6, 12};
+  
+  utf8::sanitize(&arena[0], offsets.data(), 3);
+  EXPECT_EQ(arena, "hello  world");
+}
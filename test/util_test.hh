@@ -27,12 +27,17 @@ namespace virtdb { namespace test {
     util::barrier barrier_;
   };
   
+  class UtilWorkStealingQueueTest : public ::testing::Test { };
+  
   class UtilNetTest : public ::testing::Test { };
   class UtilFlexAllocTest : public ::testing::Test { };
   class UtilAsyncWorkerTest : public ::testing::Test { };
   class UtilCompareMessagesTest : public ::testing::Test { };
   class UtilZmqTest : public ::testing::Test { };
   class UtilTableCollectorTest : public ::testing::Test { };
+  class UtilObjectPoolTest : public ::testing::Test { };
+  class UtilMempoolTest : public ::testing::Test { };
+  class UtilNullBitmapTest : public ::testing::Test { };
   class UtilUtf8Test : public ::testing::Test { };
   class UtilHashFileTest : public ::testing::Test { };
   class UtilLZ4UtilTest : public ::testing::Test { };
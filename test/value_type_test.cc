@@ -3,6 +3,7 @@
 #include <util/value_type_reader.hh>
 #include <util/value_type_writer.hh>
 #include <util/mempool.hh>
+#include <util/null_bitmap.hh>
 #include <google/protobuf/io/coded_stream.h>
 #include <logger.hh>
 #include <list>
@@ -381,6 +382,147 @@ TEST_F(ValueTypeWriterTest, SimpleDate_Writer)
 }
 
 
+namespace
+{
+  void compare_writer(const pb::ValueType & vt,
+                      value_type_writer::sptr wr)
+  {
+    int message_size = vt.ByteSize();
+    std::unique_ptr<char []> buf(new char[message_size]);
+    EXPECT_TRUE(vt.SerializeToArray(buf.get(),message_size));
+    auto result = copy_parts(wr);
+    EXPECT_EQ(message_size, result.second);
+    if( message_size != result.second )
+    {
+      print_parts(wr);
+      print_compare(std::make_pair(buf.get(),
+                                   message_size),
+                    std::make_pair(result.first.get(),
+                                   result.second));
+    }
+    EXPECT_EQ(::memcmp(buf.get(),
+                       result.first.get(),
+                       std::min(message_size,
+                                result.second)),0);
+  }
+}
+
+TEST_F(ValueTypeWriterTest, Int64Batch_Writer)
+{
+  // small estimate, so the batches need more write and null areas
+  const size_t n = 100000;
+  std::vector<int64_t> values;
+  std::unique_ptr<bool []> nulls{new bool[n]};
+  pb::ValueType vt;
+  vt.set_type(pb::Kind::INT64);
+  for( size_t i=0; i<n; ++i )
+  {
+    values.push_back((int64_t)i*(i%2?-1000:1000));
+    nulls[i] = (i%3 == 0 || (i > 5000 && i < 5100));
+    vt.add_int64value(nulls[i] ? 0 : values[i]);
+    if( nulls[i] )
+      value_type_base::set_null(vt, i);
+  }
+  
+  auto wr = value_type_writer::construct(pb::Kind::INT64, 1000);
+  {
+    MEASURE_ME("Int64 - 100000 - Batch Writer");
+    // mixing single values and uneven batches
+    wr->write_int64(values[0]);
+    wr->set_null(0);
+    size_t pos = 1;
+    while( pos < n )
+    {
+      size_t chunk = std::min(n-pos, (size_t)777);
+      wr->write_int64_batch(values.data()+pos, nulls.get()+pos, chunk);
+      pos += chunk;
+    }
+  }
+  EXPECT_EQ(n, wr->n_items());
+  compare_writer(vt, wr);
+}
+
+TEST_F(ValueTypeWriterTest, DoubleBatch_Writer)
+{
+  const size_t n = 100000;
+  std::vector<double> values;
+  std::unique_ptr<bool []> nulls{new bool[n]};
+  pb::ValueType vt;
+  vt.set_type(pb::Kind::DOUBLE);
+  for( size_t i=0; i<n; ++i )
+  {
+    values.push_back(1.5+i);
+    nulls[i] = (i%7 == 0);
+    vt.add_doublevalue(nulls[i] ? 0.0 : values[i]);
+    if( nulls[i] )
+      value_type_base::set_null(vt, i);
+  }
+  
+  auto wr = value_type_writer::construct(pb::Kind::DOUBLE, 1000);
+  {
+    MEASURE_ME("Double - 100000 - Batch Writer");
+    wr->write_double_batch(values.data(), nulls.get(), n/2);
+    wr->write_double_batch(values.data()+n/2, nulls.get()+n/2, n-n/2);
+  }
+  EXPECT_EQ(n, wr->n_items());
+  compare_writer(vt, wr);
+}
+
+TEST_F(ValueTypeWriterTest, StringBatch_Writer)
+{
+  const size_t n = 100000;
+  std::string arena;
+  std::vector<uint32_t> offsets{0};
+  std::unique_ptr<bool []> nulls{new bool[n]};
+  pb::ValueType vt;
+  vt.set_type(pb::Kind::STRING);
+  for( size_t i=0; i<n; ++i )
+  {
+    std::string s = "Hello World " + std::to_string(i) + std::string(i%200, 'x');
+    arena += s;
+    offsets.push_back(arena.size());
+    nulls[i] = (i%3 == 0);
+    vt.add_stringvalue(nulls[i] ? std::string() : s);
+    if( nulls[i] )
+      value_type_base::set_null(vt, i);
+  }
+  
+  auto wr = value_type_writer::construct(pb::Kind::STRING, 10);
+  {
+    MEASURE_ME("String - 100000 - Batch Writer");
+    for( size_t pos=0; pos<n; pos+=1000 )
+      wr->write_strings(arena.data(), offsets.data()+pos, nulls.get()+pos, 1000);
+  }
+  EXPECT_EQ(n, wr->n_items());
+  compare_writer(vt, wr);
+}
+
+
+TEST_F(ValueTypeWriterTest, NullBits_Writer)
+{
+  const size_t n = 100000;
+  std::vector<int64_t> values;
+  null_bitmap nulls{n};
+  pb::ValueType vt;
+  vt.set_type(pb::Kind::INT64);
+  for( size_t i=0; i<n; ++i )
+  {
+    bool null = (i%5 == 0 || (i > 70000 && i < 70200));
+    values.push_back(null ? 0 : (int64_t)i);
+    nulls.set(i, null);
+    vt.add_int64value(values[i]);
+    if( null )
+      value_type_base::set_null(vt, i);
+  }
+  
+  auto wr = value_type_writer::construct(pb::Kind::INT64, 1000);
+  for( size_t pos=0; pos<n; pos+=10000 )
+    wr->write_int64_batch(values.data()+pos, nullptr, 10000);
+  wr->set_null_bits(0, nulls.words(), n);
+  EXPECT_EQ(n, wr->n_items());
+  compare_writer(vt, wr);
+}
+
 TEST_F(ValueTypeReaderTest, Empty)
 {
   std::unique_ptr<char[]> buffer;
@@ -555,6 +697,51 @@ TEST_F(ValueTypeReaderTest, String)
 }
 
 
+TEST_F(ValueTypeReaderTest, NullBits)
+{
+  // not a multiple of 8 or 64, so both decoding paths are used
+  const size_t n = 1003;
+  pb::ValueType vt;
+  vt.set_type(pb::Kind::INT32);
+  std::vector<bool> expected;
+  for( size_t i=0; i<n; ++i )
+  {
+    bool null = (i%9 == 0 || i == n-1);
+    vt.add_int32value(0);
+    if( null )
+      value_type_base::set_null(vt, i);
+    expected.push_back(null);
+  }
+  
+  int buffer_size = vt.ByteSize();
+  std::unique_ptr<char[]> buffer{new char[buffer_size]};
+  ASSERT_TRUE(vt.SerializeToArray(buffer.get(), buffer_size));
+  auto rdr = value_type_reader::construct(std::move(buffer), buffer_size);
+  EXPECT_EQ(rdr->n_nulls(), n);
+  
+  for( size_t first : { (size_t)0, (size_t)13, (size_t)64, (size_t)1000 } )
+  {
+    size_t cnt = n-first+10;
+    std::vector<uint64_t> bits((cnt+63)/64, ~0ULL);
+    size_t n_nulls = rdr->copy_null_bits(first, cnt, bits.data());
+    size_t check = 0;
+    for( size_t i=0; i<cnt; ++i )
+    {
+      bool null = ((bits[i/64] >> (i%64)) & 1) != 0;
+      bool exp = (first+i < n) && expected[first+i];
+      EXPECT_EQ(exp, null) << "row " << first+i;
+      check += exp;
+    }
+    EXPECT_EQ(check, n_nulls);
+  }
+  
+  EXPECT_TRUE(rdr->read_null());
+  std::vector<uint8_t> null_bytes(n-1);
+  rdr->read_null_batch(null_bytes.data(), n-1);
+  for( size_t i=1; i<n; ++i )
+    EXPECT_EQ(expected[i], null_bytes[i-1] != 0) << "row " << i;
+}
+
 TEST_F(ValueTypeReaderTest, Int32)
 {
   pb::ValueType vt;
@@ -583,7 +770,7 @@ TEST_F(ValueTypeReaderTest, Int32)
     is.ReadVarint32(&typ);
     EXPECT_EQ(tag, 1<<3);
     EXPECT_TRUE( typ >= 2 && typ <= 18 );
-
+    
     {
       tag = is.ReadTag();
       EXPECT_EQ(tag,((3<<3)+2));
@@ -682,6 +869,109 @@ TEST_F(ValueTypeReaderTest, Int32)
   }
 }
 
+TEST_F(ValueTypeReaderTest, Int32Batch)
+{
+  pb::ValueType vt;
+  fill_int32(vt);
+  int64_t check_val = 0;
+  
+  for( auto const & i : vt.int32value() )
+    check_val += i;
+  
+  int buffer_size = vt.ByteSize();
+  std::unique_ptr<char[]> buffer{new char[buffer_size]};
+  ASSERT_TRUE(vt.SerializeToArray(buffer.get(), buffer_size));
+  
+  {
+    MEASURE_ME("Int32 value type reader - batch sum");
+    auto rdr = value_type_reader::construct(std::move(buffer), buffer_size);
+    
+    const size_t batch_size = 4096;
+    std::unique_ptr<int32_t[]> values{new int32_t[batch_size]};
+    std::unique_ptr<uint8_t[]> nulls{new uint8_t[batch_size]};
+    
+    int64_t val = 0;
+    size_t n_read = 0;
+    size_t n_null = 0;
+    size_t n = 0;
+    while( (n = rdr->read_int32_batch(values.get(), nulls.get(), batch_size)) > 0 )
+    {
+      for( size_t i=0; i<n; ++i )
+      {
+        EXPECT_EQ(values[i], (int32_t)(n_read+i)-500000);
+        val += values[i];
+        n_null += nulls[i];
+      }
+      n_read += n;
+    }
+    
+    EXPECT_EQ(n_read, 1000000);
+    EXPECT_EQ(n_null, 2);
+    EXPECT_EQ(val, check_val);
+    EXPECT_FALSE(rdr->has_more());
+    
+    // type mismatch
+    double d = 0;
+    EXPECT_EQ(rdr->read_double_batch(&d, nullptr, 1), 0);
+  }
+}
+
+TEST_F(ValueTypeReaderTest, DoubleBatch)
+{
+  pb::ValueType vt;
+  fill_double(vt);
+  
+  int buffer_size = vt.ByteSize();
+  std::unique_ptr<char[]> buffer{new char[buffer_size]};
+  ASSERT_TRUE(vt.SerializeToArray(buffer.get(), buffer_size));
+  
+  auto rdr = value_type_reader::construct(std::move(buffer), buffer_size);
+  std::vector<double> values(1000001, 0.0);
+  std::vector<uint8_t> nulls(1000001, 0);
+  
+  // odd batch size to check the continuation
+  size_t n_read = 0;
+  size_t n = 0;
+  while( (n = rdr->read_double_batch(&values[n_read], &nulls[n_read], 333)) > 0 )
+    n_read += n;
+  
+  EXPECT_EQ(n_read, 1000000);
+  for( size_t i=0; i<n_read; ++i )
+  {
+    EXPECT_DOUBLE_EQ(values[i], 1.0+i);
+    EXPECT_EQ(nulls[i], (i == 3 || i == 999999) ? 1 : 0);
+  }
+}
+
+TEST_F(ValueTypeReaderTest, StringBatch)
+{
+  pb::ValueType vt;
+  fill_string(vt);
+  
+  int buffer_size = vt.ByteSize();
+  std::unique_ptr<char[]> buffer{new char[buffer_size]};
+  ASSERT_TRUE(vt.SerializeToArray(buffer.get(), buffer_size));
+  
+  auto rdr = value_type_reader::construct(std::move(buffer), buffer_size);
+  const size_t batch_size = 1000;
+  char * ptrs[batch_size];
+  size_t lens[batch_size];
+  
+  size_t n_read = 0;
+  size_t n = 0;
+  while( (n = rdr->read_string_batch(ptrs, lens, nullptr, batch_size)) > 0 )
+  {
+    for( size_t i=0; i<n; ++i )
+    {
+      EXPECT_EQ(lens[i], 11);
+      EXPECT_EQ('H', *ptrs[i]);
+    }
+    n_read += n;
+  }
+  EXPECT_EQ(n_read, 1000000);
+  EXPECT_EQ(rdr->null_pos(), 1000000);
+}
+
 TEST_F(ValueTypeTest, TestString)
 {
   typedef std::string val_t;
@@ -3,6 +3,7 @@
 #include "util/exception.hh"
 #include "util/barrier.hh"
 #include "util/active_queue.hh"
+#include "util/work_stealing_queue.hh"
 #include "util/relative_time.hh"
 #include "util/net.hh"
 #include "util/flex_alloc.hh"
@@ -12,8 +13,12 @@
 #include "util/value_type.hh"
 #include "util/constants.hh"
 #include "util/table_collector.hh"
+#include "util/ring_table_collector.hh"
 #include "util/timer_service.hh"
 #include "util/utf8.hh"
 #include "util/value_type_reader.hh"
 #include "util/mempool.hh"
+#include "util/cached_mempool.hh"
+#include "util/object_pool.hh"
+#include "util/null_bitmap.hh"
 
@@ -3,6 +3,7 @@
 #include <util/barrier.hh>
 #include <util/exception.hh>
 #include <util/constants.hh>
+#include <util/mpmc_queue.hh>
 
 #include <queue>
 #include <thread>
@@ -17,8 +18,16 @@
 
 namespace virtdb { namespace util {
 
-  template <typename ITEM, unsigned long WAKEUP_FREQ=DEFAULT_TIMEOUT_MS>
-  class active_queue final
+  // LOCK_FREE_CAPACITY == 0 : unbounded queue under a mutex
+  // LOCK_FREE_CAPACITY  > 0 : bounded lock-free queue, push() waits
+  //                           while the queue is full
+  template <typename ITEM,
+            unsigned long WAKEUP_FREQ=DEFAULT_TIMEOUT_MS,
+            size_t LOCK_FREE_CAPACITY=0>
+  class active_queue;
+  
+  template <typename ITEM, unsigned long WAKEUP_FREQ>
+  class active_queue<ITEM, WAKEUP_FREQ, 0> final
   {
   public:
     typedef std::function<void(ITEM)> item_handler;
@@ -238,4 +247,224 @@ namespace virtdb { namespace util {
     }
   };
 
+  template <typename ITEM,
+            unsigned long WAKEUP_FREQ,
+            size_t LOCK_FREE_CAPACITY>
+  class active_queue final
+  {
+  public:
+    typedef std::function<void(ITEM)> item_handler;
+    
+  private:
+    typedef std::mutex                             mtx;
+    typedef mpmc_queue<ITEM,LOCK_FREE_CAPACITY>    q;
+    typedef std::condition_variable                cond;
+    typedef std::vector<std::thread>               thread_vector;
+    typedef std::atomic<bool>                      flag;
+    typedef std::atomic<uint64_t>                  counter;
+    typedef std::unique_lock<mtx>                  lock;
+    
+    active_queue() = delete;
+    active_queue(const active_queue&) = delete;
+    active_queue & operator=(const active_queue &) = delete;
+    
+    // the mutexes are only taken when a thread sleeps or waits
+    // for progress, push and pop don't need them
+    mutable mtx     mutex_;
+    cond            cond_;
+    mutable mtx     progress_mutex_;
+    cond            progress_cond_;
+    counter         enqueued_;
+    counter         done_;
+    counter         n_sleeping_;
+    counter         n_progress_waiting_;
+    q               queue_;
+    barrier         barrier_;
+    item_handler    handler_;
+    thread_vector   threads_;
+    flag            stop_;
+    
+  public:
+    static const unsigned int wakeup_freq() { return WAKEUP_FREQ; }
+    static constexpr size_t capacity() { return LOCK_FREE_CAPACITY; }
+    
+    active_queue(unsigned int nthreads, item_handler handler)
+    : enqueued_{0},
+      done_{0},
+      n_sleeping_{0},
+      n_progress_waiting_{0},
+      barrier_(nthreads+1),
+      handler_(handler),
+      stop_(false)
+    {
+      // starting all threads in the constructor
+      for( unsigned int i=0; i<nthreads; ++i )
+      {
+        threads_.push_back(std::move(std::thread(std::bind(&active_queue::entry,this))));
+      }
+      
+      // this won't return till all threads are ready
+      barrier_.wait();
+      
+      // give a chance to the workers to reach wait() before this
+      // thread start sending in the items
+      std::this_thread::yield();
+    }
+    
+    uint64_t n_done() const
+    {
+      return done_.load();
+    }
+    
+    uint64_t n_enqueued() const
+    {
+      return enqueued_.load();
+    }
+    
+    void push(const ITEM & i)
+    {
+      ITEM tmp{i};
+      push(std::move(tmp));
+    }
+    
+    void push(ITEM && i)
+    {
+      if( stopped() ) return;
+      ++enqueued_;
+      
+      // the queue is bounded, wait for the workers to make room
+      while( !queue_.try_push(i) )
+      {
+        if( stopped() )
+        {
+          --enqueued_;
+          return;
+        }
+        std::this_thread::yield();
+      }
+      
+      // only pay for the notification when a worker sleeps
+      if( n_sleeping_ > 0 )
+      {
+        lock l(mutex_);
+        cond_.notify_one();
+      }
+    }
+    
+    bool stopped() const
+    {
+      return stop_;
+    }
+    
+    template <typename T>
+    bool wait_empty(const T & progress_for)
+    {
+      uint64_t enqueued_items = enqueued_;
+      uint64_t done_items     = done_;
+      
+      while( enqueued_items > done_items && !stopped() )
+      {
+        uint64_t last_done = done_items;
+        std::cv_status cvstat = std::cv_status::no_timeout;
+        
+        {
+          lock l(progress_mutex_);
+          ++n_progress_waiting_;
+          
+          if( enqueued_ > done_ )
+          {
+            // give time to the threads to progress
+            cvstat = progress_cond_.wait_for(l, progress_for);
+          }
+          
+          --n_progress_waiting_;
+          enqueued_items = enqueued_;
+          done_items     = done_;
+        }
+        
+        // if no progress has been made, then stop waiting for them
+        if( last_done == done_items &&
+            cvstat == std::cv_status::timeout )
+        {
+          break;
+        }
+      }
+      
+      return (enqueued_items == done_items);
+    }
+    
+    void stop()
+    {
+      stop_ = true;
+      {
+        lock l(mutex_);
+        cond_.notify_all();
+      }
+      {
+        lock l(progress_mutex_);
+        progress_cond_.notify_all();
+      }
+      for( auto & t : threads_ )
+      {
+        if( t.joinable() )
+          t.join();
+      }
+    }
+    
+    ~active_queue()
+    {
+      stop();
+    }
+    
+  private:
+    void sleep()
+    {
+      lock l(mutex_);
+      ++n_sleeping_;
+      if( queue_.empty() && !stopped() )
+      {
+        cond_.wait_for(l,std::chrono::milliseconds(WAKEUP_FREQ));
+      }
+      --n_sleeping_;
+    }
+    
+    void entry()
+    {
+      // synchronize between the threads and the constructor
+      barrier_.wait();
+      
+      // check if we can still run
+      while( !stopped() )
+      {
+        ITEM tmp;
+        if( !queue_.try_pop(tmp) )
+        {
+          sleep();
+          continue;
+        }
+        
+        try
+        {
+          handler_(tmp);
+        }
+        catch( const std::exception & e )
+        {
+          std::cerr << "exception caught: " << e.what() << "\n";
+        }
+        catch(...)
+        {
+          std::cerr << "unknown exception caught\n";
+        }
+        
+        // signal wait_empty, no matter what the result was
+        ++done_;
+        if( n_progress_waiting_ > 0 )
+        {
+          lock l(progress_mutex_);
+          progress_cond_.notify_all();
+        }
+      }
+    }
+  };
+
 }}
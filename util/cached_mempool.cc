@@ -0,0 +1,273 @@
+#include <util/cached_mempool.hh>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace virtdb { namespace util {
+
+  namespace
+  {
+    typedef long long chunk_item;
+    typedef std::vector<chunk_item *> chunk_list;
+    
+    // class c holds (min_items/4)*(4+c%4) << c/4 items: 4KB, 5KB, 6KB,
+    // 7KB, 8KB, 10KB ... 8MB
+    const size_t min_items       = 512;
+    const size_t n_doublings     = 11;
+    const size_t n_classes       = (4*n_doublings)+1;
+    const size_t max_items       = min_items << n_doublings;
+    
+    // per thread limits, the rest goes to the global list
+    const size_t thread_chunks_per_class  = 2;
+    const size_t thread_max_bytes         = 8*1024*1024;
+    
+    inline size_t
+    class_size(size_t c)
+    {
+      return ((min_items/4)*(4+(c&3))) << (c/4);
+    }
+    
+    inline size_t
+    class_of(size_t n_items)
+    {
+      if( n_items <= min_items ) return 0;
+      size_t e = 0;
+      while( (min_items << (e+1)) < n_items ) ++e;
+      size_t base = min_items << e;
+      size_t step = base/4;
+      size_t k = ((n_items-base)+step-1)/step;
+      return (4*e)+k;
+    }
+    
+    struct global_cache
+    {
+      std::mutex              mtx_;
+      chunk_list              free_[n_classes];
+      size_t                  bytes_;
+      std::atomic<size_t>     max_bytes_;
+      std::atomic<uint64_t>   allocated_;
+      std::atomic<uint64_t>   reused_;
+      std::atomic<uint64_t>   freed_;
+      std::atomic<uint64_t>   cached_;
+      
+      global_cache()
+      : bytes_{0},
+        max_bytes_{64*1024*1024},
+        allocated_{0},
+        reused_{0},
+        freed_{0},
+        cached_{0}
+      {
+      }
+    };
+    
+    global_cache &
+    global()
+    {
+      // never destroyed, so thread caches can flush into it at exit
+      static global_cache * instance = new global_cache;
+      return *instance;
+    }
+    
+    void
+    free_chunk(chunk_item * p,
+               size_t bytes)
+    {
+      delete [] p;
+      global().freed_ += bytes;
+    }
+    
+    // puts the chunk on the global list or frees it if that's full
+    void
+    give_global(chunk_item * p,
+                size_t c)
+    {
+      global_cache & g = global();
+      size_t bytes = class_size(c)*sizeof(chunk_item);
+      {
+        std::lock_guard<std::mutex> l(g.mtx_);
+        if( g.bytes_+bytes <= g.max_bytes_ )
+        {
+          g.free_[c].push_back(p);
+          g.bytes_ += bytes;
+          g.cached_ += bytes;
+          return;
+        }
+      }
+      free_chunk(p, bytes);
+    }
+    
+    struct thread_cache
+    {
+      chunk_list   free_[n_classes];
+      size_t       bytes_;
+      
+      thread_cache() : bytes_{0} {}
+      
+      void flush()
+      {
+        for( size_t c=0; c<n_classes; ++c )
+        {
+          for( auto p : free_[c] )
+          {
+            global().cached_ -= class_size(c)*sizeof(chunk_item);
+            give_global(p, c);
+          }
+          free_[c].clear();
+        }
+        bytes_ = 0;
+      }
+      
+      ~thread_cache()
+      {
+        flush();
+      }
+    };
+    
+    thread_cache &
+    local()
+    {
+      static thread_local thread_cache instance;
+      return instance;
+    }
+  }
+
+  cached_mempool::chunk
+  cached_mempool::acquire(size_t n_items)
+  {
+    global_cache & g = global();
+    if( n_items > max_items )
+    {
+      g.allocated_ += n_items*sizeof(chunk_item);
+      return chunk{new item[n_items], n_items};
+    }
+    
+    size_t c      = class_of(n_items);
+    size_t n      = class_size(c);
+    size_t bytes  = n*sizeof(chunk_item);
+    
+    // this thread's cache first, no locking needed
+    thread_cache & tc = local();
+    if( !tc.free_[c].empty() )
+    {
+      item * ret = tc.free_[c].back();
+      tc.free_[c].pop_back();
+      tc.bytes_ -= bytes;
+      g.cached_ -= bytes;
+      g.reused_ += bytes;
+      return chunk{ret, n};
+    }
+    
+    {
+      std::lock_guard<std::mutex> l(g.mtx_);
+      if( !g.free_[c].empty() )
+      {
+        item * ret = g.free_[c].back();
+        g.free_[c].pop_back();
+        g.bytes_ -= bytes;
+        g.cached_ -= bytes;
+        g.reused_ += bytes;
+        return chunk{ret, n};
+      }
+    }
+    
+    g.allocated_ += bytes;
+    return chunk{new item[n], n};
+  }
+
+  void
+  cached_mempool::release(item * p,
+                          size_t n_items)
+  {
+    if( !p ) return;
+    
+    if( n_items > max_items )
+    {
+      free_chunk(p, n_items*sizeof(chunk_item));
+      return;
+    }
+    
+    // the chunk was allocated with the rounded up size
+    size_t c      = class_of(n_items);
+    size_t bytes  = class_size(c)*sizeof(chunk_item);
+    
+    thread_cache & tc = local();
+    if( tc.free_[c].size() < thread_chunks_per_class &&
+        tc.bytes_+bytes <= thread_max_bytes )
+    {
+      tc.free_[c].push_back(p);
+      tc.bytes_ += bytes;
+      global().cached_ += bytes;
+      return;
+    }
+    
+    give_global(p, c);
+  }
+
+  cached_mempool::cached_mempool(size_t byte_size,
+                                 size_t next_size)
+  : cached_mempool(acquire(aligned_size(byte_size)), next_size)
+  {
+  }
+
+  cached_mempool::cached_mempool(chunk c,
+                                 size_t next_size)
+  : mempool(c.first, c.second, next_size)
+  {
+  }
+
+  cached_mempool::~cached_mempool()
+  {
+    // mempool's destructor wouldn't reach our delete_items
+    clear();
+  }
+
+  mempool::item *
+  cached_mempool::allocate_items(size_t n)
+  {
+    return acquire(n).first;
+  }
+
+  void
+  cached_mempool::delete_items(item * p,
+                               size_t n)
+  {
+    release(p, n);
+  }
+
+  mempool *
+  cached_mempool::allocate_pool(size_t byte_size,
+                                size_t next_size)
+  {
+    return new cached_mempool(byte_size, next_size);
+  }
+
+  cached_mempool::stats
+  cached_mempool::get_stats()
+  {
+    global_cache & g = global();
+    return stats{g.allocated_.load(),
+                 g.reused_.load(),
+                 g.freed_.load(),
+                 g.cached_.load()};
+  }
+
+  void
+  cached_mempool::max_cached_bytes(size_t sz)
+  {
+    global().max_bytes_ = sz;
+  }
+
+  size_t
+  cached_mempool::max_cached_bytes()
+  {
+    return global().max_bytes_.load();
+  }
+
+  void
+  cached_mempool::flush_thread_cache()
+  {
+    local().flush();
+  }
+
+}}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <util/mempool.hh>
+#include <utility>
+#include <cstdint>
+
+namespace virtdb { namespace util {
+
+  // mempool with size classed chunks that are recycled instead of freed.
+  // released chunks go to a small per thread cache first (no locking),
+  // then to a global free list shared by all threads, so the short lived
+  // pools of value_type_writer mostly reuse memory other writers gave back.
+  // chunk sizes are rounded up to 4 classes per power of two, chunks over
+  // 8MB are not cached
+  class cached_mempool : public mempool
+  {
+  public:
+    struct stats
+    {
+      uint64_t allocated_bytes_;   // chunks taken from the system
+      uint64_t reused_bytes_;      // chunks served from the caches
+      uint64_t freed_bytes_;       // chunks given back to the system
+      uint64_t cached_bytes_;      // chunks waiting in the caches now
+    };
+    
+    typedef std::shared_ptr<cached_mempool> sptr;
+    
+    cached_mempool(size_t byte_size, size_t next_size=0);
+    virtual ~cached_mempool();
+    
+    static stats get_stats();
+    
+    // limit of the global free list, chunks over this are freed
+    static void max_cached_bytes(size_t sz);
+    static size_t max_cached_bytes();
+    
+    // moves this thread's cached chunks to the global free list. this
+    // also happens when the thread exits
+    static void flush_thread_cache();
+    
+  protected:
+    virtual item * allocate_items(size_t n);
+    virtual void delete_items(item * p, size_t n);
+    virtual mempool * allocate_pool(size_t byte_size, size_t next_size);
+    
+  private:
+    typedef std::pair<item *, size_t> chunk;
+    
+    // returns the chunk and its real size in items
+    static chunk acquire(size_t n_items);
+    static void release(item * p, size_t n_items);
+    
+    cached_mempool(chunk c, size_t next_size);
+    
+    cached_mempool() = delete;
+    cached_mempool(const cached_mempool &) = delete;
+    cached_mempool& operator=(const cached_mempool &) = delete;
+  };
+  
+}}
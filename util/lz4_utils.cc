@@ -1,4 +1,448 @@
 #include <util/lz4_utils.hh>
+#include <util/exception.hh>
+#include <lz4/lib/lz4.h>
+#include <lz4/lib/lz4hc.h>
+#include <xxhash.h>
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <unordered_map>
 
 namespace virtdb { namespace util {
+  
+  namespace
+  {
+    // a valid standalone LZ4 block never starts with a zero token
+    // followed by more data, so these cannot be mistaken for the
+    // beginning of a dictionary-less block. the embedded header is
+    // followed by the dictionary id, the dictionary size, the dictionary
+    // and the compressed data. the reference header only by the
+    // dictionary id and the compressed data
+    const char      dict_magic[4]     = { 0, 'V', 'D', 'I' };
+    const char      ref_magic[4]      = { 0, 'V', 'D', 'R' };
+    const size_t    dict_header_size  = sizeof(dict_magic)+2*sizeof(uint32_t);
+    const size_t    ref_header_size   = sizeof(ref_magic)+sizeof(uint32_t);
+    
+    enum header_t { NO_HEADER, DICT_HEADER, REF_HEADER, BAD_HEADER };
+    
+    std::map<std::string, lz4_dictionary::sptr>   g_table_dicts_;
+    std::map<uint32_t, lz4_dictionary::sptr>      g_id_dicts_;
+    std::mutex                                    g_mutex_;
+    
+    void write_u32(char * p, uint32_t v)
+    {
+      for( size_t i=0; i<sizeof(uint32_t); ++i )
+      {
+        p[i] = (char)((v >> (8*i)) & 0xff);
+      }
+    }
+    
+    uint32_t read_u32(const char * p)
+    {
+      const unsigned char * up = reinterpret_cast<const unsigned char *>(p);
+      uint32_t ret = 0;
+      for( size_t i=0; i<sizeof(uint32_t); ++i )
+      {
+        ret |= (((uint32_t)up[i]) << (8*i));
+      }
+      return ret;
+    }
+    
+    size_t header_size(const lz4_options & opts)
+    {
+      if( opts.dictionary_mode_ == lz4_options::REFERENCE )
+        return ref_header_size;
+      return dict_header_size+opts.dictionary_->data().size();
+    }
+    
+    void write_header(char * p, const lz4_options & opts)
+    {
+      const lz4_dictionary & dict = *opts.dictionary_;
+      if( opts.dictionary_mode_ == lz4_options::REFERENCE )
+      {
+        ::memcpy(p, ref_magic, sizeof(ref_magic));
+        write_u32(p+sizeof(ref_magic), dict.id());
+        return;
+      }
+      ::memcpy(p, dict_magic, sizeof(dict_magic));
+      p += sizeof(dict_magic);
+      write_u32(p, dict.id());
+      write_u32(p+sizeof(uint32_t), (uint32_t)dict.data().size());
+      ::memcpy(p+2*sizeof(uint32_t), dict.data().c_str(), dict.data().size());
+    }
+    
+    // checks the header. dict and dict_size are only set for the
+    // dictionary inside the data, header_len for both kinds
+    header_t read_header(const char * src,
+                         size_t src_size,
+                         uint32_t & dict_id,
+                         const char *& dict,
+                         size_t & dict_size,
+                         size_t & header_len)
+    {
+      if( !src || src_size < sizeof(dict_magic) )
+        return NO_HEADER;
+      
+      if( ::memcmp(src, ref_magic, sizeof(ref_magic)) == 0 )
+      {
+        if( src_size <= ref_header_size )
+          return BAD_HEADER;
+        dict_id    = read_u32(src+sizeof(ref_magic));
+        header_len = ref_header_size;
+        return REF_HEADER;
+      }
+      
+      if( ::memcmp(src, dict_magic, sizeof(dict_magic)) != 0 )
+        return NO_HEADER;
+      if( src_size <= dict_header_size )
+        return BAD_HEADER;
+      
+      dict_id    = read_u32(src+sizeof(dict_magic));
+      dict_size  = read_u32(src+sizeof(dict_magic)+sizeof(uint32_t));
+      dict       = src+dict_header_size;
+      header_len = dict_header_size+dict_size;
+      if( dict_size > 0 && dict_size <= lz4_dictionary::max_size &&
+          header_len < src_size )
+      {
+        return DICT_HEADER;
+      }
+      return BAD_HEADER;
+    }
+    
+    int compress_plain(const char * src,
+                       int src_size,
+                       char * dest,
+                       int max_size,
+                       const lz4_options & opts)
+    {
+      if( opts.mode_ == lz4_options::HC )
+        return LZ4_compress_HC(src, dest, src_size, max_size, opts.hc_level_);
+      else
+        return LZ4_compress_fast(src, dest, src_size, max_size, opts.acceleration_);
+    }
+    
+    int compress_dict(const char * src,
+                      int src_size,
+                      char * dest,
+                      int max_size,
+                      const lz4_options & opts)
+    {
+      const std::string & dict = opts.dictionary_->data();
+      if( opts.mode_ == lz4_options::HC )
+      {
+        std::unique_ptr<LZ4_streamHC_t, int(*)(LZ4_streamHC_t*)>
+          stream{LZ4_createStreamHC(), LZ4_freeStreamHC};
+        if( !stream ) return 0;
+        LZ4_resetStreamHC(stream.get(), opts.hc_level_);
+        LZ4_loadDictHC(stream.get(), dict.c_str(), dict.size());
+        return LZ4_compress_HC_continue(stream.get(), src, dest, src_size, max_size);
+      }
+      else
+      {
+        std::unique_ptr<LZ4_stream_t, int(*)(LZ4_stream_t*)>
+          stream{LZ4_createStream(), LZ4_freeStream};
+        if( !stream ) return 0;
+        LZ4_loadDict(stream.get(), dict.c_str(), dict.size());
+        return LZ4_compress_fast_continue(stream.get(),
+                                          src,
+                                          dest,
+                                          src_size,
+                                          max_size,
+                                          opts.acceleration_);
+      }
+    }
+  }
+  
+  lz4_dictionary::lz4_dictionary(const std::string & data)
+  : data_{data.size() > max_size ? data.substr(data.size()-max_size) : data},
+    id_{XXH32(data_.c_str(), data_.size(), 0)}
+  {
+    if( data_.empty() )
+    {
+      THROW_("empty dictionary");
+    }
+  }
+  
+  uint32_t
+  lz4_dictionary::id() const
+  {
+    return id_;
+  }
+  
+  const std::string &
+  lz4_dictionary::data() const
+  {
+    return data_;
+  }
+  
+  lz4_dictionary::sptr
+  lz4_dictionary::train(const std::vector<std::string> & samples,
+                        size_t max_dict_size)
+  {
+    if( max_dict_size > max_size ) max_dict_size = max_size;
+    
+    std::unordered_map<std::string, size_t> counts;
+    for( auto const & s : samples )
+    {
+      if( !s.empty() ) ++counts[s];
+    }
+    
+    // values that save the most when referenced go first
+    typedef std::pair<size_t, const std::string *> scored;
+    std::vector<scored> ranked;
+    ranked.reserve(counts.size());
+    for( auto const & c : counts )
+    {
+      ranked.push_back(scored{c.second*c.first.size(), &c.first});
+    }
+    std::sort(ranked.begin(), ranked.end(),
+              [](const scored & l, const scored & r) {
+                return l.first > r.first;
+              });
+    
+    // collect the best values that fit, then put the best one last
+    std::vector<const std::string *> selected;
+    size_t total = 0;
+    for( auto const & r : ranked )
+    {
+      if( total + r.second->size() > max_dict_size ) continue;
+      total += r.second->size();
+      selected.push_back(r.second);
+    }
+    
+    if( selected.empty() ) return lz4_dictionary::sptr();
+    
+    std::string data;
+    data.reserve(total);
+    for( auto it=selected.rbegin(); it!=selected.rend(); ++it )
+    {
+      data.append(**it);
+    }
+    
+    return lz4_dictionary::sptr{new lz4_dictionary{data}};
+  }
+  
+  void
+  lz4_dictionary_store::add(const std::string & table_name,
+                            lz4_dictionary::sptr dict)
+  {
+    if( !dict ) return;
+    std::lock_guard<std::mutex> lock(g_mutex_);
+    g_table_dicts_[table_name] = dict;
+    g_id_dicts_[dict->id()] = dict;
+  }
+  
+  lz4_dictionary::sptr
+  lz4_dictionary_store::get(const std::string & table_name)
+  {
+    std::lock_guard<std::mutex> lock(g_mutex_);
+    auto it = g_table_dicts_.find(table_name);
+    if( it == g_table_dicts_.end() )
+      return lz4_dictionary::sptr();
+    return it->second;
+  }
+  
+  void
+  lz4_dictionary_store::remove(const std::string & table_name)
+  {
+    std::lock_guard<std::mutex> lock(g_mutex_);
+    g_table_dicts_.erase(table_name);
+  }
+  
+  void
+  lz4_dictionary_store::add_by_id(lz4_dictionary::sptr dict)
+  {
+    if( !dict ) return;
+    std::lock_guard<std::mutex> lock(g_mutex_);
+    g_id_dicts_[dict->id()] = dict;
+  }
+  
+  lz4_dictionary::sptr
+  lz4_dictionary_store::get_by_id(uint32_t dict_id)
+  {
+    std::lock_guard<std::mutex> lock(g_mutex_);
+    auto it = g_id_dicts_.find(dict_id);
+    if( it == g_id_dicts_.end() )
+      return lz4_dictionary::sptr();
+    return it->second;
+  }
+  
+  lz4_options::lz4_options()
+  : mode_{FAST},
+    acceleration_{1},
+    hc_level_{9},
+    dictionary_mode_{EMBED}
+  {
+  }
+  
+  lz4_options
+  lz4_options::fast(int acceleration)
+  {
+    lz4_options ret;
+    ret.mode_ = FAST;
+    ret.acceleration_ = (acceleration < 1 ? 1 : acceleration);
+    return ret;
+  }
+  
+  lz4_options
+  lz4_options::hc(int level)
+  {
+    lz4_options ret;
+    ret.mode_ = HC;
+    ret.hc_level_ = level;
+    return ret;
+  }
+  
+  lz4_options &
+  lz4_options::with_dictionary(lz4_dictionary::sptr dict,
+                               dictionary_t how)
+  {
+    dictionary_ = dict;
+    dictionary_mode_ = how;
+    return *this;
+  }
+  
+  bool
+  lz4_utils::compress(const char * src,
+                      size_t src_size,
+                      std::string & dest,
+                      const lz4_options & opts)
+  {
+    if( !src || !src_size || src_size > LZ4_MAX_INPUT_SIZE )
+      return false;
+    
+    int bound = LZ4_compressBound(src_size);
+    
+    if( opts.dictionary_ && opts.dictionary_mode_ == lz4_options::ANNOUNCE )
+    {
+      size_t hdr_size = header_size(opts);
+      dest.resize(bound+hdr_size);
+      write_header(&(dest[0]), opts);
+      int ret = compress_dict(src, src_size, &(dest[hdr_size]), bound, opts);
+      if( ret <= 0 )
+      {
+        dest.clear();
+        return false;
+      }
+      dest.resize(ret+hdr_size);
+      return true;
+    }
+    
+    dest.resize(bound);
+    int ret = compress_plain(src, src_size, &(dest[0]), bound, opts);
+    if( ret <= 0 )
+    {
+      dest.clear();
+      return false;
+    }
+    dest.resize(ret);
+    
+    if( !opts.dictionary_ )
+      return true;
+    
+    // the dictionary has to beat the plain block with its header
+    // together, LZ4 gives up when the output doesn't fit
+    size_t hdr_size = header_size(opts);
+    if( hdr_size+1 >= (size_t)ret )
+      return true;
+    
+    std::string with_dict(ret-1, 0);
+    write_header(&(with_dict[0]), opts);
+    int dict_ret = compress_dict(src,
+                                 src_size,
+                                 &(with_dict[hdr_size]),
+                                 ret-1-hdr_size,
+                                 opts);
+    if( dict_ret > 0 )
+    {
+      with_dict.resize(dict_ret+hdr_size);
+      dest.swap(with_dict);
+    }
+    return true;
+  }
+  
+  bool
+  lz4_utils::has_dictionary(const char * src,
+                            size_t src_size,
+                            uint32_t & dict_id)
+  {
+    const char * dict = nullptr;
+    size_t dict_size = 0;
+    size_t header_len = 0;
+    header_t hdr = read_header(src, src_size, dict_id, dict, dict_size, header_len);
+    return (hdr == DICT_HEADER || hdr == REF_HEADER);
+  }
+  
+  bool
+  lz4_utils::learn_dictionary(const char * src,
+                              size_t src_size)
+  {
+    uint32_t dict_id = 0;
+    const char * dict = nullptr;
+    size_t dict_size = 0;
+    size_t header_len = 0;
+    if( read_header(src, src_size, dict_id, dict, dict_size, header_len) != DICT_HEADER )
+      return false;
+    
+    // every block of a column may carry the same dictionary
+    if( lz4_dictionary_store::get_by_id(dict_id) )
+      return true;
+    
+    lz4_dictionary::sptr learnt{new lz4_dictionary{std::string(dict, dict_size)}};
+    if( learnt->id() != dict_id )
+      return false;
+    
+    lz4_dictionary_store::add_by_id(learnt);
+    return true;
+  }
+  
+  int
+  lz4_utils::decompress(const char * src,
+                        size_t src_size,
+                        char * dest,
+                        size_t orig_size)
+  {
+    if( !src || !src_size || !dest || !orig_size )
+      return -1;
+    
+    uint32_t dict_id = 0;
+    const char * dict = nullptr;
+    size_t dict_size = 0;
+    size_t header_len = 0;
+    lz4_dictionary::sptr referenced;
+    
+    switch( read_header(src, src_size, dict_id, dict, dict_size, header_len) )
+    {
+      case NO_HEADER:
+        // fast and HC modes share the same block format
+        return LZ4_decompress_safe(src, dest, src_size, orig_size);
+        
+      case DICT_HEADER:
+        // the id is the hash of the dictionary, this catches damaged data
+        if( XXH32(dict, dict_size, 0) != dict_id )
+          return -1;
+        break;
+        
+      case REF_HEADER:
+        referenced = lz4_dictionary_store::get_by_id(dict_id);
+        if( !referenced )
+          return -1;
+        dict       = referenced->data().c_str();
+        dict_size  = referenced->data().size();
+        break;
+        
+      default:
+        // truncated or damaged header
+        return -1;
+    }
+    
+    return LZ4_decompress_safe_usingDict(src+header_len,
+                                         dest,
+                                         src_size-header_len,
+                                         orig_size,
+                                         dict,
+                                         dict_size);
+  }
+  
 }}
@@ -1,4 +1,117 @@
 #pragma once
 
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
 namespace virtdb { namespace util {
+  
+  class lz4_dictionary final
+  {
+    std::string   data_;
+    uint32_t      id_;
+    
+  public:
+    typedef std::shared_ptr<lz4_dictionary> sptr;
+    
+    // LZ4 only looks back 64k, bigger dictionaries are truncated
+    static const size_t max_size = 64*1024;
+    
+    lz4_dictionary(const std::string & data);
+    
+    uint32_t id() const;
+    const std::string & data() const;
+    
+    // builds a dictionary from sample values. the most frequent values
+    // are placed at the end so they are the closest to the compressed
+    // data and are cheaper to reference
+    static sptr train(const std::vector<std::string> & samples,
+                      size_t max_dict_size=max_size);
+    
+  private:
+    lz4_dictionary() = delete;
+    lz4_dictionary(const lz4_dictionary &) = delete;
+    lz4_dictionary & operator=(const lz4_dictionary &) = delete;
+  };
+  
+  // process wide store of the dictionaries by table name, so the
+  // producers of a table can share one. the dictionaries are also kept
+  // by id for the blocks that only reference them. remove() only drops
+  // the table name, data in flight may still reference the dictionary
+  class lz4_dictionary_store
+  {
+  public:
+    static void add(const std::string & table_name,
+                    lz4_dictionary::sptr dict);
+    static lz4_dictionary::sptr get(const std::string & table_name);
+    static void remove(const std::string & table_name);
+    
+    static void add_by_id(lz4_dictionary::sptr dict);
+    static lz4_dictionary::sptr get_by_id(uint32_t dict_id);
+  };
+  
+  struct lz4_options
+  {
+    enum mode_t {
+      FAST,  // LZ4_compress_fast with the given acceleration
+      HC,    // LZ4HC with the given level
+    };
+    
+    enum dictionary_t {
+      EMBED,      // the dictionary travels in the block, unless plain
+                  // LZ4 is smaller
+      ANNOUNCE,   // the dictionary travels in the block even if that is
+                  // bigger, for the first block that introduces it
+      REFERENCE,  // only the dictionary id travels, unless plain LZ4 is
+                  // smaller. the consumer must know the dictionary
+    };
+    
+    mode_t                  mode_;
+    int                     acceleration_;
+    int                     hc_level_;
+    lz4_dictionary::sptr    dictionary_;
+    dictionary_t            dictionary_mode_;
+    
+    lz4_options();
+    
+    static lz4_options fast(int acceleration=1);
+    static lz4_options hc(int level=9);
+    lz4_options & with_dictionary(lz4_dictionary::sptr dict,
+                                  dictionary_t how=EMBED);
+  };
+  
+  struct lz4_utils
+  {
+    // compresses src into dest. dest is resized to the compressed size.
+    // data compressed with a dictionary is prefixed by a header with the
+    // dictionary id, and the dictionary itself in EMBED and ANNOUNCE
+    // modes. EMBED and REFERENCE fall back to a plain block when the
+    // dictionary doesn't make the block smaller. returns false on failure
+    static bool compress(const char * src,
+                         size_t src_size,
+                         std::string & dest,
+                         const lz4_options & opts=lz4_options());
+    
+    // decompresses data produced by compress() in any mode. referenced
+    // dictionaries are looked up with lz4_dictionary_store::get_by_id().
+    // dest must be able to hold orig_size bytes. returns the decompressed
+    // size or a negative value on failure
+    static int decompress(const char * src,
+                          size_t src_size,
+                          char * dest,
+                          size_t orig_size);
+    
+    // tells if the data was compressed with a dictionary and which one
+    static bool has_dictionary(const char * src,
+                               size_t src_size,
+                               uint32_t & dict_id);
+    
+    // registers the dictionary carried by the data by its id, so the
+    // blocks referencing it can be decompressed in any order. returns
+    // true if the data carried a valid dictionary
+    static bool learn_dictionary(const char * src,
+                                 size_t src_size);
+  };
+  
 }}
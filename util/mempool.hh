@@ -19,7 +19,8 @@ namespace virtdb { namespace util {
       return new item[n];
     }
     
-    virtual void delete_items(item * p)
+    // n is the number of items allocated for p
+    virtual void delete_items(item * p, size_t n)
     {
       delete [] p;
     }
@@ -34,9 +35,24 @@ namespace virtdb { namespace util {
       delete p;
     }
     
-  private:
+    // virtual calls don't reach the child class from our constructor, so
+    // children allocate the first n_items themselves and pass them here
+    mempool(item * pool, size_t n_items, size_t next_size)
+    : allocated_items_(n_items),
+      free_items_(allocated_items_),
+      next_size_(next_size?aligned_size(next_size):allocated_items_),
+      pool_(pool),
+      next_(nullptr),
+      last_(this) {}
+    
     enum { item_size_ = sizeof(item) };
     
+    static constexpr size_t aligned_size(size_t sz)
+    {
+      return (sz+item_size_-1)/item_size_;
+    }
+    
+  private:
     size_t    allocated_items_;
     size_t    free_items_;
     size_t    next_size_;
@@ -63,11 +79,6 @@ namespace virtdb { namespace util {
     mempool(const mempool &) = delete;
     mempool& operator=(const mempool &) = delete;
     
-    static constexpr size_t aligned_size(size_t sz)
-    {
-      return (sz+item_size_-1)/item_size_;
-    }
-    
   public:
     typedef std::shared_ptr<mempool> sptr;
     
@@ -93,7 +104,7 @@ namespace virtdb { namespace util {
       }
       if( pool_ )
       {
-        delete_items(pool_);
+        delete_items(pool_, allocated_items_);
         pool_ = nullptr;
       }
     }
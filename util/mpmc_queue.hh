@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace virtdb { namespace util {
+
+  // bounded, lock-free, multi producer multi consumer queue. every cell
+  // carries a sequence number that tells if it is ready to be written or
+  // read in the current round, so producers and consumers only contend
+  // on their own position counter
+  template <typename T, size_t CAPACITY>
+  class mpmc_queue final
+  {
+    static_assert( CAPACITY >= 2 && (CAPACITY & (CAPACITY-1)) == 0,
+                   "mpmc_queue capacity must be a power of 2" );
+    
+    enum { cache_line_ = 64, mask_ = CAPACITY-1 };
+    
+    struct cell
+    {
+      std::atomic<size_t>   seq_;
+      T                     data_;
+    };
+    
+    typedef std::unique_ptr<cell[]> cell_array;
+    
+    cell_array            cells_;
+    char                  pad0_[cache_line_];
+    std::atomic<size_t>   enqueue_pos_;
+    char                  pad1_[cache_line_];
+    std::atomic<size_t>   dequeue_pos_;
+    char                  pad2_[cache_line_];
+    
+    mpmc_queue(const mpmc_queue &) = delete;
+    mpmc_queue & operator=(const mpmc_queue &) = delete;
+
+  public:
+    mpmc_queue()
+    : cells_{new cell[CAPACITY]},
+      enqueue_pos_{0},
+      dequeue_pos_{0}
+    {
+      for( size_t i=0; i<CAPACITY; ++i )
+        cells_[i].seq_.store(i, std::memory_order_relaxed);
+    }
+    
+    static constexpr size_t capacity() { return CAPACITY; }
+    
+    // v is only moved from when the push succeeds
+    bool try_push(T & v)
+    {
+      cell * c = nullptr;
+      size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+      while( true )
+      {
+        c = &cells_[pos & mask_];
+        size_t seq = c->seq_.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if( diff == 0 )
+        {
+          if( enqueue_pos_.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed) )
+            break;
+        }
+        else if( diff < 0 )
+        {
+          // full
+          return false;
+        }
+        else
+        {
+          pos = enqueue_pos_.load(std::memory_order_relaxed);
+        }
+      }
+      c->data_ = std::move(v);
+      c->seq_.store(pos+1, std::memory_order_release);
+      return true;
+    }
+    
+    bool try_pop(T & v)
+    {
+      cell * c = nullptr;
+      size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+      while( true )
+      {
+        c = &cells_[pos & mask_];
+        size_t seq = c->seq_.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos+1);
+        if( diff == 0 )
+        {
+          if( dequeue_pos_.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed) )
+            break;
+        }
+        else if( diff < 0 )
+        {
+          // empty
+          return false;
+        }
+        else
+        {
+          pos = dequeue_pos_.load(std::memory_order_relaxed);
+        }
+      }
+      v = std::move(c->data_);
+      // don't keep the moved-from value alive in the cell
+      c->data_ = T();
+      c->seq_.store(pos+mask_+1, std::memory_order_release);
+      return true;
+    }
+    
+    // only a hint while other threads are pushing and popping
+    bool empty() const
+    {
+      return enqueue_pos_.load() == dequeue_pos_.load();
+    }
+  };
+
+}}
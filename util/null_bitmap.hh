@@ -0,0 +1,134 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace virtdb { namespace util {
+
+  // packed null flags, bit (i%64) of word (i/64) belongs to row i. unlike
+  // std::vector<bool> the words are accessible, so rows without nulls can
+  // be skipped 64 at a time. the bits past size() are always zero
+  class null_bitmap final
+  {
+    std::vector<uint64_t>  words_;
+    size_t                 size_;
+
+  public:
+    class reference
+    {
+      uint64_t * word_;
+      uint64_t   mask_;
+    
+    public:
+      reference(uint64_t * word, uint64_t mask) : word_{word}, mask_{mask} {}
+      
+      inline operator bool() const { return (*word_ & mask_) != 0; }
+      
+      inline reference & operator=(bool v)
+      {
+        if( v ) *word_ |= mask_;
+        else    *word_ &= ~mask_;
+        return *this;
+      }
+      
+      inline reference & operator=(const reference & other)
+      {
+        return (*this = static_cast<bool>(other));
+      }
+    };
+    
+    null_bitmap(size_t n=0)
+    : words_((n+63)/64, 0),
+      size_{n}
+    {
+    }
+    
+    // the new rows are not null
+    inline void resize(size_t n)
+    {
+      if( n < size_ )
+      {
+        words_.resize((n+63)/64);
+        if( n&63 )
+          words_.back() &= ((1ULL << (n&63))-1);
+      }
+      else
+      {
+        words_.resize((n+63)/64, 0);
+      }
+      size_ = n;
+    }
+    
+    inline size_t size() const { return size_; }
+    inline size_t n_words() const { return words_.size(); }
+    inline const uint64_t * words() const { return words_.data(); }
+    
+    inline bool operator[](size_t i) const
+    {
+      return ((words_[i>>6] >> (i&63)) & 1) != 0;
+    }
+    
+    inline reference operator[](size_t i)
+    {
+      return reference{&words_[i>>6], (1ULL << (i&63))};
+    }
+    
+    inline void set(size_t i, bool v=true)
+    {
+      (*this)[i] = v;
+    }
+    
+    inline void reset()
+    {
+      for( auto & w : words_ )
+        w = 0;
+    }
+    
+    // is any of the first n rows null
+    inline bool any(size_t n) const
+    {
+      size_t full = n>>6;
+      for( size_t w=0; w<full; ++w )
+        if( words_[w] ) return true;
+      if( n&63 )
+        return (words_[full] & ((1ULL << (n&63))-1)) != 0;
+      return false;
+    }
+    
+    // one past the last null among the first n rows, zero if none
+    inline size_t end_of_nulls(size_t n) const
+    {
+      size_t w = (n+63)>>6;
+      while( w > 0 )
+      {
+        --w;
+        uint64_t bits = words_[w];
+        if( w == (n>>6) && (n&63) )
+          bits &= ((1ULL << (n&63))-1);
+        if( bits )
+          return (w<<6) + (64-__builtin_clzll(bits));
+      }
+      return 0;
+    }
+    
+    // calls f(i) for the null rows below n, in increasing order
+    template <typename F>
+    inline void for_each_null(size_t n, F f) const
+    {
+      size_t n_words = (n+63)>>6;
+      for( size_t w=0; w<n_words; ++w )
+      {
+        uint64_t bits = words_[w];
+        while( bits )
+        {
+          size_t i = (w<<6) + __builtin_ctzll(bits);
+          if( i >= n ) return;
+          f(i);
+          bits &= (bits-1);
+        }
+      }
+    }
+  };
+
+}}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+
+namespace virtdb { namespace util {
+
+  // recycles heap objects instead of freeing them. get() hands out a
+  // shared_ptr that puts the object back into the pool when the last
+  // reference goes away, so a group of objects released together (like
+  // the columns of an erased block) return in one go. T is reset with
+  // Clear() on release, as protobuf messages are, which keeps the
+  // capacity of their strings and repeated fields for the next parse.
+  // objects may outlive the pool, then they are simply deleted
+  template <typename T>
+  class object_pool final
+  {
+    typedef std::lock_guard<std::mutex>  lock;
+    
+    struct state
+    {
+      std::mutex                       mtx_;
+      std::vector<std::unique_ptr<T>>  free_;
+      size_t                           max_free_;
+      std::atomic<uint64_t>            n_created_;
+      std::atomic<uint64_t>            n_reused_;
+      
+      state(size_t max_free)
+      : max_free_{max_free},
+        n_created_{0},
+        n_reused_{0}
+      {
+      }
+      
+      void release(T * p)
+      {
+        std::unique_ptr<T> ptr{p};
+        ptr->Clear();
+        lock l(mtx_);
+        if( free_.size() < max_free_ )
+          free_.push_back(std::move(ptr));
+      }
+    };
+    
+    typedef std::shared_ptr<state> state_sptr;
+    typedef std::weak_ptr<state>   state_wptr;
+    
+    state_sptr state_;
+
+  public:
+    typedef std::shared_ptr<T>            sptr;
+    typedef std::shared_ptr<object_pool>  pool_sptr;
+    
+    // at most max_free objects are kept for reuse, the rest is deleted
+    object_pool(size_t max_free=256)
+    : state_{new state{max_free}}
+    {
+    }
+    
+    sptr get()
+    {
+      std::unique_ptr<T> ptr;
+      {
+        lock l(state_->mtx_);
+        if( !state_->free_.empty() )
+        {
+          ptr = std::move(state_->free_.back());
+          state_->free_.pop_back();
+        }
+      }
+      
+      if( ptr ) ++(state_->n_reused_);
+      else      { ptr.reset(new T); ++(state_->n_created_); }
+      
+      state_wptr wst{state_};
+      return sptr(ptr.release(), [wst](T * p) {
+        auto st = wst.lock();
+        if( st ) st->release(p);
+        else     delete p;
+      });
+    }
+    
+    size_t n_free() const
+    {
+      lock l(state_->mtx_);
+      return state_->free_.size();
+    }
+    
+    uint64_t n_created() const
+    {
+      return state_->n_created_.load();
+    }
+    
+    uint64_t n_reused() const
+    {
+      return state_->n_reused_.load();
+    }
+
+  private:
+    object_pool(const object_pool &) = delete;
+    object_pool & operator=(const object_pool &) = delete;
+  };
+
+}}
@@ -0,0 +1,393 @@
+#pragma once
+
+#include <util/exception.hh>
+#include <util/constants.hh>
+
+#include <vector>
+#include <map>
+#include <memory>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <chrono>
+#include <functional>
+#include <iostream>
+
+namespace virtdb { namespace util {
+
+  // same interface as table_collector, but only a sliding window of
+  // blocks is kept: block_id lives in slot (block_id % window). column
+  // inserts only lock their slot, the collector lock is taken when a
+  // block completes and when the window slides. inserting beyond the
+  // window blocks until the consumer erases the oldest blocks, so
+  // memory stays bounded
+  template <typename T, size_t CHECK_TIMEOUT_MS=50>
+  class ring_table_collector final
+  {
+    typedef std::unique_lock<std::mutex>     lock;
+  public:
+    typedef T                                      item;
+    typedef std::shared_ptr<item>                  item_sptr;
+    typedef T*                                     item_ptr;
+    typedef std::vector<item_sptr>                 row_data;
+    typedef std::pair<row_data,size_t>             row_data_ret;
+    typedef std::shared_ptr<ring_table_collector>  sptr;
+    typedef std::function<void(size_t)>            completion_callback;
+    typedef std::vector<completion_callback>       completion_callbacks;
+
+  private:
+    struct slot
+    {
+      // checking the round and storing a column happen together under
+      // this lock, so a late column cannot land in the next round
+      mutable std::mutex    mtx_;
+      // the block this slot holds in the current round
+      std::atomic<size_t>   block_id_;
+      std::atomic<size_t>   n_set_;
+      std::atomic<bool>     erased_;
+      row_data              cols_;
+      // guarded by the collector mutex
+      completion_callbacks  callbacks_;
+    };
+    
+    typedef std::unique_ptr<slot[]>                          slot_array;
+    typedef std::multimap<size_t, completion_callback>       pending_callbacks;
+    
+    size_t                   n_columns_;
+    size_t                   window_;
+    slot_array               slots_;
+    std::atomic<size_t>      base_;
+    std::atomic<size_t>      max_block_id_;
+    std::atomic<uint64_t>    n_backpressure_waits_;
+    std::atomic<uint64_t>    n_dropped_;
+    mutable std::mutex       mtx_;
+    // callbacks of blocks beyond the window, guarded by mtx_. they move
+    // to their slot when the window reaches the block
+    pending_callbacks        pending_;
+    std::condition_variable  cond_;
+    std::condition_variable  space_cond_;
+    std::atomic<bool>        stop_;
+
+  public:
+    ring_table_collector(size_t n_columns,
+                         size_t window)
+    : n_columns_{n_columns},
+      window_{window},
+      slots_{new slot[window ? window : 1]},
+      base_{0},
+      max_block_id_{0},
+      n_backpressure_waits_{0},
+      n_dropped_{0},
+      stop_{false}
+    {
+      if( !window )
+      {
+        THROW_("window size is zero");
+      }
+      
+      for( size_t i=0; i<window_; ++i )
+      {
+        slots_[i].block_id_  = i;
+        slots_[i].n_set_     = 0;
+        slots_[i].erased_    = false;
+        slots_[i].cols_.resize(n_columns_);
+      }
+    }
+    
+    ~ring_table_collector()
+    {
+      stop();
+    }
+    
+    void stop()
+    {
+      stop_ = true;
+      {
+        lock l(mtx_);
+        cond_.notify_all();
+        space_cond_.notify_all();
+      }
+    }
+    
+    bool stopped() const
+    {
+      return stop_.load();
+    }
+    
+    // returns false if the item was dropped: the block has already left
+    // the window or the collector was stopped while waiting for space
+    bool insert(size_t block_id,
+                size_t col_id,
+                item_ptr b)
+    {
+      item_sptr isptr{b};
+      return insert(block_id, col_id, isptr);
+    }
+    
+    bool insert(size_t block_id,
+                size_t col_id,
+                item_sptr b)
+    {
+      // check for invalid column id
+      if( n_columns_ <= col_id )
+      {
+        std::cerr << "out of bounds: " << n_columns_ << "<=" << col_id << "\n";
+        THROW_("col_id out of bounds");
+      }
+      
+      if( !wait_for_space(block_id) )
+      {
+        ++n_dropped_;
+        return false;
+      }
+      
+      slot & s = slots_[block_id % window_];
+      bool completed = false;
+      {
+        lock sl(s.mtx_);
+        if( s.block_id_ != block_id || s.erased_ )
+        {
+          // the block was erased or the window slid past it while we
+          // were waiting
+          ++n_dropped_;
+          return false;
+        }
+        
+        item_sptr prev = s.cols_[col_id];
+        s.cols_[col_id] = b;
+        if( !prev && b )
+          completed = ((++s.n_set_) == n_columns_);
+      }
+      
+      size_t max_id = max_block_id_.load();
+      while( block_id > max_id &&
+             !max_block_id_.compare_exchange_weak(max_id, block_id) ) {}
+      
+      if( completed )
+      {
+        // wake up the readers only when the block is complete. the slot
+        // only moves to the next round under the collector lock, so the
+        // callbacks taken here belong to this block
+        completion_callbacks callbacks;
+        {
+          lock l(mtx_);
+          if( s.block_id_ == block_id )
+            callbacks.swap(s.callbacks_);
+          cond_.notify_all();
+        }
+        for( auto & cb : callbacks )
+          cb(block_id);
+      }
+      return true;
+    }
+    
+    // erased blocks can be erased in any order. the window slides over
+    // the erased blocks at its beginning
+    void erase(size_t block_id)
+    {
+      size_t base = base_.load();
+      if( block_id < base || block_id >= base+window_ )
+        return;
+      
+      slot & s = slots_[block_id % window_];
+      {
+        // inserts are dropped from now on
+        lock sl(s.mtx_);
+        if( s.block_id_ != block_id )
+          return;
+        clear_slot(s);
+        s.erased_ = true;
+      }
+      
+      lock l(mtx_);
+      bool moved = false;
+      base = base_.load();
+      while( true )
+      {
+        slot & old = slots_[base % window_];
+        {
+          lock sl(old.mtx_);
+          if( !old.erased_ || old.block_id_ != base )
+            break;
+          old.erased_   = false;
+          old.block_id_ = base+window_;
+        }
+        old.callbacks_.clear();
+        
+        // nothing can be inserted beyond the window, so the block that
+        // enters it is empty and its callbacks just wait in the slot
+        auto range = pending_.equal_range(base+window_);
+        for( auto it=range.first; it!=range.second; ++it )
+          old.callbacks_.push_back(it->second);
+        pending_.erase(range.first, range.second);
+        ++base;
+        moved = true;
+      }
+      
+      if( moved )
+      {
+        base_ = base;
+        space_cond_.notify_all();
+      }
+    }
+    
+    // same semantics as table_collector::on_complete. callbacks of
+    // blocks beyond the window are kept until the window reaches them,
+    // the ones of blocks already out of the window are dropped
+    void on_complete(size_t block_id,
+                     completion_callback cb)
+    {
+      if( !cb ) return;
+      
+      {
+        lock l(mtx_);
+        if( block_id < base_.load() )
+          return;
+        
+        if( !in_window(block_id) )
+        {
+          pending_.insert(std::make_pair(block_id, cb));
+          return;
+        }
+        
+        slot & s = slots_[block_id % window_];
+        lock sl(s.mtx_);
+        if( s.block_id_ != block_id )
+          return;
+        if( s.n_set_ != n_columns_ )
+        {
+          s.callbacks_.push_back(cb);
+          return;
+        }
+      }
+      
+      cb(block_id);
+    }
+    
+    row_data_ret get(size_t block_id,
+                     uint64_t timeout_ms=10000)
+    {
+      row_data_ret ret{row_data(n_columns_, item_sptr()), 0};
+      
+      if( collect(block_id, ret) )
+        return ret;
+      
+      auto wait_till = (std::chrono::steady_clock::now() +
+                        std::chrono::milliseconds(timeout_ms));
+      
+      // completing inserts notify under the lock, so checking under it
+      // cannot miss the wakeup
+      lock l(mtx_);
+      while( !collect(block_id, ret) && !stopped() )
+      {
+        auto now = std::chrono::steady_clock::now();
+        if( now >= wait_till )
+          break;
+        
+        auto slice = now + std::chrono::milliseconds(CHECK_TIMEOUT_MS);
+        cond_.wait_until(l, (slice < wait_till ? slice : wait_till));
+      }
+      return ret;
+    }
+    
+    size_t missing_columns(size_t block_id) const
+    {
+      const slot & s = slots_[block_id % window_];
+      lock sl(s.mtx_);
+      if( s.block_id_ != block_id )
+        return n_columns_;
+      return n_columns_ - s.n_set_.load();
+    }
+    
+    size_t max_block_id() const
+    {
+      return max_block_id_.load();
+    }
+    
+    size_t n_columns() const
+    {
+      return n_columns_;
+    }
+    
+    size_t window() const
+    {
+      return window_;
+    }
+    
+    // the first block that is still kept
+    size_t first_block_id() const
+    {
+      return base_.load();
+    }
+    
+    uint64_t n_backpressure_waits() const
+    {
+      return n_backpressure_waits_.load();
+    }
+    
+    uint64_t n_dropped() const
+    {
+      return n_dropped_.load();
+    }
+
+  private:
+    ring_table_collector() = delete;
+    ring_table_collector(const ring_table_collector &) = delete;
+    ring_table_collector & operator=(const ring_table_collector &) = delete;
+    
+    bool in_window(size_t block_id) const
+    {
+      size_t base = base_.load();
+      return (block_id >= base && block_id < base+window_);
+    }
+    
+    bool wait_for_space(size_t block_id)
+    {
+      if( block_id < base_.load() )
+        return false;
+      
+      if( block_id < base_.load()+window_ )
+        return true;
+      
+      ++n_backpressure_waits_;
+      while( !stopped() )
+      {
+        lock l(mtx_);
+        if( block_id < base_.load() )
+          return false;
+        if( block_id < base_.load()+window_ )
+          return true;
+        space_cond_.wait_for(l, std::chrono::milliseconds(CHECK_TIMEOUT_MS));
+      }
+      return false;
+    }
+    
+    // the caller holds the slot lock
+    void clear_slot(slot & s)
+    {
+      for( auto & c : s.cols_ )
+        c.reset();
+      s.n_set_ = 0;
+    }
+    
+    // fills ret from the slot, returns true if all columns are there
+    bool collect(size_t block_id,
+                 row_data_ret & ret) const
+    {
+      const slot & s = slots_[block_id % window_];
+      lock sl(s.mtx_);
+      if( s.block_id_ != block_id || s.erased_ )
+        return false;
+      
+      size_t n = 0;
+      for( size_t i=0; i<n_columns_; ++i )
+      {
+        ret.first[i] = s.cols_[i];
+        if( ret.first[i] ) ++n;
+      }
+      ret.second = n;
+      return (n == n_columns_);
+    }
+  };
+
+}}
@@ -5,16 +5,20 @@
 #include <util/constants.hh>
 
 #include <map>
+#include <set>
 #include <vector>
 #include <memory>
 #include <atomic>
 #include <condition_variable>
 #include <mutex>
 #include <chrono>
+#include <functional>
 #include <iostream>
 
 namespace virtdb { namespace util {
 
+  // get() is woken up when the block it waits for completes. stop() and
+  // the CHECK_TIMEOUT_MS slices only bound the wait if a wakeup is lost
   template <typename T, size_t CHECK_TIMEOUT_MS=50>
   class table_collector final
   {
@@ -26,11 +30,16 @@ namespace virtdb { namespace util {
     typedef std::vector<item_sptr>            row_data;
     typedef std::pair<row_data,size_t>        row_data_ret;
     typedef std::shared_ptr<table_collector>  sptr;
+    typedef std::function<void(size_t)>       completion_callback;
+    typedef std::vector<completion_callback>  completion_callbacks;
     
     class block
     {
-      row_data             data_;
-      size_t               n_columns_;
+      row_data               data_;
+      size_t                 n_columns_;
+      // the non-nil columns in data_, kept up to date by set_col
+      size_t                 n_set_;
+      completion_callbacks   callbacks_;
       
     public:
       block(const block & other);
@@ -44,10 +53,12 @@ namespace virtdb { namespace util {
       void reset();
       size_t count_non_nil() const;
       size_t count_nil() const;
-
+      
       void set_col(size_t col_id,
                    item_sptr b);
       
+      completion_callbacks & callbacks();
+      
     private:
       block() = delete;
     };
@@ -65,6 +76,13 @@ namespace virtdb { namespace util {
     void erase(size_t block_id);
     row_data_ret get(size_t block_id,
                      uint64_t timeout_ms=10000);
+    // cb is called once, when the last missing column of the block
+    // arrives. this is on the inserting thread, outside of the collector
+    // lock. if the block is already complete cb is called right away.
+    // callbacks of erased blocks are dropped, also the ones registered
+    // after the erase
+    void on_complete(size_t block_id,
+                     completion_callback cb);
     uint64_t last_updated(size_t block_id) const;
     size_t missing_columns(size_t block_id) const;
     size_t max_block_id() const;
@@ -75,8 +93,15 @@ namespace virtdb { namespace util {
     table_collector(const table_collector &) = delete;
     table_collector & operator=(const table_collector &) = delete;
     
+    // the caller holds mtx_
+    bool is_erased(size_t block_id) const;
+    
     size_t                         n_columns_;
     std::map<size_t, block>        blocks_;
+    // every block below erased_below_ is erased, the ones above it are
+    // in erased_
+    size_t                         erased_below_;
+    std::set<size_t>               erased_;
     mutable std::mutex             mtx_;
     std::condition_variable        cond_;
     std::atomic<bool>              stop_;
@@ -87,14 +112,17 @@ namespace virtdb { namespace util {
   template <typename T, size_t CHECK_TIMEOUT_MS>
   table_collector<T,CHECK_TIMEOUT_MS>::table_collector::block::block(const block & other)
   : data_{other.data_},
-    n_columns_{other.n_columns_}
+    n_columns_{other.n_columns_},
+    n_set_{other.n_set_},
+    callbacks_{other.callbacks_}
   {
   }
   
   template <typename T, size_t CHECK_TIMEOUT_MS>
   table_collector<T,CHECK_TIMEOUT_MS>::table_collector::block::block(size_t n_columns)
   : data_(n_columns, item_sptr()),
-    n_columns_{n_columns}
+    n_columns_{n_columns},
+    n_set_{0}
   {
   }
   
@@ -118,30 +146,22 @@ namespace virtdb { namespace util {
   {
     for( auto & d : data_ )
       d.reset();
+    n_set_ = 0;
+    callbacks_.clear();
   }
   
   template <typename T, size_t CHECK_TIMEOUT_MS>
   size_t
   table_collector<T,CHECK_TIMEOUT_MS>::table_collector::block::count_non_nil() const
   {
-    size_t ret = 0;
-    {
-      for( auto const & r : data_ )
-        if( r.get() ) ++ret;
-    }
-    return ret;
+    return n_set_;
   }
   
   template <typename T, size_t CHECK_TIMEOUT_MS>
   size_t
   table_collector<T,CHECK_TIMEOUT_MS>::table_collector::block::count_nil() const
   {
-    size_t ret = 0;
-    {
-      for( auto const & r : data_ )
-        if( !r.get() ) ++ret;
-    }
-    return ret;
+    return n_columns_ - n_set_;
   }
 
 
@@ -150,14 +170,25 @@ namespace virtdb { namespace util {
   table_collector<T,CHECK_TIMEOUT_MS>::table_collector::block::set_col(size_t col_id,
                                                       item_sptr b)
   {
+    bool was_set = (data_[col_id].get() != nullptr);
+    if( !was_set && b ) ++n_set_;
+    else if( was_set && !b ) --n_set_;
     data_[col_id] = b;
   }
   
+  template <typename T, size_t CHECK_TIMEOUT_MS>
+  typename table_collector<T,CHECK_TIMEOUT_MS>::completion_callbacks &
+  table_collector<T,CHECK_TIMEOUT_MS>::table_collector::block::callbacks()
+  {
+    return callbacks_;
+  }
+  
   // implementation of table_collector
   
   template <typename T, size_t CHECK_TIMEOUT_MS>
   table_collector<T,CHECK_TIMEOUT_MS>::table_collector::table_collector(size_t n_columns)
   : n_columns_{n_columns},
+    erased_below_{0},
     stop_{false}
   {
   }
@@ -172,6 +203,7 @@ namespace virtdb { namespace util {
   void
   table_collector<T,CHECK_TIMEOUT_MS>::table_collector::stop()
   {
+    lock l(mtx_);
     stop_ = true;
     cond_.notify_all();
   }
@@ -199,26 +231,70 @@ namespace virtdb { namespace util {
                                               size_t col_id,
                                               item_sptr b)
   {
-    lock l(mtx_);
+    completion_callbacks callbacks;
     
-    // check for invalid column id
-    if( n_columns_ <= col_id )
     {
-      std::cerr << "out of bounds: " << n_columns_ << "<=" << col_id << "\n";
-      THROW_("col_id out of bounds");
+      lock l(mtx_);
+      
+      // check for invalid column id
+      if( n_columns_ <= col_id )
+      {
+        std::cerr << "out of bounds: " << n_columns_ << "<=" << col_id << "\n";
+        THROW_("col_id out of bounds");
+      }
+      
+      // check if exists and create if not
+      auto it = blocks_.find(block_id);
+      if( it == blocks_.end() )
+      {
+        auto iit = blocks_.insert(std::make_pair(block_id,block(n_columns_)));
+        it = iit.first;
+      }
+      
+      bool was_set = (it->second.data()[col_id].get() != nullptr);
+      it->second.set_col(col_id, b);
+      
+      // only the column that completes the block wakes up the readers
+      if( !was_set && b && it->second.count_non_nil() == n_columns_ )
+      {
+        callbacks.swap(it->second.callbacks());
+        cond_.notify_all();
+      }
     }
     
-    // check if exists and create if not
-    auto it = blocks_.find(block_id);
-    if( it == blocks_.end() )
+    for( auto & cb : callbacks )
+      cb(block_id);
+  }
+  
+  template <typename T, size_t CHECK_TIMEOUT_MS>
+  void
+  table_collector<T,CHECK_TIMEOUT_MS>::table_collector::on_complete(size_t block_id,
+                                                   completion_callback cb)
+  {
+    if( !cb ) return;
+    
     {
-      auto iit = blocks_.insert(std::make_pair(block_id,block(n_columns_)));
-      it = iit.first;
+      lock l(mtx_);
+      // no column will complete an erased block, and a new entry for it
+      // would keep cb forever
+      if( is_erased(block_id) )
+        return;
+      
+      auto it = blocks_.find(block_id);
+      if( it == blocks_.end() )
+      {
+        auto iit = blocks_.insert(std::make_pair(block_id,block(n_columns_)));
+        it = iit.first;
+      }
+      
+      if( it->second.count_non_nil() != n_columns_ )
+      {
+        it->second.callbacks().push_back(cb);
+        return;
+      }
     }
     
-    it->second.set_col(col_id, b);
-    
-    cond_.notify_all();
+    cb(block_id);
   }
   
   template <typename T, size_t CHECK_TIMEOUT_MS>
@@ -231,6 +307,21 @@ namespace virtdb { namespace util {
     {
       it->second.reset();
     }
+    
+    // blocks are mostly erased in order, so the set stays small
+    if( block_id >= erased_below_ )
+    {
+      erased_.insert(block_id);
+      while( erased_.erase(erased_below_) )
+        ++erased_below_;
+    }
+  }
+  
+  template <typename T, size_t CHECK_TIMEOUT_MS>
+  bool
+  table_collector<T,CHECK_TIMEOUT_MS>::table_collector::is_erased(size_t block_id) const
+  {
+    return (block_id < erased_below_ || erased_.count(block_id) > 0);
   }
   
   template <typename T, size_t CHECK_TIMEOUT_MS>
@@ -240,41 +331,30 @@ namespace virtdb { namespace util {
   {
     row_data_ret ret{row_data(n_columns_, item_sptr()), 0};
     
-    {
-      // initial check for block state
-      lock l(mtx_);
-      
-      auto it = blocks_.find(block_id);
-      if( it != blocks_.end() &&
-          it->second.count_non_nil() == n_columns_ )
-      {
-        ret.first  = it->second.data();
-        ret.second = it->second.count_non_nil();
-        return ret;
-      }
-    }
-    
     auto wait_till = (std::chrono::steady_clock::now() +
                       std::chrono::milliseconds(timeout_ms));
     
-    while( stopped() == false )
-    {
-      lock l(mtx_);
-      cond_.wait_for(l, std::chrono::milliseconds(CHECK_TIMEOUT_MS));
-      
+    // the block state is checked under the same lock we wait on, so a
+    // completion between the check and the wait cannot be missed
+    lock l(mtx_);
+    auto collect = [&]() {
       auto it = blocks_.find(block_id);
       if( it != blocks_.end() )
       {
         ret.first  = it->second.data();
         ret.second = it->second.count_non_nil();
-        if( ret.second == n_columns_ )
-          return ret;
       }
-      
-      if( std::chrono::steady_clock::now() > wait_till )
-      {
+      return (ret.second == n_columns_);
+    };
+    
+    while( !collect() && !stopped() )
+    {
+      auto now = std::chrono::steady_clock::now();
+      if( now >= wait_till )
         break;
-      }
+      
+      auto slice = now + std::chrono::milliseconds(CHECK_TIMEOUT_MS);
+      cond_.wait_until(l, (slice < wait_till ? slice : wait_till));
     }
     return ret;
   }
@@ -1,8 +1,166 @@
 
 #include <util/utf8.hh>
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define VIRTDB_UTF8_X86 1
+#include <immintrin.h>
+#endif
 
 namespace virtdb { namespace util {
   
+  namespace
+  {
+    const uint64_t high_bits_ = 0x8080808080808080ULL;
+    const uint64_t low_bits_  = 0x0101010101010101ULL;
+    
+    size_t
+    ascii_prefix_scalar(const unsigned char * p, size_t len)
+    {
+      size_t pos = 0;
+      
+      // 8 bytes at a time: stop at the first word that has a high bit
+      // or a zero byte set
+      while( pos+8 <= len )
+      {
+        uint64_t w;
+        ::memcpy(&w, p+pos, 8);
+        if( (w & high_bits_) || ((w - low_bits_) & ~w & high_bits_) )
+          break;
+        pos += 8;
+      }
+      
+      while( pos < len && p[pos] < 128 && p[pos] != 0 )
+        ++pos;
+      
+      return pos;
+    }
+    
+#ifdef VIRTDB_UTF8_X86
+    // SSE2 is always there on x86_64
+    size_t
+    ascii_prefix_sse2(const unsigned char * p, size_t len)
+    {
+      size_t pos = 0;
+      const __m128i zero = _mm_setzero_si128();
+      
+      while( pos+16 <= len )
+      {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p+pos));
+        int mask = _mm_movemask_epi8(_mm_or_si128(chunk, _mm_cmpeq_epi8(chunk, zero)));
+        if( mask )
+          return pos + __builtin_ctz(mask);
+        pos += 16;
+      }
+      
+      return pos + ascii_prefix_scalar(p+pos, len-pos);
+    }
+    
+    __attribute__((target("avx2")))
+    size_t
+    ascii_prefix_avx2(const unsigned char * p, size_t len)
+    {
+      size_t pos = 0;
+      const __m256i zero = _mm256_setzero_si256();
+      
+      while( pos+32 <= len )
+      {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p+pos));
+        unsigned int mask = _mm256_movemask_epi8(_mm256_or_si256(chunk, _mm256_cmpeq_epi8(chunk, zero)));
+        if( mask )
+          return pos + __builtin_ctz(mask);
+        pos += 32;
+      }
+      
+      return pos + ascii_prefix_sse2(p+pos, len-pos);
+    }
+#endif
+    
+    typedef size_t (*ascii_prefix_fun)(const unsigned char *, size_t);
+    
+    ascii_prefix_fun
+    select_ascii_prefix()
+    {
+#ifdef VIRTDB_UTF8_X86
+      __builtin_cpu_init();
+      if( __builtin_cpu_supports("avx2") )
+        return &ascii_prefix_avx2;
+      return &ascii_prefix_sse2;
+#else
+      return &ascii_prefix_scalar;
+#endif
+    }
+    
+    size_t
+    ascii_prefix_dispatch(const unsigned char * p, size_t len)
+    {
+      // decided once, on first use
+      static const ascii_prefix_fun fun = select_ascii_prefix();
+      return fun(p, len);
+    }
+  }
+  
+  size_t
+  utf8::ascii_prefix(const char * p, size_t len)
+  {
+    if( !p || !len ) { return 0; }
+    return ascii_prefix_dispatch((const unsigned char *)p, len);
+  }
+  
+  bool
+  utf8::valid(const char * px, size_t len)
+  {
+    if( !px || !len ) { return true; }
+    
+    const unsigned char * p    = (const unsigned char *)px;
+    const unsigned char * end  = p+len;
+    
+    while( p != end )
+    {
+      p += ascii_prefix_dispatch(p, end-p);
+      if( p == end ) break;
+      
+      int code_len = 0;
+      if( ((*p)>>3) == 30 )       code_len = 4; // 11110
+      else if( ((*p)>>4) == 14 )  code_len = 3; // 1110
+      else if( ((*p)>>5) == 6 )   code_len = 2; // 110
+      else                        return false; // zero, continuation or garbage
+      
+      if( (end-p) < code_len ) return false;
+      for( int i=1; i<code_len; ++i )
+      {
+        if( (p[i]>>6) != 2 ) return false;
+      }
+      p += code_len;
+    }
+    return true;
+  }
+  
+  void
+  utf8::sanitize(char * p,
+                 const uint32_t * offsets,
+                 size_t n)
+  {
+    if( !p || !offsets || !n ) { return; }
+    
+    size_t pos = offsets[0];
+    size_t end = offsets[n];
+    
+    while( pos < end )
+    {
+      // most of the arena is expected to be clean, so only the values
+      // having something else than plain ASCII are looked at
+      pos += ascii_prefix_dispatch((const unsigned char *)p+pos, end-pos);
+      if( pos >= end ) break;
+      
+      // the last value that starts at or before pos
+      size_t i = (std::upper_bound(offsets, offsets+n+1, pos) - offsets) - 1;
+      sanitize(p+offsets[i], offsets[i+1]-offsets[i]);
+      pos = offsets[i+1];
+    }
+  }
+  
   void
   utf8::sanitize(char * px, size_t len)
   {
@@ -16,6 +174,15 @@ namespace virtdb { namespace util {
     
     while( p != end )
     {
+      // outside of a multibyte sequence a run of ASCII characters
+      // needs no change, skip it in one step
+      if( code_len == 1 && *p < 128 && *p != 0 )
+      {
+        p += ascii_prefix_dispatch(p, end-p);
+        code_pos = 0;
+        if( p == end ) break;
+      }
+      
       // in any case, we don't allow 0x0 inside an UTF-8 string
       if( *p == 0 ) *p = ' ';
       
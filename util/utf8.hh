@@ -1,5 +1,6 @@
 #pragma once
 #include <cstdint>
+#include <cstddef>
 #include <string>
 
 namespace virtdb { namespace util {
@@ -7,6 +8,19 @@ namespace virtdb { namespace util {
   struct utf8
   {
     static void sanitize(char * p, size_t len);
+    
+    // sanitizes all values of a column arena in one pass. the i-th
+    // value is [p+offsets[i], p+offsets[i+1]) and sequences are not
+    // allowed to span values
+    static void sanitize(char * p, const uint32_t * offsets, size_t n);
+    
+    // true if sanitize would leave the data untouched
+    static bool valid(const char * p, size_t len);
+    
+    // number of leading non-zero ASCII bytes. uses AVX2 or SSE2 when
+    // the CPU has them, this is what lets ASCII runs skip the state
+    // machine
+    static size_t ascii_prefix(const char * p, size_t len);
   };
   
 }}
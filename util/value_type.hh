@@ -3,6 +3,7 @@
 #include <common.pb.h>
 #include <string>
 #include <util/exception.hh>
+#include <util/null_bitmap.hh>
 #include <sstream>
 
 // TODO : polymorphic getter
@@ -36,6 +37,23 @@ namespace virtdb { namespace util {
         pb_vt.add_isnull(false);
       pb_vt.set_isnull(index, val);
     }
+    
+    // marks the nulls among the first n rows. IsNull is sized once up
+    // to the last null instead of growing it row by row
+    static void
+    set_nulls(interface::pb::ValueType & pb_vt,
+              const null_bitmap & nulls,
+              size_t n)
+    {
+      size_t end = nulls.end_of_nulls(n);
+      if( !end ) return;
+      
+      auto * isnull = pb_vt.mutable_isnull();
+      if( isnull->size() < static_cast<int>(end) )
+        isnull->Resize(static_cast<int>(end), false);
+      bool * dst = isnull->mutable_data();
+      nulls.for_each_null(n, [dst](size_t i) { dst[i] = true; });
+    }
   };
 
   template <typename T, interface::pb::Kind = interface::pb::Kind::STRING> struct value_type {};
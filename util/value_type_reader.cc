@@ -5,7 +5,7 @@
 namespace virtdb { namespace util {
   
   value_type_reader::value_type_reader()
-  : is_(nullptr, 0), null_pos_{0}, n_nulls_{0}
+  : is_(nullptr, 0), null_pos_{0}, n_nulls_{0}, kind_{0}
   {
   }
   
@@ -14,7 +14,8 @@ namespace virtdb { namespace util {
   : buffer_{std::move(buf)},
     is_((uint8_t *)buffer_.get(), len),
     null_pos_{0},
-    n_nulls_{0}
+    n_nulls_{0},
+    kind_{0}
   {
   }
 
@@ -28,7 +29,7 @@ namespace virtdb { namespace util {
       return ret;
     }
     
-    std::unique_ptr<uint32_t[]> tmp_nulls;
+    std::unique_ptr<uint64_t[]> tmp_nulls;
     size_t n_nulls = 0;
     size_t start_pos = 0;
     
@@ -62,13 +63,38 @@ namespace virtdb { namespace util {
         bool rv = tmp_is.ReadVarint32(&payload);
         if( rv )
         {
-          size_t null_size = 1+((payload+31)/32);
-          tmp_nulls.reset(new uint32_t[null_size]);
-          uint32_t * p = tmp_nulls.get();
-          ::memset(tmp_nulls.get(),0,(null_size*sizeof(uint32_t)));
+          // one spare word, so copy_null_bits can read ahead
+          size_t null_size = 1+((payload+63)/64);
+          tmp_nulls.reset(new uint64_t[null_size]);
+          uint64_t * p = tmp_nulls.get();
+          ::memset(tmp_nulls.get(),0,(null_size*sizeof(uint64_t)));
           
           int pos = tmp_is.CurrentPosition();
           int endpos = pos + payload;
+          
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+          // the flags are single byte varints unless someone wrote a
+          // non canonical encoding, so take 8 of them at once
+          const uint8_t * raw = (const uint8_t *)buf.get();
+          size_t fast = 0;
+          while( pos+8 <= endpos )
+          {
+            uint64_t w = 0;
+            ::memcpy(&w, raw+pos, 8);
+            if( w & 0x8080808080808080ULL )
+              break;
+            // 1 in the low bit of the non zero bytes
+            w = ((w + 0x7f7f7f7f7f7f7f7fULL) & 0x8080808080808080ULL) >> 7;
+            // gather the low bits of the 8 bytes into the top byte
+            uint64_t bits = (w * 0x0102040810204080ULL) >> 56;
+            p[n_nulls/64] |= (bits << (n_nulls&63));
+            n_nulls += 8;
+            pos += 8;
+            fast += 8;
+          }
+          tmp_is.Skip(fast);
+#endif
+          
           while( pos < endpos )
           {
             uint32_t val = 0;
@@ -76,8 +102,8 @@ namespace virtdb { namespace util {
             pos = tmp_is.CurrentPosition();
             if( val )
             {
-              uint32_t * px = p+(n_nulls/32);
-              uint32_t nval = (1<<(n_nulls&31));
+              uint64_t * px = p+(n_nulls/64);
+              uint64_t nval = (1ULL<<(n_nulls&63));
               *px = *px | nval;
             }
             ++n_nulls;
@@ -175,6 +201,7 @@ namespace virtdb { namespace util {
     
     ret->nulls_.swap(tmp_nulls);
     ret->n_nulls_ = n_nulls;
+    ret->kind_    = typ;
     return ret;
   }
   
@@ -5,6 +5,11 @@
 #include <google/protobuf/io/coded_stream.h>
 #include <memory>
 #include <vector>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 namespace virtdb { namespace util {
   
@@ -34,11 +39,16 @@ namespace virtdb { namespace util {
     stream_t                      is_;
     size_t                        null_pos_;
     size_t                        n_nulls_;
-    std::unique_ptr<uint32_t[]>   nulls_;
+    // bit (i%64) of word (i/64) is the IsNull flag of row i
+    std::unique_ptr<uint64_t[]>   nulls_;
+    uint32_t                      kind_;
     
   public:
     static sptr construct(buffer && buf, size_t len);
     
+    // interface::pb::Kind of the values or 0 if the buffer was empty
+    inline uint32_t kind() const { return kind_; }
+    
     // all input types have a corresponding reader class
     virtual inline status read_string(char ** ptr, size_t & len)  { return type_mismatch_; }
     virtual inline status read_int32(int32_t & v)                 { return type_mismatch_; }
@@ -54,13 +64,93 @@ namespace virtdb { namespace util {
     inline size_t null_pos() const { return null_pos_; }
     inline size_t n_nulls()  const { return n_nulls_; }
     
+    // batch readers fill up to n values and return the number of values
+    // read. this is less than n at the end of the stream and 0 on type
+    // mismatch. nulls may be nullptr if the caller is not interested
+    virtual inline size_t read_string_batch(char ** ptrs, size_t * lens, uint8_t * nulls, size_t n)  { return 0; }
+    virtual inline size_t read_int32_batch(int32_t * out, uint8_t * nulls, size_t n)                 { return 0; }
+    virtual inline size_t read_int64_batch(int64_t * out, uint8_t * nulls, size_t n)                 { return 0; }
+    virtual inline size_t read_uint32_batch(uint32_t * out, uint8_t * nulls, size_t n)               { return 0; }
+    virtual inline size_t read_uint64_batch(uint64_t * out, uint8_t * nulls, size_t n)               { return 0; }
+    virtual inline size_t read_double_batch(double * out, uint8_t * nulls, size_t n)                 { return 0; }
+    virtual inline size_t read_float_batch(float * out, uint8_t * nulls, size_t n)                   { return 0; }
+    virtual inline size_t read_bool_batch(bool * out, uint8_t * nulls, size_t n)                     { return 0; }
+    virtual inline size_t read_bytes_batch(char ** ptrs, size_t * lens, uint8_t * nulls, size_t n)   { return 0; }
+    
+    inline void read_null_batch(uint8_t * nulls, size_t n)
+    {
+      if( !nulls )
+      {
+        null_pos_ += n;
+        return;
+      }
+      
+      size_t i = 0;
+      // word at a time while we are inside the null bitmap
+      while( i < n && null_pos_ < n_nulls_ )
+      {
+        uint64_t w = nulls_.get()[null_pos_/64] >> (null_pos_&63);
+        size_t in_word = 64-(null_pos_&63);
+        size_t left_in_bitmap = n_nulls_-null_pos_;
+        if( in_word > left_in_bitmap ) in_word = left_in_bitmap;
+        if( in_word > (n-i) ) in_word = n-i;
+        if( !w )
+        {
+          ::memset(nulls+i, 0, in_word);
+        }
+        else
+        {
+          for( size_t b=0; b<in_word; ++b )
+          {
+            nulls[i+b] = (uint8_t)((w>>b)&1);
+          }
+        }
+        i += in_word;
+        null_pos_ += in_word;
+      }
+      
+      // no nulls past the end of the bitmap
+      if( i < n )
+      {
+        ::memset(nulls+i, 0, n-i);
+        null_pos_ += (n-i);
+      }
+    }
+    
+    // copies the null flags of rows [first, first+n) to out, bit (i%64)
+    // of out[i/64] belongs to row first+i. returns the number of nulls.
+    // the read position doesn't change
+    inline size_t copy_null_bits(size_t first, size_t n, uint64_t * out) const
+    {
+      size_t n_words = (n+63)/64;
+      size_t ret = 0;
+      const uint64_t * src = nulls_.get();
+      for( size_t w=0; w<n_words; ++w )
+      {
+        size_t pos = first+(w*64);
+        uint64_t bits = 0;
+        if( pos < n_nulls_ )
+        {
+          // the bitmap has a spare zero word at the end
+          size_t shift = pos&63;
+          bits = src[pos/64] >> shift;
+          if( shift ) bits |= (src[(pos/64)+1] << (64-shift));
+        }
+        if( w == n_words-1 && (n&63) )
+          bits &= ((1ULL << (n&63))-1);
+        out[w] = bits;
+        ret += __builtin_popcountll(bits);
+      }
+      return ret;
+    }
+    
     inline bool read_null()
     {
       bool ret = false;
       if( null_pos_ < n_nulls_ )
       {
-        uint32_t p = nulls_.get()[null_pos_/32];
-        ret = (((p>>(null_pos_&(31)))&1) == 1);
+        uint64_t p = nulls_.get()[null_pos_/64];
+        ret = (((p>>(null_pos_&63))&1) == 1);
       }
       ++null_pos_;
       return ret;
@@ -83,6 +173,72 @@ namespace virtdb { namespace util {
   
   namespace vtr_impl
   {
+    inline const uint8_t *
+    decode_varint(const uint8_t * p,
+                  const uint8_t * end,
+                  uint64_t & v)
+    {
+      uint64_t ret = 0;
+      int shift = 0;
+      while( p < end && shift < 64 )
+      {
+        uint8_t b = *p++;
+        ret |= ((uint64_t)(b&0x7f) << shift);
+        if( !(b&0x80) ) break;
+        shift += 7;
+      }
+      v = ret;
+      return p;
+    }
+    
+    // decodes up to n varints. runs of single byte varints are detected
+    // 16 bytes at a time (8 bytes without SSE2) and copied in a tight loop
+    template <typename X>
+    inline const uint8_t *
+    decode_varints(const uint8_t * p,
+                   const uint8_t * end,
+                   X * out,
+                   size_t n,
+                   size_t & decoded)
+    {
+      size_t i = 0;
+      while( i < n && p < end )
+      {
+#ifdef __SSE2__
+        if( (n-i) >= 16 && (end-p) >= 16 )
+        {
+          __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+          if( _mm_movemask_epi8(chunk) == 0 )
+          {
+            for( size_t b=0; b<16; ++b ) out[i+b] = (X)p[b];
+            i += 16;
+            p += 16;
+            continue;
+          }
+        }
+#else
+        if( (n-i) >= 8 && (end-p) >= 8 )
+        {
+          uint64_t chunk = 0;
+          ::memcpy(&chunk, p, sizeof(chunk));
+          if( (chunk & 0x8080808080808080ULL) == 0 )
+          {
+            for( size_t b=0; b<8; ++b ) out[i+b] = (X)p[b];
+            i += 8;
+            p += 8;
+            continue;
+          }
+        }
+#endif
+        uint64_t v = 0;
+        p = decode_varint(p, end, v);
+        out[i] = (X)v;
+        ++i;
+      }
+      decoded = i;
+      return p;
+    }
+    
     template <typename T, uint32_t TAG>
     class packed_reader : public value_type_reader
     {
@@ -106,7 +262,7 @@ namespace virtdb { namespace util {
           return end_of_stream_;
         }
       }
-
+      
       template <typename X>
       inline status
       read32(X & v, bool & null)
@@ -129,6 +285,38 @@ namespace virtdb { namespace util {
         return ( is_.CurrentPosition() < endpos_ );
       }
       
+      template <typename X>
+      inline size_t
+      read_varint_batch(X * out, uint8_t * nulls, size_t n)
+      {
+        int pos = is_.CurrentPosition();
+        if( pos >= endpos_ || !n || !out ) return 0;
+        
+        const uint8_t * begin = reinterpret_cast<const uint8_t *>(buffer_.get())+pos;
+        const uint8_t * end   = reinterpret_cast<const uint8_t *>(buffer_.get())+endpos_;
+        size_t decoded = 0;
+        const uint8_t * p = decode_varints(begin, end, out, n, decoded);
+        
+        is_.Skip(p-begin);
+        read_null_batch(nulls, decoded);
+        return decoded;
+      }
+      
+      inline size_t
+      read_fixed_batch(data_t * out, uint8_t * nulls, size_t n)
+      {
+        int pos = is_.CurrentPosition();
+        if( pos >= endpos_ || !n || !out ) return 0;
+        
+        size_t available = (endpos_-pos)/sizeof(data_t);
+        if( n > available ) n = available;
+        ::memcpy(out, buffer_.get()+pos, n*sizeof(data_t));
+        
+        is_.Skip(n*sizeof(data_t));
+        read_null_batch(nulls, n);
+        return n;
+      }
+      
       template <typename X>
       inline status
       read64(X & v)
@@ -144,7 +332,7 @@ namespace virtdb { namespace util {
           return end_of_stream_;
         }
       }
-
+      
       template <typename X>
       inline status
       read64(X & v, bool & null)
@@ -176,7 +364,7 @@ namespace virtdb { namespace util {
           return end_of_stream_;
         }
       }
-
+      
       inline status
       read(data_t & v, bool & null)
       {
@@ -239,7 +427,7 @@ namespace virtdb { namespace util {
           return end_of_stream_;
         }
       }
-
+      
       virtual inline status
       read(char ** ptr, size_t & rlen, bool & null)
       {
@@ -266,6 +454,25 @@ namespace virtdb { namespace util {
         return ( next_tag_ == TAG );
       }
       
+      inline size_t
+      read_batch(char ** ptrs, size_t * lens, uint8_t * nulls, size_t n)
+      {
+        if( !ptrs || !lens ) return 0;
+        size_t i = 0;
+        while( i < n && next_tag_ == TAG )
+        {
+          uint32_t len = 0;
+          is_.ReadVarint32(&len);
+          ptrs[i] = buffer_.get()+is_.CurrentPosition();
+          lens[i] = len;
+          is_.Skip(len);
+          next_tag_ = is_.ReadTag();
+          ++i;
+        }
+        read_null_batch(nulls, i);
+        return i;
+      }
+      
       inline
       buffer_reader(buffer && buf, size_t len, size_t start_pos)
       : value_type_reader(std::move(buf),len),
@@ -288,6 +495,7 @@ namespace virtdb { namespace util {
     public:
       virtual inline status read_string(char ** ptr, size_t & len) { return read(ptr,len); }
       virtual inline status read_string(char ** ptr, size_t & len, bool & null) { return read(ptr,len, null); }
+      virtual inline size_t read_string_batch(char ** ptrs, size_t * lens, uint8_t * nulls, size_t n) { return read_batch(ptrs,lens,nulls,n); }
       virtual ~string_reader() {}
     };
     
@@ -311,6 +519,7 @@ namespace virtdb { namespace util {
         v = n;
         return ret;
       }
+      virtual inline size_t read_int32_batch(int32_t * out, uint8_t * nulls, size_t n) { return read_varint_batch(out,nulls,n); }
       virtual ~int32_reader() {}
     };
     
@@ -334,6 +543,7 @@ namespace virtdb { namespace util {
         v = n;
         return ret;
       }
+      virtual inline size_t read_int64_batch(int64_t * out, uint8_t * nulls, size_t n) { return read_varint_batch(out,nulls,n); }
       virtual ~int64_reader() {}
     };
     
@@ -345,6 +555,7 @@ namespace virtdb { namespace util {
     public:
       virtual inline status read_uint32(uint32_t & v) { return read32(v); }
       virtual inline status read_uint32(uint32_t & v, bool & null) { return read32(v,null); }
+      virtual inline size_t read_uint32_batch(uint32_t * out, uint8_t * nulls, size_t n) { return read_varint_batch(out,nulls,n); }
       virtual ~uint32_reader() {}
     };
     
@@ -356,6 +567,7 @@ namespace virtdb { namespace util {
     public:
       virtual inline status read_uint64(uint64_t & v) { return read64(v); }
       virtual inline status read_uint64(uint64_t & v, bool & null) { return read64(v,null); }
+      virtual inline size_t read_uint64_batch(uint64_t * out, uint8_t * nulls, size_t n) { return read_varint_batch(out,nulls,n); }
       virtual ~uint64_reader() {}
     };
     
@@ -367,6 +579,7 @@ namespace virtdb { namespace util {
     public:
       virtual inline status read_double(double & v) { return read(v); }
       virtual inline status read_double(double & v, bool & null) { return read(v,null); }
+      virtual inline size_t read_double_batch(double * out, uint8_t * nulls, size_t n) { return read_fixed_batch(out,nulls,n); }
       virtual ~double_reader() {}
     };
     
@@ -378,6 +591,7 @@ namespace virtdb { namespace util {
     public:
       virtual inline status read_float(float & v) { return read(v); }
       virtual inline status read_float(float & v, bool & null) { return read(v,null); }
+      virtual inline size_t read_float_batch(float * out, uint8_t * nulls, size_t n) { return read_fixed_batch(out,nulls,n); }
       virtual ~float_reader() {}
     };
     
@@ -401,6 +615,7 @@ namespace virtdb { namespace util {
         v = (v32 != 0);
         return ret;
       }
+      virtual inline size_t read_bool_batch(bool * out, uint8_t * nulls, size_t n) { return read_varint_batch(out,nulls,n); }
       virtual ~bool_reader() {}
     };
     
@@ -412,6 +627,7 @@ namespace virtdb { namespace util {
     public:
       virtual inline status read_bytes(char ** ptr, size_t & len) { return read(ptr,len); }
       virtual inline status read_bytes(char ** ptr, size_t & len, bool & null) { return read(ptr,len,null); }
+      virtual inline size_t read_bytes_batch(char ** ptrs, size_t * lens, uint8_t * nulls, size_t n) { return read_batch(ptrs,lens,nulls,n); }
       virtual ~bytes_reader() {}
     };
   }
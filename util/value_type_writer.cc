@@ -7,13 +7,15 @@ namespace virtdb { namespace util {
                                        size_t initial_mempool_size,
                                        size_t estimated_item_count)
   : mpool_(initial_mempool_size),
+    kind_{kind},
     root_{0,0,0,0},
     nulls_{0,0,0,0},
     estimated_item_count_{estimated_item_count},
     last_null_{0},
     null_part_chain_{nullptr},
     null_part_{nullptr},
-    null_offset_{0}
+    null_offset_{0},
+    n_items_{0}
   {
     using namespace google::protobuf::io;
     
@@ -30,6 +32,36 @@ namespace virtdb { namespace util {
     CodedOutputStream::WriteTagToArray((11<<3)+2, nulls_.parts_[0].head_);
   }
   
+  size_t
+  value_type_writer::byte_size() const
+  {
+    size_t ret = 0;
+    const part_chain * p = &root_;
+    while( p )
+    {
+      for( size_t i=0; i<p->n_parts_; ++i )
+        ret += p->parts_[i].n_used_;
+      p = p->next_;
+    }
+    return ret;
+  }
+  
+  void
+  value_type_writer::copy_to(char * dest) const
+  {
+    const part_chain * p = &root_;
+    while( p )
+    {
+      for( size_t i=0; i<p->n_parts_; ++i )
+      {
+        if( !p->parts_[i].n_used_ ) continue;
+        ::memcpy(dest, p->parts_[i].data_, p->parts_[i].n_used_);
+        dest += p->parts_[i].n_used_;
+      }
+      p = p->next_;
+    }
+  }
+  
   value_type_writer::sptr
   value_type_writer::construct(interface::pb::Kind kind,
                                size_t estimated_item_count)
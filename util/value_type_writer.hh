@@ -1,12 +1,14 @@
 #pragma once
 
 #include <util/exception.hh>
-#include <util/mempool.hh>
+#include <util/cached_mempool.hh>
 #include <common.pb.h>
 #include <google/protobuf/io/coded_stream.h>
 #include <memory>
 #include <vector>
 #include <functional>
+#include <algorithm>
+#include <cstring>
 
 namespace virtdb { namespace util {
   
@@ -51,7 +53,8 @@ namespace virtdb { namespace util {
     };
     
   protected:
-    mempool             mpool_;
+    cached_mempool      mpool_;
+    interface::pb::Kind kind_;
     part_chain          root_;
     part_chain          nulls_;
     const size_t        estimated_item_count_;
@@ -59,6 +62,7 @@ namespace virtdb { namespace util {
     part_chain *        null_part_chain_;
     part *              null_part_;
     size_t              null_offset_;
+    size_t              n_items_;
     
     value_type_writer() = delete;
     value_type_writer& operator=(const value_type_writer &) = delete;
@@ -75,6 +79,16 @@ namespace virtdb { namespace util {
     virtual ~value_type_writer() {}
     
     inline const part_chain * get_parts() const { return &root_; }
+    inline interface::pb::Kind kind() const { return kind_; }
+    
+    // size of the serialized ValueType, which is the concatenation of
+    // the parts. copy_to() flattens it into a buffer of this size
+    size_t byte_size() const;
+    void copy_to(char * dest) const;
+    
+    // number of values written so far, the batch writers continue
+    // from this position when they mark the nulls
+    inline size_t n_items() const { return n_items_; }
     
     // string and bytes type tell how much space they need
     // and the passed function will receive the allocated buffer.
@@ -96,6 +110,42 @@ namespace virtdb { namespace util {
     virtual inline void write_float(float v)      { }
     virtual inline void write_bool(bool v)        { }
     
+    // batch writers encode n values at once into the part chain. nulls
+    // may be null, otherwise the values at the positions where nulls[i]
+    // is true are written as zero (empty string) and marked as null
+    virtual inline void write_int32_batch(const int32_t * v, const bool * nulls, size_t n)    { }
+    virtual inline void write_int64_batch(const int64_t * v, const bool * nulls, size_t n)    { }
+    virtual inline void write_uint32_batch(const uint32_t * v, const bool * nulls, size_t n)  { }
+    virtual inline void write_uint64_batch(const uint64_t * v, const bool * nulls, size_t n)  { }
+    virtual inline void write_double_batch(const double * v, const bool * nulls, size_t n)    { }
+    virtual inline void write_float_batch(const float * v, const bool * nulls, size_t n)      { }
+    virtual inline void write_bool_batch(const bool * v, const bool * nulls, size_t n)        { }
+    
+    // the i-th string is [base+offsets[i], base+offsets[i+1]) so offsets
+    // must have n+1 items
+    virtual inline void write_strings(const char * base,
+                                      const uint32_t * offsets,
+                                      const bool * nulls,
+                                      size_t n)                                             { }
+    virtual inline void write_bytes_batch(const char * base,
+                                          const uint32_t * offsets,
+                                          const bool * nulls,
+                                          size_t n)                                         { }
+    
+    // fixed width layout: the i-th value is sizes[i] bytes at base+(i*stride).
+    // null_bits is a packed bitmap like in set_null_bits() or null, the
+    // null values are written as empty strings
+    virtual inline void write_strings_strided(const char * base,
+                                              size_t stride,
+                                              const size_t * sizes,
+                                              const uint64_t * null_bits,
+                                              size_t n)                                     { }
+    virtual inline void write_bytes_strided(const char * base,
+                                            size_t stride,
+                                            const size_t * sizes,
+                                            const uint64_t * null_bits,
+                                            size_t n)                                       { }
+    
     inline void
     allocate_more_null_area(size_t requested_space)
     {
@@ -108,6 +158,9 @@ namespace virtdb { namespace util {
         auto * new_chain = mpool_.allocate<part_chain>(1);
         new_chain->allocate(mpool_,8);
         
+        // the positions in the previous part are all accounted for
+        null_part_->n_used_ = prev_alloc;
+        
         auto old_chain    = null_part_chain_;
         null_part_chain_  = new_chain;
         null_part_         = new_chain->parts_;
@@ -120,6 +173,7 @@ namespace virtdb { namespace util {
       else
       {
         // we have empty slot in the actual part chain
+        null_part_->n_used_ = prev_alloc;
         auto pos = null_part_chain_->n_parts_;
         ++(null_part_chain_->n_parts_);
         null_part_ = null_part_chain_->parts_ + pos;
@@ -133,13 +187,22 @@ namespace virtdb { namespace util {
       
       // finally allocate space and update free space and buffer
       null_part_->allocate(mpool_, to_allocate);
+      ::memset(null_part_->head_, 0, to_allocate);
       null_offset_ += prev_alloc;
     }
     
-    inline void set_null(size_t pos)
+    inline void
+    update_null_payload()
     {
       using namespace google::protobuf::io;
       
+      uint8_t * payload_end = CodedOutputStream::WriteVarint32ToArray(last_null_, nulls_.parts_[0].data_+1);
+      size_t n_used = payload_end-nulls_.parts_[0].data_;
+      nulls_.parts_[0].n_used_ = n_used;
+    }
+    
+    inline void set_null(size_t pos)
+    {
       size_t act_pos = pos - null_offset_;
       if( act_pos < null_part_->n_allocated_ )
       {
@@ -147,18 +210,83 @@ namespace virtdb { namespace util {
           null_part_->n_used_ = act_pos+1;
         null_part_->data_[act_pos] = 1;
         
-        if( pos > last_null_ )
+        if( pos >= last_null_ )
           last_null_ = (pos+1);
         
-        uint8_t * payload_end = CodedOutputStream::WriteVarint32ToArray(last_null_, nulls_.parts_[0].data_+1);
-        size_t n_used = payload_end-nulls_.parts_[0].data_;
-        nulls_.parts_[0].n_used_ = n_used;
+        update_null_payload();
         return;
       }
       
       allocate_more_null_area(act_pos+1);
       set_null(pos);
     }
+    
+    // flags pos in the IsNull area without rewriting the payload
+    inline void mark_null(size_t pos)
+    {
+      size_t act_pos = pos - null_offset_;
+      if( act_pos >= null_part_->n_allocated_ )
+      {
+        allocate_more_null_area(act_pos+1);
+        act_pos = pos - null_offset_;
+      }
+      if( act_pos >= null_part_->n_used_ )
+        null_part_->n_used_ = act_pos+1;
+      null_part_->data_[act_pos] = 1;
+    }
+    
+    // marks nulls[i] at first_pos+i, the IsNull payload is only
+    // rewritten once for the whole batch
+    inline void
+    set_nulls(size_t first_pos, const bool * nulls, size_t n)
+    {
+      size_t last_null = last_null_;
+      for( size_t i=0; i<n; ++i )
+      {
+        if( !nulls[i] ) continue;
+        
+        size_t pos = first_pos+i;
+        mark_null(pos);
+        if( pos >= last_null )
+          last_null = (pos+1);
+      }
+      
+      if( last_null != last_null_ )
+      {
+        last_null_ = last_null;
+        update_null_payload();
+      }
+    }
+    
+    // same with a packed bitmap: bit (i%64) of bits[i/64] marks
+    // first_pos+i, words without nulls are skipped at once
+    inline void
+    set_null_bits(size_t first_pos, const uint64_t * bits, size_t n)
+    {
+      size_t last_null = last_null_;
+      size_t n_words = (n+63)/64;
+      for( size_t w=0; w<n_words; ++w )
+      {
+        uint64_t word = bits[w];
+        if( w == n_words-1 && (n&63) )
+          word &= ((1ULL << (n&63))-1);
+        
+        while( word )
+        {
+          size_t pos = first_pos+(w*64)+__builtin_ctzll(word);
+          word &= (word-1);
+          mark_null(pos);
+          if( pos >= last_null )
+            last_null = (pos+1);
+        }
+      }
+      
+      if( last_null != last_null_ )
+      {
+        last_null_ = last_null;
+        update_null_payload();
+      }
+    }
   };
   
   namespace vtw_impl
@@ -251,7 +379,16 @@ namespace virtdb { namespace util {
         act_buffer_       = act_part_->head_;
         act_free_bytes_   = act_part_->n_allocated_;
       }
-
+      
+      inline void
+      update_payload()
+      {
+        using namespace google::protobuf::io;
+        
+        auto * res = CodedOutputStream::WriteVarint32ToArray(payload_, payload_start_);
+        root_.parts_[0].n_used_ = res-root_.parts_[0].head_;
+      }
+      
       inline void
       write32(uint32_t v)
       {
@@ -266,9 +403,9 @@ namespace virtdb { namespace util {
           act_free_bytes_ -= written;
           payload_ += written;
           act_part_->n_used_ += written;
+          ++n_items_;
           // update payload
-          auto * res = CodedOutputStream::WriteVarint32ToArray(payload_, payload_start_);
-          root_.parts_[0].n_used_ = res-root_.parts_[0].head_;
+          update_payload();
           return;
         }
         
@@ -290,14 +427,14 @@ namespace virtdb { namespace util {
           act_free_bytes_ -= written;
           payload_ += written;
           act_part_->n_used_ += written;
+          ++n_items_;
           // update payload
-          auto * res = CodedOutputStream::WriteVarint32ToArray(payload_, payload_start_);
-          root_.parts_[0].n_used_ = res-root_.parts_[0].head_;
+          update_payload();
           return;
         }
         
         allocate_more_write_area();
-        write32(v);
+        write64(v);
       }
       
       inline void
@@ -314,17 +451,101 @@ namespace virtdb { namespace util {
           act_free_bytes_ -= written;
           payload_ += written;
           act_part_->n_used_ += written;
+          ++n_items_;
           // update payload
-          auto * res = CodedOutputStream::WriteVarint32ToArray(payload_, payload_start_);
-          root_.parts_[0].n_used_ = res-root_.parts_[0].head_;
+          update_payload();
           return;
         }
         
         allocate_more_write_area();
-        write32(v);
+        write(v);
+      }
+      
+      // encodes a chunk of values at once, as much as fits into the
+      // actual write area, so the bookkeeping is only done per chunk
+      template <typename IN, typename ENCODER>
+      inline void
+      write_varint_batch(const IN * values,
+                         const bool * nulls,
+                         size_t n,
+                         ENCODER encode)
+      {
+        size_t first_pos = n_items_;
+        size_t done      = 0;
+        
+        while( done < n )
+        {
+          if( act_free_bytes_ < max_item_size_ )
+            allocate_more_write_area();
+          
+          size_t end = done + std::min(n-done, act_free_bytes_/max_item_size_);
+          uint8_t * start = act_buffer_;
+          uint8_t * pos   = start;
+          
+          if( nulls )
+          {
+            for( size_t i=done; i<end; ++i )
+              pos = encode((nulls[i] ? IN() : values[i]), pos);
+          }
+          else
+          {
+            for( size_t i=done; i<end; ++i )
+              pos = encode(values[i], pos);
+          }
+          
+          size_t written = pos-start;
+          act_buffer_         = pos;
+          act_free_bytes_    -= written;
+          payload_           += written;
+          act_part_->n_used_ += written;
+          done                = end;
+        }
+        
+        n_items_ += n;
+        update_payload();
+        if( nulls ) set_nulls(first_pos, nulls, n);
+      }
+      
+      // fixed size values are copied as they are
+      inline void
+      write_raw_batch(const data_t * values,
+                      const bool * nulls,
+                      size_t n)
+      {
+        size_t first_pos = n_items_;
+        size_t done      = 0;
+        
+        while( done < n )
+        {
+          if( act_free_bytes_ < sizeof(data_t) )
+            allocate_more_write_area();
+          
+          size_t chunk = std::min(n-done, act_free_bytes_/sizeof(data_t));
+          size_t written = chunk*sizeof(data_t);
+          ::memcpy(act_buffer_, values+done, written);
+          
+          if( nulls )
+          {
+            for( size_t i=0; i<chunk; ++i )
+            {
+              if( nulls[done+i] )
+                ::memset(act_buffer_+(i*sizeof(data_t)), 0, sizeof(data_t));
+            }
+          }
+          
+          act_buffer_        += written;
+          act_free_bytes_    -= written;
+          payload_           += written;
+          act_part_->n_used_ += written;
+          done               += chunk;
+        }
+        
+        n_items_ += n;
+        update_payload();
+        if( nulls ) set_nulls(first_pos, nulls, n);
       }
     };
-
+    
     template <uint32_t TAG, interface::pb::Kind KIND, size_t LEN>
     class fixlen_writer : public value_type_writer
     {
@@ -426,6 +647,7 @@ namespace virtdb { namespace util {
           *payload_pos = u8_used;
           act_free_bytes_ -= (2+u8_used);
           act_part_->n_used_ += (2+u8_used);
+          ++n_items_;
           return;
         }
         
@@ -501,9 +723,19 @@ namespace virtdb { namespace util {
           // update members
           p->data_ = data_start;
           p->n_used_ = used+payload_len+1;
+          ++n_items_;
           return;
         }
         
+        add_part_chain();
+        
+        // need to retry this
+        write(desired_size, fun);
+      }
+      
+      inline void
+      add_part_chain()
+      {
         // we have eaten up all space in the current part_chain, will need a new part_chain
         auto * new_chain = mpool_.allocate<part_chain>(1);
         new_chain->allocate(mpool_,act_part_chain_->n_allocated_);
@@ -514,9 +746,89 @@ namespace virtdb { namespace util {
         // chain this in
         act_part_chain_->next_  = old_chain->next_;
         old_chain->next_        = act_part_chain_;
-
-        // need to retry this
-        write(desired_size, fun);
+      }
+      
+      // the whole batch goes into a single part: { Tag, Size, Data } for
+      // every item, the unused tail is given back to the mempool. item(i,src)
+      // sets src and returns the length of the i-th value, data_bytes is
+      // the sum of the lengths
+      template <typename ITEM>
+      inline void
+      write_items(size_t n,
+                  size_t data_bytes,
+                  ITEM item)
+      {
+        using namespace google::protobuf::io;
+        
+        if( !n ) return;
+        
+        if( act_part_chain_->n_parts_ == act_part_chain_->n_allocated_ )
+          add_part_chain();
+        
+        // tag is a single byte, the size is at most 5 bytes
+        size_t to_allocate = data_bytes + (6*n);
+        part * p = act_part_chain_->parts_ + act_part_chain_->n_parts_;
+        p->allocate(mpool_, to_allocate);
+        ++(act_part_chain_->n_parts_);
+        
+        uint8_t * pos = p->data_;
+        for( size_t i=0; i<n; ++i )
+        {
+          const char * src = nullptr;
+          uint32_t len = item(i, src);
+          *pos++ = TAG;
+          pos = CodedOutputStream::WriteVarint32ToArray(len, pos);
+          if( len ) ::memcpy(pos, src, len);
+          pos += len;
+        }
+        
+        p->n_used_ = pos-p->data_;
+        size_t to_reuse = to_allocate-p->n_used_;
+        mpool_.reuse<uint8_t>(to_reuse);
+        p->n_allocated_ -= to_reuse;
+        
+        n_items_ += n;
+      }
+      
+      inline void
+      write_batch(const char * base,
+                  const uint32_t * offsets,
+                  const bool * nulls,
+                  size_t n)
+      {
+        if( !n ) return;
+        
+        size_t first_pos = n_items_;
+        write_items(n, offsets[n]-offsets[0], [base,offsets,nulls](size_t i, const char *& src) {
+          src = base+offsets[i];
+          return (nulls && nulls[i]) ? 0 : (offsets[i+1]-offsets[i]);
+        });
+        if( nulls ) set_nulls(first_pos, nulls, n);
+      }
+      
+      inline void
+      write_strided_batch(const char * base,
+                          size_t stride,
+                          const size_t * sizes,
+                          const uint64_t * null_bits,
+                          size_t n)
+      {
+        if( !n ) return;
+        
+        auto is_null = [null_bits](size_t i) {
+          return null_bits && ((null_bits[i>>6] >> (i&63)) & 1);
+        };
+        
+        size_t data_bytes = 0;
+        for( size_t i=0; i<n; ++i )
+          if( !is_null(i) ) data_bytes += sizes[i];
+        
+        size_t first_pos = n_items_;
+        write_items(n, data_bytes, [base,stride,sizes,&is_null](size_t i, const char *& src) {
+          src = base+(i*stride);
+          return is_null(i) ? 0 : static_cast<uint32_t>(sizes[i]);
+        });
+        if( null_bits ) set_null_bits(first_pos, null_bits, n);
       }
     };
     
@@ -533,6 +845,25 @@ namespace virtdb { namespace util {
       {
         write(desired_size, fun);
       }
+      
+      inline void
+      write_strings(const char * base,
+                    const uint32_t * offsets,
+                    const bool * nulls,
+                    size_t n)
+      {
+        write_batch(base, offsets, nulls, n);
+      }
+      
+      inline void
+      write_strings_strided(const char * base,
+                            size_t stride,
+                            const size_t * sizes,
+                            const uint64_t * null_bits,
+                            size_t n)
+      {
+        write_strided_batch(base, stride, sizes, null_bits, n);
+      }
     };
     
     class date_writer : public fixlen_writer<((2<<3)+2),interface::pb::Kind::DATE,8>
@@ -573,6 +904,14 @@ namespace virtdb { namespace util {
         uint32_t vv = v;
         write32(vv);
       }
+      
+      inline void
+      write_int32_batch(const int32_t * v, const bool * nulls, size_t n)
+      {
+        write_varint_batch(v, nulls, n, [](uint32_t v, uint8_t * pos) {
+          return google::protobuf::io::CodedOutputStream::WriteVarint32ToArray(v, pos);
+        });
+      }
     };
     
     class int64_writer : public packed_writer<int64_t,((4<<3)+2),interface::pb::Kind::INT64>
@@ -586,6 +925,14 @@ namespace virtdb { namespace util {
         uint64_t vv = v;
         write64(vv);
       }
+      
+      inline void
+      write_int64_batch(const int64_t * v, const bool * nulls, size_t n)
+      {
+        write_varint_batch(v, nulls, n, [](uint64_t v, uint8_t * pos) {
+          return google::protobuf::io::CodedOutputStream::WriteVarint64ToArray(v, pos);
+        });
+      }
     };
     
     class uint32_writer : public packed_writer<uint32_t,((5<<3)+2),interface::pb::Kind::UINT32>
@@ -598,6 +945,14 @@ namespace virtdb { namespace util {
       {
         write32(v);
       }
+      
+      inline void
+      write_uint32_batch(const uint32_t * v, const bool * nulls, size_t n)
+      {
+        write_varint_batch(v, nulls, n, [](uint32_t v, uint8_t * pos) {
+          return google::protobuf::io::CodedOutputStream::WriteVarint32ToArray(v, pos);
+        });
+      }
     };
     
     class uint64_writer : public packed_writer<uint64_t,((6<<3)+2),interface::pb::Kind::UINT64>
@@ -611,6 +966,14 @@ namespace virtdb { namespace util {
       {
         write64(v);
       }
+      
+      inline void
+      write_uint64_batch(const uint64_t * v, const bool * nulls, size_t n)
+      {
+        write_varint_batch(v, nulls, n, [](uint64_t v, uint8_t * pos) {
+          return google::protobuf::io::CodedOutputStream::WriteVarint64ToArray(v, pos);
+        });
+      }
     };
     
     class double_writer : public packed_writer<double,((7<<3)+2),interface::pb::Kind::DOUBLE>
@@ -624,6 +987,12 @@ namespace virtdb { namespace util {
       {
         write(v);
       }
+      
+      inline void
+      write_double_batch(const double * v, const bool * nulls, size_t n)
+      {
+        write_raw_batch(v, nulls, n);
+      }
     };
     
     class float_writer : public packed_writer<float,((8<<3)+2),interface::pb::Kind::FLOAT>
@@ -637,6 +1006,12 @@ namespace virtdb { namespace util {
       {
         write(v);
       }
+      
+      inline void
+      write_float_batch(const float * v, const bool * nulls, size_t n)
+      {
+        write_raw_batch(v, nulls, n);
+      }
     };
     
     class bool_writer : public packed_writer<bool,((9<<3)+2),interface::pb::Kind::BOOL>
@@ -650,6 +1025,15 @@ namespace virtdb { namespace util {
       {
         write32((v?1:0));
       }
+      
+      inline void
+      write_bool_batch(const bool * v, const bool * nulls, size_t n)
+      {
+        write_varint_batch(v, nulls, n, [](bool v, uint8_t * pos) {
+          *pos = (v?1:0);
+          return pos+1;
+        });
+      }
     };
     
     class bytes_writer : public buffer_writer<((10<<3)+2),interface::pb::Kind::BYTES>
@@ -665,6 +1049,25 @@ namespace virtdb { namespace util {
       {
         write(desired_size, fun);
       }
+      
+      inline void
+      write_bytes_batch(const char * base,
+                        const uint32_t * offsets,
+                        const bool * nulls,
+                        size_t n)
+      {
+        write_batch(base, offsets, nulls, n);
+      }
+      
+      inline void
+      write_bytes_strided(const char * base,
+                          size_t stride,
+                          const size_t * sizes,
+                          const uint64_t * null_bits,
+                          size_t n)
+      {
+        write_strided_batch(base, stride, sizes, null_bits, n);
+      }
     };
   }
 }}
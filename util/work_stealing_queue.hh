@@ -0,0 +1,290 @@
+#pragma once
+
+#include <util/barrier.hh>
+#include <util/exception.hh>
+#include <util/constants.hh>
+
+#include <deque>
+#include <thread>
+#include <condition_variable>
+#include <mutex>
+#include <chrono>
+#include <functional>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <iostream>
+
+namespace virtdb { namespace util {
+
+  // same interface as active_queue, but every worker has its own deque
+  // so the workers don't contend on a single lock. pushed items are
+  // spread between the deques and idle workers steal from the others
+  template <typename ITEM, unsigned long WAKEUP_FREQ=DEFAULT_TIMEOUT_MS>
+  class work_stealing_queue final
+  {
+  public:
+    typedef std::function<void(ITEM)> item_handler;
+
+  private:
+    typedef std::mutex                   mtx;
+    typedef std::condition_variable      cond;
+    typedef std::vector<std::thread>     thread_vector;
+    typedef std::atomic<bool>            flag;
+    typedef std::atomic<uint64_t>        counter;
+    typedef std::unique_lock<mtx>        lock;
+    
+    struct worker_deque
+    {
+      mtx               mutex_;
+      std::deque<ITEM>  items_;
+    };
+    
+    typedef std::unique_ptr<worker_deque>    deque_uptr;
+    typedef std::vector<deque_uptr>          deque_vector;
+    
+    work_stealing_queue() = delete;
+    work_stealing_queue(const work_stealing_queue&) = delete;
+    work_stealing_queue & operator=(const work_stealing_queue &) = delete;
+    
+    // the mutexes are only taken when a worker sleeps or somebody
+    // waits for progress, the counters don't need them
+    deque_vector            deques_;
+    counter                 next_deque_;
+    counter                 pending_;
+    counter                 n_sleeping_;
+    counter                 n_stolen_;
+    mtx                     sleep_mutex_;
+    cond                    sleep_cond_;
+    mutable mtx             progress_mutex_;
+    cond                    progress_cond_;
+    counter                 enqueued_;
+    counter                 done_;
+    counter                 n_progress_waiting_;
+    barrier                 barrier_;
+    item_handler            handler_;
+    thread_vector           threads_;
+    flag                    stop_;
+
+  public:
+    static const unsigned int wakeup_freq() { return WAKEUP_FREQ; }
+    
+    work_stealing_queue(unsigned int nthreads, item_handler handler)
+    : next_deque_{0},
+      pending_{0},
+      n_sleeping_{0},
+      n_stolen_{0},
+      enqueued_{0},
+      done_{0},
+      n_progress_waiting_{0},
+      barrier_((nthreads ? nthreads : 1)+1),
+      handler_(handler),
+      stop_(false)
+    {
+      if( !nthreads ) nthreads = 1;
+      
+      for( unsigned int i=0; i<nthreads; ++i )
+      {
+        deques_.push_back(deque_uptr{new worker_deque});
+      }
+      
+      // starting all threads in the constructor
+      for( unsigned int i=0; i<nthreads; ++i )
+      {
+        threads_.push_back(std::thread(std::bind(&work_stealing_queue::entry,this,i)));
+      }
+      
+      // this won't return till all threads are ready
+      barrier_.wait();
+      std::this_thread::yield();
+    }
+    
+    uint64_t n_done() const
+    {
+      return done_.load();
+    }
+    
+    uint64_t n_enqueued() const
+    {
+      return enqueued_.load();
+    }
+    
+    uint64_t n_stolen() const
+    {
+      return n_stolen_;
+    }
+    
+    size_t n_threads() const
+    {
+      return deques_.size();
+    }
+    
+    void push(const ITEM & i)
+    {
+      ITEM tmp{i};
+      push(std::move(tmp));
+    }
+    
+    void push(ITEM && i)
+    {
+      if( stopped() ) return;
+      ++enqueued_;
+      ++pending_;
+      {
+        worker_deque & d = *(deques_[(next_deque_++) % deques_.size()]);
+        lock l(d.mutex_);
+        d.items_.push_back(std::move(i));
+      }
+      
+      // only pay for the notification when somebody sleeps
+      if( n_sleeping_ > 0 )
+      {
+        lock l(sleep_mutex_);
+        sleep_cond_.notify_one();
+      }
+    }
+    
+    bool stopped() const
+    {
+      return stop_;
+    }
+    
+    template <typename T>
+    bool wait_empty(const T & progress_for)
+    {
+      uint64_t enqueued_items = enqueued_;
+      uint64_t done_items     = done_;
+      
+      while( enqueued_items > done_items && !stopped() )
+      {
+        uint64_t last_done = done_items;
+        std::cv_status cvstat = std::cv_status::no_timeout;
+        
+        {
+          lock l(progress_mutex_);
+          ++n_progress_waiting_;
+          
+          if( enqueued_ > done_ )
+          {
+            // give time to the threads to progress
+            cvstat = progress_cond_.wait_for(l, progress_for);
+          }
+          
+          --n_progress_waiting_;
+          enqueued_items = enqueued_;
+          done_items     = done_;
+        }
+        
+        // if no progress has been made, then stop waiting for them
+        if( last_done == done_items &&
+            cvstat == std::cv_status::timeout )
+        {
+          break;
+        }
+      }
+      
+      return (enqueued_items == done_items);
+    }
+    
+    void stop()
+    {
+      stop_ = true;
+      {
+        lock l(sleep_mutex_);
+        sleep_cond_.notify_all();
+      }
+      {
+        lock l(progress_mutex_);
+        progress_cond_.notify_all();
+      }
+      for( auto & t : threads_ )
+      {
+        if( t.joinable() )
+          t.join();
+      }
+    }
+    
+    ~work_stealing_queue()
+    {
+      stop();
+    }
+
+  private:
+    bool pop_own(size_t id, ITEM & tmp)
+    {
+      worker_deque & d = *(deques_[id]);
+      lock l(d.mutex_);
+      if( d.items_.empty() ) return false;
+      tmp = std::move(d.items_.front());
+      d.items_.pop_front();
+      return true;
+    }
+    
+    bool steal(size_t id, ITEM & tmp)
+    {
+      size_t n = deques_.size();
+      for( size_t i=1; i<n; ++i )
+      {
+        worker_deque & d = *(deques_[(id+i)%n]);
+        // don't wait for a busy victim, try the next one
+        lock l(d.mutex_, std::try_to_lock);
+        if( !l.owns_lock() || d.items_.empty() ) continue;
+        tmp = std::move(d.items_.back());
+        d.items_.pop_back();
+        ++n_stolen_;
+        return true;
+      }
+      return false;
+    }
+    
+    void sleep()
+    {
+      lock l(sleep_mutex_);
+      ++n_sleeping_;
+      if( !pending_ && !stopped() )
+      {
+        sleep_cond_.wait_for(l,std::chrono::milliseconds(WAKEUP_FREQ));
+      }
+      --n_sleeping_;
+    }
+    
+    void entry(size_t id)
+    {
+      // synchronize between the threads and the constructor
+      barrier_.wait();
+      
+      while( !stopped() )
+      {
+        ITEM tmp;
+        if( !pop_own(id, tmp) && !steal(id, tmp) )
+        {
+          sleep();
+          continue;
+        }
+        --pending_;
+        
+        try
+        {
+          handler_(tmp);
+        }
+        catch( const std::exception & e )
+        {
+          std::cerr << "exception caught: " << e.what() << "\n";
+        }
+        catch(...)
+        {
+          std::cerr << "unknown exception caught\n";
+        }
+        
+        // signal wait_empty, no matter what the result was
+        ++done_;
+        if( n_progress_waiting_ > 0 )
+        {
+          lock l(progress_mutex_);
+          progress_cond_.notify_all();
+        }
+      }
+    }
+  };
+
+}}
@@ -620,4 +620,11 @@ namespace virtdb { namespace util {
     valid_subscription((const char *)msg.data(), msg.size(), result);    
   }
 
+  void
+  zmq_socket_wrapper::free_message_buffer(void * data, void * hint)
+  {
+    unsigned char * buffer = reinterpret_cast<unsigned char *>(data);
+    delete [] buffer;
+  }
+
 }}
@@ -1,7 +1,9 @@
 #pragma once
 
 #include <zmq.hpp>
+#include <util/constants.hh>
 #include <string>
+#include <memory>
 #include <set>
 #include <future>
 #include <mutex>
@@ -91,6 +93,31 @@ namespace virtdb { namespace util {
     static void valid_subscription(const zmq::message_t & msg,
                                    std::string & result);
     
+    // releases buffers handed over to zmq by serialize_to_message
+    static void free_message_buffer(void * data, void * hint);
+    
+    // serializes the message once, into a buffer that is owned by msg
+    // and freed by zmq when the last reference to it is gone. byte_size
+    // must be the value the last ByteSize() call returned on pb
+    template <typename PB>
+    static bool serialize_to_message(const PB & pb,
+                                     int byte_size,
+                                     zmq::message_t & msg)
+    {
+      if( byte_size <= 0 || (unsigned long)byte_size > MAX_0MQ_MESSAGE_SIZE )
+        return false;
+      
+      std::unique_ptr<unsigned char []> buffer{new unsigned char[byte_size]};
+      unsigned char * end = pb.SerializeWithCachedSizesToArray(buffer.get());
+      if( end != buffer.get()+byte_size )
+        return false;
+      
+      msg.rebuild(buffer.get(), byte_size, &free_message_buffer, nullptr);
+      // zmq owns the buffer from now
+      buffer.release();
+      return true;
+    }
+    
   private:
     zmq_socket_wrapper() = delete;
     zmq_socket_wrapper(const zmq_socket_wrapper &) = delete;